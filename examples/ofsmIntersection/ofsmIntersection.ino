@@ -139,7 +139,11 @@ void OnCrosswalkButtonPressed(){
 }
 
 void ISR_ButtonPress() {
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+    ofsm_isr_queue_group_event(CrosswalkGrp, false, BUTTON_PRESSED, 0); /*only stage the event; main loop queues it*/
+#else
     ofsm_queue_group_event(CrosswalkGrp, false, BUTTON_PRESSED, 0);
+#endif
 }
 
 void OnCrosswalkArmButton(){
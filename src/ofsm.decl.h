@@ -15,27 +15,77 @@
 #   include <iostream>
 #	include <fstream>
 #   include <thread>
+#   include <chrono>
 #   include <string>
 #   include <deque>
+#   include <vector>
 #   include <sstream>
 #   include <algorithm>
 #   include <mutex>
 #   include <condition_variable>
+#   include <new>
 #	include <functional>
 #	include <cctype>
 #	include <locale>
+#	include <cmath>
 #   include <string.h>
 #	include <stdio.h>
-#   define _OFSM_TIME_DATA_TYPE unsigned long
+/*energy model is applied to sleep periods accounted by sleep statistics*/
+#   if defined(OFSM_CONFIG_SIMULATION_ENERGY_MODEL) && !defined(OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS)
+#       define OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+#   endif
 #else
-#   define _OFSM_TIME_DATA_TYPE unsigned long
+#   ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+#       error "OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE allocates memory on heap and is available in host (simulation) builds only"
+#   endif
+#endif
+
+/*default time data type; must be unsigned (see time comparison below)*/
+#ifndef OFSM_CONFIG_TIME_DATA_TYPE
+#   define OFSM_CONFIG_TIME_DATA_TYPE unsigned long
 #endif
+#define _OFSM_TIME_DATA_TYPE OFSM_CONFIG_TIME_DATA_TYPE
 
 /*default event data type*/
 #ifndef OFSM_CONFIG_EVENT_DATA_TYPE
 #	define OFSM_CONFIG_EVENT_DATA_TYPE uint8_t
 #endif
 
+/*default group/FSM index data type; must be unsigned. Limits number of groups and number of FSMs in a group*/
+#ifndef OFSM_CONFIG_INDEX_DATA_TYPE
+#   define OFSM_CONFIG_INDEX_DATA_TYPE uint8_t
+#endif
+#define _OFSM_INDEX_DATA_TYPE OFSM_CONFIG_INDEX_DATA_TYPE
+
+/*storage class of current orchestrator pointer; each thread selects its own orchestrator*/
+#if defined(OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES) && !defined(OFSM_CONFIG_THREAD_LOCAL)
+#   ifdef OFSM_CONFIG_SIMULATION
+#       define OFSM_CONFIG_THREAD_LOCAL thread_local
+#   else
+#       define OFSM_CONFIG_THREAD_LOCAL
+#   endif
+#endif
+
+/*size of ISR staging ring; must be power of 2, so that free running head/tail counters can be masked*/
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+#   ifndef OFSM_CONFIG_ISR_STAGING_SIZE
+#       define OFSM_CONFIG_ISR_STAGING_SIZE 8
+#   endif
+#   if (OFSM_CONFIG_ISR_STAGING_SIZE & (OFSM_CONFIG_ISR_STAGING_SIZE - 1)) || OFSM_CONFIG_ISR_STAGING_SIZE > 128
+#       error "OFSM_CONFIG_ISR_STAGING_SIZE must be power of 2 and not greater than 128"
+#   endif
+#endif
+
+/*size of broadcast queue of global events; must be power of 2, so that free running sequence numbers can be masked*/
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+#   ifndef OFSM_CONFIG_BROADCAST_QUEUE_SIZE
+#       define OFSM_CONFIG_BROADCAST_QUEUE_SIZE 4
+#   endif
+#   if (OFSM_CONFIG_BROADCAST_QUEUE_SIZE & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)) || OFSM_CONFIG_BROADCAST_QUEUE_SIZE > 128
+#       error "OFSM_CONFIG_BROADCAST_QUEUE_SIZE must be power of 2 and not greater than 128"
+#   endif
+#endif
+
 /*--------------------------------
 Type definitions
 ----------------------------------*/
@@ -44,9 +94,16 @@ struct OFSMEventData;
 struct OFSM;
 struct OFSMState;
 struct OFSMGroup;
+struct OFSMArray;
+struct OFSMPool;
+struct OFSMEventPool;
+struct OFSMStagedEvent;
+struct OFSMTopic;
+struct OFSMOrchestrator;
+struct OFSMSleepStatistics;
 typedef void(*OFSMHandler)();
 
-/*#define ofsm_get_time(time,timeFlags) //see implementation below */
+/*#define ofsm_get_time(time) //see implementation below (deprecated form: ofsm_get_time(time, timeFlags))*/
 
 /*------------------------------------------------
 The ofsm_debug_printf() available in both simulation and non-simulated modes.
@@ -55,16 +112,52 @@ Sketch code that uses this function may be left untouched when compiled for MCU
 -------------------------------------------------*/
 /*#define ofsm_debug_printf(...) //see implementation below*/
 
-void ofsm_queue_global_event(bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData);
-void ofsm_queue_group_event(uint8_t groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData);
+/*result of ofsm_queue...(); ordered by severity*/
+enum OFSMQueueStatus {
+    OFSM_QUEUE_STATUS_QUEUED = 0,       /*event took new queue slot*/
+    OFSM_QUEUE_STATUS_REPLACED,         /*event replaced last queued event with the same event code*/
+    OFSM_QUEUE_STATUS_BACKPRESSURE,     /*event is queued (or replaced), but queue reached its high watermark; producer should slow down (see OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE)*/
+    OFSM_QUEUE_STATUS_DROPPED           /*queue is full, event is lost*/
+};
+
+OFSMQueueStatus ofsm_queue_global_event(bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData);
+OFSMQueueStatus ofsm_queue_group_event(_OFSM_INDEX_DATA_TYPE groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData);
 static inline void ofsm_heartbeat(_OFSM_TIME_DATA_TYPE currentTime)  __attribute__((__always_inline__));
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+static inline OFSMQueueStatus ofsm_isr_queue_group_event(_OFSM_INDEX_DATA_TYPE groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) __attribute__((__always_inline__));
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_SNAPSHOT
+#   include <stddef.h> /*for size_t*/
+/*copy OFSM run time state into buffer; returns snapshot size (snapshot is written only if it fits into bufferSize)*/
+size_t ofsm_snapshot(void *buffer, size_t bufferSize);
+bool ofsm_restore(const void *snapshot, size_t snapshotSize);
+#endif
 
-void _ofsm_queue_group_event(uint8_t groupIndex, OFSMGroup *group, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData);
-static inline void _ofsm_group_process_pending_event(OFSMGroup *group, uint8_t groupIndex, _OFSM_TIME_DATA_TYPE *groupEarliestWakeupTime, uint8_t *groupAndedFsmFlags) __attribute__((__always_inline__));
-static inline void _ofsm_fsm_process_event(OFSM *fsm, uint8_t groupIndex, uint8_t fsmIndex, OFSMEventData *e) __attribute__((__always_inline__));
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+OFSMQueueStatus ofsm_queue_group_event_deadline(_OFSM_INDEX_DATA_TYPE groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData, _OFSM_TIME_DATA_TYPE deadlineTicks);
+OFSMQueueStatus _ofsm_queue_group_event_deadline(_OFSM_INDEX_DATA_TYPE groupIndex, OFSMGroup *group, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData, _OFSM_TIME_DATA_TYPE deadlineTicks);
+static inline _OFSM_INDEX_DATA_TYPE _ofsm_edf_select_group() __attribute__((__always_inline__));
+#endif
+OFSMQueueStatus _ofsm_queue_group_event(_OFSM_INDEX_DATA_TYPE groupIndex, OFSMGroup *group, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData);
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+static inline void _ofsm_group_process_pending_event(OFSMGroup *group, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_TIME_DATA_TYPE *groupEarliestWakeupTime, uint8_t *groupAndedFsmFlags, _OFSM_TIME_DATA_TYPE *groupLatestWakeupTime) __attribute__((__always_inline__));
+#else
+static inline void _ofsm_group_process_pending_event(OFSMGroup *group, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_TIME_DATA_TYPE *groupEarliestWakeupTime, uint8_t *groupAndedFsmFlags) __attribute__((__always_inline__));
+#endif
+static inline void _ofsm_fsm_process_event(OFSM *fsm, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_INDEX_DATA_TYPE fsmIndex, OFSMEventData *e) __attribute__((__always_inline__));
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+OFSM* _ofsm_spawn_fsm(_OFSM_INDEX_DATA_TYPE groupIndex, OFSMTransition **transitionTable, uint8_t transitionTableEventCount, void *fsmPrivateDataPtr, uint8_t initialState);
+void ofsm_destroy_fsm(_OFSM_INDEX_DATA_TYPE groupIndex, OFSM *fsm);
+static inline void _ofsm_fsm_pool_release_destroyed(OFSMGroup *group) __attribute__((__always_inline__));
+#endif
 static inline void _ofsm_check_timeout() __attribute__((__always_inline__));
 void _ofsm_setup();
 void _ofsm_start();
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+static inline void _ofsm_sleep_statistics_enter() __attribute__((__always_inline__));
+static inline void _ofsm_sleep_statistics_exit() __attribute__((__always_inline__));
+#endif
 
 /*see declaration of fsm_... macros below*/
 
@@ -82,6 +175,8 @@ Common defines
 
 #define OFSM_NOP_HANDLER (OFSMHandler)(-1)
 
+#define OFSM_NO_DEADLINE ((_OFSM_TIME_DATA_TYPE)-1)
+
 /*---------------------
 Simulation defines
 -----------------------*/
@@ -92,11 +187,10 @@ volatile char _ofsm_simulation_assert_compare_string[1024];
 
 #undef OFSM_MCU_BLOCK
 
+void _ofsm_simulation_set_assert_compare_string(const char *str);
 #define ofsm_simulation_set_assert_compare_string(str) \
 OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
-    std::string s = str; \
-    s = trim(s); \
-    _ofsm_strncpy((char*)_ofsm_simulation_assert_compare_string, s.c_str(), 1023); \
+    _ofsm_simulation_set_assert_compare_string(str); \
 }
 
 /*DEBUG should be turned on during simulation*/
@@ -118,18 +212,18 @@ OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
 #ifdef OFSM_CONFIG_SIMULATION_DEBUG_PRINT_ADD_TIMESTAMP
 #   define ofsm_debug_printf(level,  ...) \
         if( level <= OFSM_CONFIG_SIMULATION_DEBUG_LEVEL ) { \
-            OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
+            _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_DEBUG_PRINT) { \
                 _OFSM_TIME_DATA_TYPE __time; \
-                ofsm_get_time(__time, __time); \
+                ofsm_get_time(__time); \
                 printf("[%lu] ", (long unsigned int)__time); \
                 printf(__VA_ARGS__); \
             } \
         }
 #   define _ofsm_debug_printf(level,  ...) \
         if( level <= OFSM_CONFIG_SIMULATION_DEBUG_LEVEL_OFSM ) { \
-            OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
+            _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_DEBUG_PRINT) { \
                 _OFSM_TIME_DATA_TYPE __time; \
-                ofsm_get_time(__time, __time); \
+                ofsm_get_time(__time); \
                 printf("[%lu] ", (long unsigned int)__time); \
                 printf(__VA_ARGS__); \
             } \
@@ -137,13 +231,13 @@ OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
 #else
 #   define ofsm_debug_printf(level,  ...) \
         if (level <= OFSM_CONFIG_SIMULATION_DEBUG_LEVEL) { \
-            OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
+            _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_DEBUG_PRINT) { \
                 printf(__VA_ARGS__); \
             } \
         }
 #   define _ofsm_debug_printf(level,  ...) \
         if (level <= OFSM_CONFIG_SIMULATION_DEBUG_LEVEL_OFSM) { \
-            OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
+            _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_DEBUG_PRINT) { \
                 printf(__VA_ARGS__); \
             } \
         }
@@ -156,6 +250,59 @@ OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
 #	define OFSM_CONFIG_SIMULATION_TICK_MS 1000
 #endif
 
+#ifndef OFSM_CONFIG_SIMULATION_TICK_US
+#	define OFSM_CONFIG_SIMULATION_TICK_US (OFSM_CONFIG_SIMULATION_TICK_MS * 1000L)
+#endif
+
+/*simulated MCU used by sleep planner model (see 'sl[eep]' simulation command)*/
+#ifndef OFSM_CONFIG_SIMULATION_F_CPU
+#	define OFSM_CONFIG_SIMULATION_F_CPU 16000000L
+#endif
+
+#ifndef OFSM_CONFIG_SIMULATION_WDT_CLOCK_ERROR_PPM
+#	define OFSM_CONFIG_SIMULATION_WDT_CLOCK_ERROR_PPM 0
+#endif
+
+/*simulation script parser limits (see PC SIMULATION EVENT GENERATOR)*/
+#ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MAX_LINE_LENGTH
+#	define OFSM_CONFIG_SIMULATION_SCRIPT_MAX_LINE_LENGTH 1024
+#endif
+
+#ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MAX_TOKENS
+#	define OFSM_CONFIG_SIMULATION_SCRIPT_MAX_TOKENS 16
+#endif
+
+#ifndef OFSM_CONFIG_SIMULATION_SCRIPT_BUFFER_SIZE
+#	define OFSM_CONFIG_SIMULATION_SCRIPT_BUFFER_SIZE 65536
+#endif
+
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+/*default current draw and wakeup costs of ATmega328P at 16MHz/5V*/
+#   ifndef OFSM_CONFIG_SIMULATION_ENERGY_ACTIVE_UA
+#       define OFSM_CONFIG_SIMULATION_ENERGY_ACTIVE_UA 12000
+#   endif
+#   ifndef OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_UA
+#       define OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_UA 3500
+#   endif
+#   ifndef OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_UA
+#       define OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_UA 6       /*power-down with watchdog timer running*/
+#   endif
+#   ifndef OFSM_CONFIG_SIMULATION_ENERGY_WAKEUP_NC
+#       define OFSM_CONFIG_SIMULATION_ENERGY_WAKEUP_NC 1200        /*main loop pass after wakeup (~100us active)*/
+#   endif
+#   ifndef OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_WAKEUP_NC
+#       define OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_WAKEUP_NC 60 /*timer0 overflow interrupt (~5us active)*/
+#   endif
+#   ifndef OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_WAKEUP_NC
+#       define OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_WAKEUP_NC 12000 /*start-up from power-down (16K CK, ~1ms)*/
+#   endif
+#   ifndef OFSM_CONFIG_CUSTOM_SIMULATION_ENERGY_MODEL_FUNC
+    double _ofsm_simulation_energy_model(_OFSM_TIME_DATA_TYPE awakeTicks, _OFSM_TIME_DATA_TYPE sleepTicks, bool deepSleep);
+#       define OFSM_CONFIG_CUSTOM_SIMULATION_ENERGY_MODEL_FUNC _ofsm_simulation_energy_model
+#       define _OFSM_IMPL_SIMULATION_ENERGY_MODEL
+#   endif
+#endif /*OFSM_CONFIG_SIMULATION_ENERGY_MODEL*/
+
 #ifdef OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE
 #	define OFSM_CONFIG_SIMULATION_SCRIPT_MODE
 #endif
@@ -164,10 +311,31 @@ OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
 #   define OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE 3
 #endif
 
+/*parallel runner forks isolated worker process per script case (see PC SIMULATION PARALLEL RUNNER)*/
+#if defined(OFSM_CONFIG_SIMULATION_SCRIPT_MODE) && (defined(__unix__) || defined(__APPLE__)) && !defined(OFSM_CONFIG_SIMULATION_CUSTOM_MAIN)
+#   include <unistd.h>
+#   include <sys/wait.h>
+#   define _OFSM_IMPL_SIMULATION_PARALLEL_RUNNER
+#endif
+
+/*trace is recorded by threaded simulation and replayed by script mode (see PC SIMULATION TRACE RECORD AND REPLAY).
+Recorder serializes main loop passes by simulation mutex, so it requires default atomic block of single orchestrator;
+replay feeds events without wakeup, so it requires OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE 2 or 3*/
+#ifdef OFSM_CONFIG_SIMULATION_TRACE
+#   ifdef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+#       if OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE >= 2
+#           define _OFSM_IMPL_SIMULATION_TRACE_REPLAY
+#       endif
+#   elif !defined(OFSM_CONFIG_ATOMIC_BLOCK) && !defined(OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES)
+#       define _OFSM_IMPL_SIMULATION_TRACE_RECORD
+#   endif
+#endif
+
+/*default event generator is always available, so that custom one can delegate script parsing to it*/
+int _ofsm_simulation_event_generator(const char *fileName);
+#define _OFSM_IMPL_EVENT_GENERATOR
 #ifndef OFSM_CONFIG_CUSTOM_SIMULATION_EVENT_GENERATOR_FUNC
-    int _ofsm_simulation_event_generator(const char *fileName);
 #	define OFSM_CONFIG_CUSTOM_SIMULATION_EVENT_GENERATOR_FUNC _ofsm_simulation_event_generator
-#	define _OFSM_IMPL_EVENT_GENERATOR
 #endif
 
 #ifndef OFSM_CONFIG_CUSTOM_WAKEUP_FUNC
@@ -183,12 +351,22 @@ OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
 #endif
 
 #ifndef OFSM_CONFIG_ATOMIC_BLOCK
+#   ifdef OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+    /*each orchestrator has its own lock (see OFSMOrchestrator)*/
+    static thread_local uint8_t _ofsm_simulation_atomic_counter;
+#	    define _OFSM_IMPL_SIMULATION_ORCHESTRATOR_MUTEX
+#   else
     static std::recursive_mutex _ofsm_simulation_mutex;
     static uint8_t _ofsm_simulation_atomic_counter;
+#   endif
 #	ifdef OFSM_CONFIG_ATOMIC_RESTORESTATE
 #		undef OFSM_CONFIG_ATOMIC_RESTORESTATE
 #	endif
-#	define OFSM_CONFIG_ATOMIC_RESTORESTATE _ofsm_simulation_mutex
+#   ifdef OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+#	    define OFSM_CONFIG_ATOMIC_RESTORESTATE (_ofsmOrchestrator->simulationMutex)
+#   else
+#	    define OFSM_CONFIG_ATOMIC_RESTORESTATE _ofsm_simulation_mutex
+#   endif
 #	define OFSM_CONFIG_ATOMIC_BLOCK(type) for(type.lock(), _ofsm_simulation_atomic_counter = 0; _ofsm_simulation_atomic_counter++ < 1; type.unlock())
 #endif /*OFSM_CONFIG_ATOMIC_BLOCK*/
 
@@ -292,9 +470,64 @@ static inline void _ofsm_enter_sleep() __attribute__((__always_inline__));
 
 #endif /*OFSM_CONFIG_SIMULATION*/
 
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+/*number of hold time histogram buckets; bucket 0 - below 1us, bucket k - [2^(k-1), 2^k) us, last bucket - the rest*/
+#   ifndef OFSM_CONFIG_CRITICAL_SECTION_HISTOGRAM_SIZE
+#       define OFSM_CONFIG_CRITICAL_SECTION_HISTOGRAM_SIZE 8
+#   endif
+#   ifndef OFSM_CONFIG_CUSTOM_CRITICAL_SECTION_MICROS_FUNC
+#       ifdef OFSM_CONFIG_SIMULATION
+static inline unsigned long _ofsm_simulation_critical_section_micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#           define OFSM_CONFIG_CUSTOM_CRITICAL_SECTION_MICROS_FUNC _ofsm_simulation_critical_section_micros
+#       else
+#           define OFSM_CONFIG_CUSTOM_CRITICAL_SECTION_MICROS_FUNC micros
+#       endif
+#   endif
+#endif
+
 /*--------------------------------
 Type definitions
 ----------------------------------*/
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+/*OFSM atomic block sites, see CRITICAL SECTION STATISTICS*/
+enum OFSMCriticalSection {
+    OFSM_CRITICAL_SECTION_QUEUE = 0,            /*ofsm_queue...(), ofsm_isr_queue_group_event()*/
+    OFSM_CRITICAL_SECTION_DEQUEUE,              /*group takes its pending event*/
+    OFSM_CRITICAL_SECTION_MAIN_LOOP,            /*main loop flags and wakeup time, EDF group selection*/
+    OFSM_CRITICAL_SECTION_HEARTBEAT,            /*ofsm_heartbeat()*/
+    OFSM_CRITICAL_SECTION_GET_TIME,             /*ofsm_get_time()*/
+    OFSM_CRITICAL_SECTION_DEBUG_PRINT,          /*time stamped debug print (simulation)*/
+    OFSM_CRITICAL_SECTION_SLEEP_STATISTICS,
+    OFSM_CRITICAL_SECTION_FSM_POOL,             /*FSM spawn/destroy*/
+    OFSM_CRITICAL_SECTION_SNAPSHOT,             /*ofsm_snapshot(), ofsm_restore()*/
+    OFSM_CRITICAL_SECTION_COUNT
+};
+
+struct OFSMCriticalSectionStatistics {
+    unsigned long   count;
+    unsigned long   maxHoldUs;
+    uint16_t        histogram[OFSM_CONFIG_CRITICAL_SECTION_HISTOGRAM_SIZE]; /*saturating counters*/
+};
+
+void _ofsm_critical_section_record(uint8_t site, unsigned long holdUs);
+
+/*measures the time atomic block is held; lives within the block, so that it gets recorded before interrupts are enabled (lock released)*/
+struct _OFSMCriticalSectionTimer {
+    uint8_t         site;
+    uint8_t         once;
+    unsigned long   startUs;
+    _OFSMCriticalSectionTimer(uint8_t s) : site(s), once(1), startUs(OFSM_CONFIG_CUSTOM_CRITICAL_SECTION_MICROS_FUNC()) {}
+    ~_OFSMCriticalSectionTimer() { _ofsm_critical_section_record(site, OFSM_CONFIG_CUSTOM_CRITICAL_SECTION_MICROS_FUNC() - startUs); }
+};
+#   define _OFSM_ATOMIC_BLOCK(site) \
+        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) \
+            for (_OFSMCriticalSectionTimer _ofsmCriticalSectionTimer(site); _ofsmCriticalSectionTimer.once; _ofsmCriticalSectionTimer.once = 0)
+#else
+#   define _OFSM_ATOMIC_BLOCK(site) OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE)
+#endif
+
 struct OFSMTransition {
     OFSMHandler eventHandler;
     uint8_t newState;
@@ -305,43 +538,160 @@ struct OFSMEventData {
 #ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
     OFSM_CONFIG_EVENT_DATA_TYPE eventData;
 #endif
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+    _OFSM_TIME_DATA_TYPE        enqueueTime;    /*time (in ticks) when event was queued*/
+    _OFSM_TIME_DATA_TYPE        deadline;       /*deadline relative to enqueueTime; OFSM_NO_DEADLINE if none*/
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+    uint8_t                     broadcastSeq;   /*group event: sequence number of the next broadcast event at the time it was queued; keeps FIFO order with global events*/
+#endif
 };
 
+/*Hot fields (read by main loop for every FSM on every iteration) come first, widest first, so that they share single cache line and don't need padding between them.
+Cold fields (read when FSM handles an event or during initialization) follow.*/
 struct OFSM {
-    OFSMTransition**    transitionTable;
-    uint8_t             transitionTableEventCount;  /*number of elements in each row (number of events defined)*/
-    void*               fsmPrivateInfo;
-    uint8_t             flags;
     _OFSM_TIME_DATA_TYPE wakeupTime;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    _OFSM_TIME_DATA_TYPE wakeupSlack;           /* FSM accepts timeout up to wakeupSlack ticks after wakeupTime*/
+#endif
+    uint8_t             flags;
     uint8_t             currentState;
     uint8_t             skipNextEventCode;     /* skip (once) processing of specified event event code */
+    uint8_t             transitionTableEventCount;  /*number of elements in each row (number of events defined)*/
+#ifdef OFSM_CONFIG_SIMULATION
+    uint8_t             simulationInitialState; /* store initial state, so that it can be restored during simulation reset; fills padding of hot part*/
+#endif /* OFSM_CONFIG_SIMULATION */
+    OFSMTransition**    transitionTable;
+    void*               fsmPrivateInfo;
 #ifdef OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER
     OFSMHandler         initHandler;                /*optional, can be null*/
 #endif
-#ifdef OFSM_CONFIG_SIMULATION
-    uint8_t             simulationInitialState; /* store initial state, so that it can be restored during simulation reset*/
-#endif /* OFSM_CONFIG_SIMULATION */
 };
 
 struct OFSMState {
     OFSM					*fsm;
     OFSMEventData*			e;
     _OFSM_TIME_DATA_TYPE	timeLeftBeforeTimeout;      /*time left before timeout set by previous transition*/
-    uint8_t					groupIndex;                 /*group index where current fsm is registered*/
-    uint8_t					fsmIndex;	                /*fsm index within group*/
+    _OFSM_INDEX_DATA_TYPE	groupIndex;                 /*group index where current fsm is registered*/
+    _OFSM_INDEX_DATA_TYPE	fsmIndex;	                /*fsm index within group*/
 };
 
 struct OFSMGroup {
     OFSM**					fsms;
-    uint8_t					groupSize;
+    _OFSM_INDEX_DATA_TYPE	groupSize;
     OFSMEventData*			eventQueue;
-    uint8_t					eventQueueSize;
+    _OFSM_INDEX_DATA_TYPE	eventQueueSize;
 
     volatile uint8_t		flags;
-    volatile uint8_t		nextEventIndex; //queue cell index that is available for new event
-    volatile uint8_t		currentEventIndex; //queue cell that is being processed by ofsm
+    volatile _OFSM_INDEX_DATA_TYPE nextEventIndex; //queue cell index that is available for new event
+    volatile _OFSM_INDEX_DATA_TYPE currentEventIndex; //queue cell that is being processed by ofsm
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+    _OFSM_TIME_DATA_TYPE    eventDeadline;      //default relative deadline of events queued into the group
+    volatile uint16_t       deadlineMissCount;  //number of events that were processed after their deadline
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+    OFSMArray*              fsmArray;           //when set, group consists of FSM array instances and fsms is NULL
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+    OFSMPool*               fsmPool;            //when set, fsms holds groupSize FSMs spawned from the pool
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+    OFSMEventPool*          eventPool;          //when set, events are taken from shared pool (eventQueue is NULL and eventQueueSize is number of reserved events)
+    _OFSM_INDEX_DATA_TYPE   eventHead;          //pool slot of the event that is processed next
+    _OFSM_INDEX_DATA_TYPE   eventTail;          //pool slot of the last queued event
+    volatile _OFSM_INDEX_DATA_TYPE eventCount;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+    OFSMEventData*          eventQueueInitial;      //declared ring buffer; eventQueue points to heap once the ring has grown
+    _OFSM_INDEX_DATA_TYPE   eventQueueInitialSize;
+    _OFSM_INDEX_DATA_TYPE   eventQueueMaxSize;      //ring grows up to this size
+    _OFSM_INDEX_DATA_TYPE   eventQueueHighWatermark;//pending event count from which queuing reports backpressure; 0 - never
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+    uint8_t                 broadcastCursor;        //sequence number of the next broadcast event the group takes
+#endif
 };
 
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+/*FSM array: identical FSM instances, whose per instance state is stored in parallel arrays (struct of arrays).
+Transition table, event count, private data and initialization handler are stored once in the 'cursor' FSM;
+instance state is loaded into the cursor before dispatch and stored back after it.*/
+struct OFSMArray {
+    OFSM*                   cursor;
+    uint8_t                 initialState;
+    uint8_t*                flags;
+    _OFSM_TIME_DATA_TYPE*   wakeupTime;
+    uint8_t*                currentState;
+    uint8_t*                skipNextEventCode;
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    _OFSM_TIME_DATA_TYPE*   wakeupSlack;
+#   endif
+};
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+/*fixed capacity storage of FSMs that are spawned/destroyed at run time.
+Free slots are linked into free list; destroyed FSMs are linked into pending list until group releases them (see ofsm_destroy_fsm())*/
+struct OFSMPool {
+    OFSM*                   slots;
+    uint8_t*                slotState;          /*_OFSM_POOL_SLOT_...*/
+    _OFSM_INDEX_DATA_TYPE*  position;           /*position of spawned FSM in group fsms*/
+    _OFSM_INDEX_DATA_TYPE*  next;               /*next slot in free or pending list*/
+    _OFSM_INDEX_DATA_TYPE   capacity;
+    _OFSM_INDEX_DATA_TYPE   freeHead;           /*capacity, when list is empty*/
+    _OFSM_INDEX_DATA_TYPE   pendingHead;
+};
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+/*event slots shared by several groups; each group links its events into FIFO list.
+Free slots are linked into free list. reservedFree slots of free list are held back for groups that have less events queued than they reserved.*/
+struct OFSMEventPool {
+    OFSMEventData*          events;
+    _OFSM_INDEX_DATA_TYPE*  next;               /*next slot in group FIFO or free list*/
+    _OFSM_INDEX_DATA_TYPE   size;
+    _OFSM_INDEX_DATA_TYPE   freeHead;           /*size, when list is empty*/
+    _OFSM_INDEX_DATA_TYPE   freeCount;
+    _OFSM_INDEX_DATA_TYPE   reservedFree;
+};
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_TOPICS
+/*groups subscribed to a topic; see TOPICS*/
+struct OFSMTopic {
+    const _OFSM_INDEX_DATA_TYPE*    subscribers;    /*group indexes*/
+    _OFSM_INDEX_DATA_TYPE           subscriberCount;
+};
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+/*raw event written by ISR into staging ring; main loop moves it into group event queue*/
+struct OFSMStagedEvent {
+    _OFSM_INDEX_DATA_TYPE           groupIndex;
+    uint8_t                         eventCode;
+    uint8_t                         forceNewEvent;
+#   ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
+    OFSM_CONFIG_EVENT_DATA_TYPE     eventData;
+#   endif
+};
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+struct OFSMSleepStatistics {
+    _OFSM_TIME_DATA_TYPE    awakeTicks;                 /*ticks spent processing events*/
+    _OFSM_TIME_DATA_TYPE    idleSleepTicks;
+    _OFSM_TIME_DATA_TYPE    deepSleepTicks;
+    unsigned long           timeoutWakeupCount;         /*main loop wakeups caused by scheduled timeout*/
+    unsigned long           eventWakeupCount;           /*main loop wakeups caused by queued event*/
+    unsigned long           watchdogWakeupCount;        /*MCU wakeups caused by watchdog timer (deep sleep step)*/
+    unsigned long           interruptedDeepSleepCount;  /*deep sleeps interrupted by external event*/
+    _OFSM_TIME_DATA_TYPE    markTime;                   /*time of last sleep entry/exit*/
+    unsigned long           markTimeoutWakeupCount;
+    _OFSM_TIME_DATA_TYPE    markDeepSleepTicks;
+    uint8_t                 asleep;
+};
+#endif
+
 /*defined typedef void(*OFSMHandler)(OFSMState *fsmState);*/
 
 /*------------------------------------------------
@@ -349,9 +699,8 @@ Flags
 -------------------------------------------------*/
 //Common flags
 #define _OFSM_FLAG_INFINITE_SLEEP			0x1
-#define _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW	0x2 /*indicate if wakeup time is scheduled after post overflow of time register*/
 #define _OFSM_FLAG_ALLOW_DEEP_SLEEP         0x4
-#define _OFSM_FLAG_ALL (_OFSM_FLAG_INFINITE_SLEEP | _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW | _OFSM_FLAG_ALLOW_DEEP_SLEEP)
+#define _OFSM_FLAG_ALL (_OFSM_FLAG_INFINITE_SLEEP | _OFSM_FLAG_ALLOW_DEEP_SLEEP)
 
 //FSM Flags
 #define _OFSM_FLAG_FSM_PREVENT_TRANSITION			0x10
@@ -365,20 +714,113 @@ Flags
 //Orchestra Flags
 #define _OFSM_FLAG_OFSM_IN_DEEP_SLEEP   0x8   /*watch dog timer is running*/
 #define _OFSM_FLAG_OFSM_EVENT_QUEUED	0x10
-#define _OFSM_FLAG_OFSM_TIMER_OVERFLOW	0x20
 #define _OFSM_FLAG_OFSM_FIRST_ITERATION 0x40 /*allow timeout event while in infinite sleep, when timeout is queued before loop starts*/
 #define _OFSM_FLAG_OFSM_SIMULATION_EXIT	0x80
 #define _OFSM_FLAG_OFSM_IN_PROCESS		0x100
 
+/*FSM pool slot states*/
+#define _OFSM_POOL_SLOT_FREE                0
+#define _OFSM_POOL_SLOT_SPAWNED             1
+#define _OFSM_POOL_SLOT_DESTROY_PENDING     2
+
 /*------------------------------------------------
 Global variables
 -------------------------------------------------*/
+#ifdef OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+/*state of single orchestrator (set of groups with its own time, wakeup time, flags and lock); see ORCHESTRATOR INSTANCES*/
+struct OFSMOrchestrator {
+    OFSMGroup**				        groups;
+    _OFSM_INDEX_DATA_TYPE           groupCount;
+    OFSMState*						currentFsmState;
+    volatile uint16_t               flags;
+    volatile _OFSM_TIME_DATA_TYPE   wakeupTime;
+    volatile _OFSM_TIME_DATA_TYPE   time;
+#   ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    volatile OFSMSleepStatistics    sleepStatistics;
+#   endif
+#   ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+    _OFSM_INDEX_DATA_TYPE           edfGroupIndex;
+#   endif
+#   ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+    OFSMCriticalSectionStatistics   criticalSectionStatistics[OFSM_CRITICAL_SECTION_COUNT];
+#   endif
+#   ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+    OFSMEventData                   broadcastQueue[OFSM_CONFIG_BROADCAST_QUEUE_SIZE];
+    _OFSM_INDEX_DATA_TYPE           broadcastPending[OFSM_CONFIG_BROADCAST_QUEUE_SIZE];
+    volatile uint8_t                broadcastHead;
+    volatile uint8_t                broadcastTail;
+    uint8_t                         broadcastGroupEventQueued;
+#   endif
+#   ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+    OFSMStagedEvent                 isrStaging[OFSM_CONFIG_ISR_STAGING_SIZE];
+    volatile uint8_t                isrStagingHead;         /*written by ISR only*/
+    volatile uint8_t                isrStagingTail;         /*written by main loop only*/
+    volatile uint8_t                isrStagingDropCount;
+#   endif
+#   ifdef _OFSM_IMPL_SIMULATION_ORCHESTRATOR_MUTEX
+    std::recursive_mutex            simulationMutex;        /*atomic block lock*/
+#   endif
+#   ifdef OFSM_CONFIG_SIMULATION
+    std::mutex                      simulationSleepMutex;   /*main loop sleeps on simulationSleepCv*/
+    std::condition_variable         simulationSleepCv;
+#   endif
+};
+
+/*orchestrator the calling thread works with; threads start with default orchestrator*/
+extern OFSM_CONFIG_THREAD_LOCAL OFSMOrchestrator*   _ofsmOrchestrator;
+extern OFSMOrchestrator                             _ofsmDefaultOrchestrator;
+static inline OFSMOrchestrator* ofsm_orchestrator_select(OFSMOrchestrator *orchestrator) {
+    OFSMOrchestrator *prev = _ofsmOrchestrator;
+    _ofsmOrchestrator = orchestrator;
+    return prev;
+}
+
+/*the rest of OFSM code accesses current orchestrator through these names*/
+#   define _ofsmGroups              (_ofsmOrchestrator->groups)
+#   define _ofsmGroupCount          (_ofsmOrchestrator->groupCount)
+#   define _ofsmCurrentFsmState     (_ofsmOrchestrator->currentFsmState)
+#   define _ofsmFlags               (_ofsmOrchestrator->flags)
+#   define _ofsmWakeupTime          (_ofsmOrchestrator->wakeupTime)
+#   define _ofsmTime                (_ofsmOrchestrator->time)
+#   define _ofsmSleepStatistics     (_ofsmOrchestrator->sleepStatistics)
+#   define _ofsmEdfGroupIndex       (_ofsmOrchestrator->edfGroupIndex)
+#   define _ofsmCriticalSectionStatistics (_ofsmOrchestrator->criticalSectionStatistics)
+#   define _ofsmBroadcastQueue      (_ofsmOrchestrator->broadcastQueue)
+#   define _ofsmBroadcastPending    (_ofsmOrchestrator->broadcastPending)
+#   define _ofsmBroadcastHead       (_ofsmOrchestrator->broadcastHead)
+#   define _ofsmBroadcastTail       (_ofsmOrchestrator->broadcastTail)
+#   define _ofsmBroadcastGroupEventQueued (_ofsmOrchestrator->broadcastGroupEventQueued)
+#   define _ofsmIsrStaging          (_ofsmOrchestrator->isrStaging)
+#   define _ofsmIsrStagingHead      (_ofsmOrchestrator->isrStagingHead)
+#   define _ofsmIsrStagingTail      (_ofsmOrchestrator->isrStagingTail)
+#   define _ofsmIsrStagingDropCount (_ofsmOrchestrator->isrStagingDropCount)
+#else
 extern OFSMGroup**				        _ofsmGroups;
-extern uint8_t                          _ofsmGroupCount;
+extern _OFSM_INDEX_DATA_TYPE            _ofsmGroupCount;
 extern OFSMState*						_ofsmCurrentFsmState;
 extern volatile uint16_t                _ofsmFlags;
 extern volatile _OFSM_TIME_DATA_TYPE    _ofsmWakeupTime;
 extern volatile _OFSM_TIME_DATA_TYPE    _ofsmTime;
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+extern volatile OFSMSleepStatistics     _ofsmSleepStatistics;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+extern OFSMCriticalSectionStatistics    _ofsmCriticalSectionStatistics[OFSM_CRITICAL_SECTION_COUNT];
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+extern OFSMEventData                    _ofsmBroadcastQueue[OFSM_CONFIG_BROADCAST_QUEUE_SIZE];
+extern _OFSM_INDEX_DATA_TYPE            _ofsmBroadcastPending[OFSM_CONFIG_BROADCAST_QUEUE_SIZE];
+extern volatile uint8_t                 _ofsmBroadcastHead;
+extern volatile uint8_t                 _ofsmBroadcastTail;
+extern uint8_t                          _ofsmBroadcastGroupEventQueued;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+extern OFSMStagedEvent                  _ofsmIsrStaging[OFSM_CONFIG_ISR_STAGING_SIZE];
+extern volatile uint8_t                 _ofsmIsrStagingHead;
+extern volatile uint8_t                 _ofsmIsrStagingTail;
+extern volatile uint8_t                 _ofsmIsrStagingDropCount;
+#endif
+#endif /*OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES*/
 
 /*------------------------------------------------
 Macros
@@ -387,6 +829,10 @@ Macros
 
 #define fsm_set_transition_delay(delayTicks)		((_ofsmCurrentFsmState->fsm)[0].wakeupTime = delayTicks, (_ofsmCurrentFsmState->fsm)[0].flags |= _OFSM_FLAG_FSM_HANDLER_SET_TRANSITION_DELAY)
 #define fsm_set_transition_delay_deep_sleep(delayTicks) (fsm_set_transition_delay(delayTicks), (_ofsmCurrentFsmState->fsm)[0].flags |= _OFSM_FLAG_ALLOW_DEEP_SLEEP)
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+#   define fsm_set_transition_delay_slack(delayTicks, slackTicks) (fsm_set_transition_delay(delayTicks), (_ofsmCurrentFsmState->fsm)[0].wakeupSlack = slackTicks)
+#   define fsm_set_transition_delay_slack_deep_sleep(delayTicks, slackTicks) (fsm_set_transition_delay_deep_sleep(delayTicks), (_ofsmCurrentFsmState->fsm)[0].wakeupSlack = slackTicks)
+#endif
 #define fsm_set_infinite_delay()					((_ofsmCurrentFsmState->fsm)[0].flags |= _OFSM_FLAG_INFINITE_SLEEP)
 #define fsm_set_infinite_delay_deep_sleep()         (fsm_set_infinite_delay(), (_ofsmCurrentFsmState->fsm)[0].flags |= _OFSM_FLAG_ALLOW_DEEP_SLEEP)
 #define fsm_set_next_state(nextStateId)			    ((_ofsmCurrentFsmState->fsm)[0].flags |= _OFSM_FLAG_FSM_NEXT_STATE_OVERRIDE, (_ofsmCurrentFsmState->_ofsmCurrentFsmState)[0].currentState = nextStateId)
@@ -409,27 +855,112 @@ Macros
     (ofsm_queue_group_event(fsm_get_group_index(), forceNewEvent, eventCode, eventData), (_ofsmCurrentFsmState->fsm)[0].skipNextEventCode = eventCode)
 
 
-#define ofsm_get_time(outCurrentTime, outTimeFlags) \
-    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
-        outTimeFlags = _ofsmFlags & _OFSM_FLAG_OFSM_TIMER_OVERFLOW; \
+#define _ofsm_get_time(outCurrentTime) \
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_GET_TIME) { \
+        outCurrentTime = _ofsmTime; \
+    }
+/*DEPRECATED: time overflow is not tracked any more (see _OFSM_TIME_A_GT_B()), outTimeFlags is always 0*/
+#define _ofsm_get_time_flags(outCurrentTime, outTimeFlags) \
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_GET_TIME) { \
+        outTimeFlags = 0; \
         outCurrentTime = _ofsmTime; \
     }
+#define _OFSM_GET_TIME_SELECT(outCurrentTime, outTimeFlags, name, ...) name
+/*ofsm_get_time(outCurrentTime) or deprecated ofsm_get_time(outCurrentTime, outTimeFlags)*/
+#define ofsm_get_time(...) _OFSM_GET_TIME_SELECT(__VA_ARGS__, _ofsm_get_time_flags, _ofsm_get_time, 0)(__VA_ARGS__)
 
 #define ofsm_query_get_group(groupIndex) (_ofsmGroups[groupIndex])
-#define ofsm_query_get_fsm(groupIndex, fsmIndex) ((ofsm_query_get_group(groupIndex)->fsms)[fsmIndex])
+#define ofsm_query_get_fsm(groupIndex, fsmIndex) ((ofsm_query_get_group(groupIndex)->fsms)[fsmIndex]) /*not available for FSM array groups*/
+
+/*read access to FSM state that works for both regular and FSM array groups*/
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+#   define _OFSM_GROUP_FSM_FLAGS(group, fsmIndex) ((group)->fsmArray ? ((group)->fsmArray->flags)[fsmIndex] : ((group)->fsms)[fsmIndex]->flags)
+#   define _OFSM_GROUP_FSM_WAKEUP_TIME(group, fsmIndex) ((group)->fsmArray ? ((group)->fsmArray->wakeupTime)[fsmIndex] : ((group)->fsms)[fsmIndex]->wakeupTime)
+#   define _OFSM_GROUP_FSM_CURRENT_STATE(group, fsmIndex) ((group)->fsmArray ? ((group)->fsmArray->currentState)[fsmIndex] : ((group)->fsms)[fsmIndex]->currentState)
+#else
+#   define _OFSM_GROUP_FSM_FLAGS(group, fsmIndex) (((group)->fsms)[fsmIndex]->flags)
+#   define _OFSM_GROUP_FSM_WAKEUP_TIME(group, fsmIndex) (((group)->fsms)[fsmIndex]->wakeupTime)
+#   define _OFSM_GROUP_FSM_CURRENT_STATE(group, fsmIndex) (((group)->fsms)[fsmIndex]->currentState)
+#endif
+
+/*group event queue access that works for both private ring buffer and shared event pool*/
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+#   define _OFSM_GROUP_LOCAL_EVENT_QUEUE_IS_EMPTY(group) ((group)->eventPool ? (group)->eventCount == 0 : ((group)->currentEventIndex == (group)->nextEventIndex && !((group)->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW)))
+#   define _OFSM_GROUP_LOCAL_EVENT_QUEUE_HEAD(group) ((group)->eventPool ? &((group)->eventPool->events)[(group)->eventHead] : &((group)->eventQueue)[(group)->currentEventIndex])
+#else
+#   define _OFSM_GROUP_LOCAL_EVENT_QUEUE_IS_EMPTY(group) ((group)->currentEventIndex == (group)->nextEventIndex && !((group)->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW))
+#   define _OFSM_GROUP_LOCAL_EVENT_QUEUE_HEAD(group) (&((group)->eventQueue)[(group)->currentEventIndex])
+#endif
+/*group sees broadcast events (global events) merged with its own ones: broadcast event goes first, unless group event was queued before it*/
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+#   define _OFSM_GROUP_BROADCAST_EVENT_IS_NEXT(group) ((group)->broadcastCursor != _ofsmBroadcastHead && \
+        (_OFSM_GROUP_LOCAL_EVENT_QUEUE_IS_EMPTY(group) || _OFSM_GROUP_LOCAL_EVENT_QUEUE_HEAD(group)->broadcastSeq != (group)->broadcastCursor))
+#   define _OFSM_GROUP_EVENT_QUEUE_IS_EMPTY(group) (_OFSM_GROUP_LOCAL_EVENT_QUEUE_IS_EMPTY(group) && (group)->broadcastCursor == _ofsmBroadcastHead)
+#   define _OFSM_GROUP_EVENT_QUEUE_HEAD(group) (_OFSM_GROUP_BROADCAST_EVENT_IS_NEXT(group) ? \
+        &(_ofsmBroadcastQueue[(group)->broadcastCursor & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)]) : _OFSM_GROUP_LOCAL_EVENT_QUEUE_HEAD(group))
+#else
+#   define _OFSM_GROUP_EVENT_QUEUE_IS_EMPTY(group) _OFSM_GROUP_LOCAL_EVENT_QUEUE_IS_EMPTY(group)
+#   define _OFSM_GROUP_EVENT_QUEUE_HEAD(group) _OFSM_GROUP_LOCAL_EVENT_QUEUE_HEAD(group)
+#endif
 
 #define ofsm_query_flags() (_ofsmFlags)
 #define ofsm_query_group_flags(groupIndex) (ofsm_query_get_group(groupIndex)->flags)
-#define ofsm_query_fsm_time_left_before_timeout(groupIndex, fsmIndex) ((ofsm_query_get_fsm(groupIndex, fsmIndex)->wakeupTime == 0 || ofsm_query_get_fsm(groupIndex, fsmIndex)->wakeupTime < _ofsmTime) ? 0 : ofsm_query_get_fsm(groupIndex, fsmIndex)->wakeupTime - _ofsmTime)
-#define ofsm_query_fsm_next_state(groupIndex, fsmIndex) (ofsm_query_get_fsm(groupIndex, fsmIndex)->currentState)
-#define ofsm_query_fsm_flags(groupIndex, fsmIndex) (ofsm_query_get_fsm(groupIndex, fsmIndex)->flags)
+#define ofsm_query_fsm_time_left_before_timeout(groupIndex, fsmIndex) ((_OFSM_GROUP_FSM_WAKEUP_TIME(ofsm_query_get_group(groupIndex), fsmIndex) == 0 || _OFSM_TIME_A_GTE_B(_ofsmTime, _OFSM_GROUP_FSM_WAKEUP_TIME(ofsm_query_get_group(groupIndex), fsmIndex))) ? 0 : _OFSM_GROUP_FSM_WAKEUP_TIME(ofsm_query_get_group(groupIndex), fsmIndex) - _ofsmTime)
+#define ofsm_query_fsm_next_state(groupIndex, fsmIndex) (_OFSM_GROUP_FSM_CURRENT_STATE(ofsm_query_get_group(groupIndex), fsmIndex))
+#define ofsm_query_fsm_flags(groupIndex, fsmIndex) (_OFSM_GROUP_FSM_FLAGS(ofsm_query_get_group(groupIndex), fsmIndex))
+
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+/*copy sleep statistics into OFSMSleepStatistics outStatistics*/
+#   define ofsm_query_sleep_statistics(outStatistics) \
+        _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_SLEEP_STATISTICS) { \
+            outStatistics = *((OFSMSleepStatistics*)&_ofsmSleepStatistics); \
+        }
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+/*default limits of group event ring buffer; can be changed per group by ofsm_set_group_event_queue_limit() after OFSM_SETUP()*/
+#   ifndef OFSM_CONFIG_ELASTIC_QUEUE_MAX_SIZE
+#       define OFSM_CONFIG_ELASTIC_QUEUE_MAX_SIZE ((_OFSM_INDEX_DATA_TYPE)-1)
+#   endif
+#   ifndef OFSM_CONFIG_ELASTIC_QUEUE_HIGH_WATERMARK_PERCENT
+#       define OFSM_CONFIG_ELASTIC_QUEUE_HIGH_WATERMARK_PERCENT 75
+#   endif
+#   define ofsm_set_group_event_queue_limit(groupIndex, maxSize, highWatermark) \
+        (ofsm_query_get_group(groupIndex)->eventQueueMaxSize = (maxSize), ofsm_query_get_group(groupIndex)->eventQueueHighWatermark = (highWatermark))
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+/*copy statistics of atomic block site (OFSMCriticalSection) into OFSMCriticalSectionStatistics outStatistics*/
+#   define ofsm_query_critical_section_statistics(site, outStatistics) \
+        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
+            outStatistics = _ofsmCriticalSectionStatistics[site]; \
+        }
+#   define ofsm_reset_critical_section_statistics() \
+        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
+            memset((void*)_ofsmCriticalSectionStatistics, 0, sizeof(_ofsmCriticalSectionStatistics)); \
+        }
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+/*number of events dropped by ofsm_isr_queue_group_event() because staging ring was full (wraps around at 256)*/
+#   define ofsm_query_isr_staging_drop_count() (_ofsmIsrStagingDropCount)
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+#   define ofsm_set_group_event_deadline(groupIndex, deadlineTicks) (ofsm_query_get_group(groupIndex)->eventDeadline = deadlineTicks)
+#   define ofsm_query_group_deadline_miss_count(groupIndex) (ofsm_query_get_group(groupIndex)->deadlineMissCount)
+#   define fsm_queue_group_event_deadline(forceNewEvent, eventCode, eventData, deadlineTicks) \
+        ofsm_queue_group_event_deadline(fsm_get_group_index(), forceNewEvent, eventCode, eventData, deadlineTicks)
+#endif
 
 #define _OFSM_GET_TRANSTION(fsm, eventCode) ((OFSMTransition*)( (fsm->transitionTableEventCount * fsm->currentState +  eventCode) * sizeof(OFSMTransition) + (char*)fsm->transitionTable) )
 
-/*time comparison*/
-/*ao, bo - 'o' means overflow*/
-#define _OFSM_TIME_A_GT_B(a, ao, b, bo)  ( (a  >  b) && (ao || !bo) )
-#define _OFSM_TIME_A_GTE_B(a, ao, b, bo) ( (a  >=  b) && (ao || !bo) )
+/*time comparison (serial number arithmetic)*/
+/*'a' is later than 'b' when difference between them, taken modulo time data type range, is less than half of the range.
+Thus, time register overflow doesn't need to be tracked, as long as transition delays stay below _OFSM_TIME_HALF_RANGE.*/
+#define _OFSM_TIME_HALF_RANGE (((_OFSM_TIME_DATA_TYPE)-1) >> 1)
+#define _OFSM_TIME_A_GT_B(a, b)  ( (_OFSM_TIME_DATA_TYPE)((b) - (a)) > _OFSM_TIME_HALF_RANGE )
+#define _OFSM_TIME_A_GTE_B(a, b) ( (_OFSM_TIME_DATA_TYPE)((a) - (b)) <= _OFSM_TIME_HALF_RANGE )
 
 /*----------------------------------------------
 Setup helper macros
@@ -438,11 +969,41 @@ Setup helper macros
 #define _OFSM_DECLARE_GET(name, id) (name##id)
 #define _OFSM_DECLARE_GROUP_EVENT_QUEUE(grpId, eventQueueSize) OFSMEventData _ofsm_decl_grp_eq_##grpId[eventQueueSize];
 
-#define _OFSM_DECLARE_GROUP_FSM_ARRAY_1(grpId, fsmId0) OFSM *_ofsm_decl_grp_fsms_##grpId[] = { &_ofsm_decl_fsm_##fsmId0 };
-#define _OFSM_DECLARE_GROUP_FSM_ARRAY_2(grpId, fsmId0, fsmId1) OFSM *_ofsm_decl_grp_fsms_##grpId[] = { &_ofsm_decl_fsm_##fsmId0, &_ofsm_decl_fsm_##fsmId1 };
-#define _OFSM_DECLARE_GROUP_FSM_ARRAY_3(grpId, fsmId0, fsmId1, fsmId2) OFSM *_ofsm_decl_grp_fsms_##grpId[] = { &_ofsm_decl_fsm_##fsmId0, &_ofsm_decl_fsm_##fsmId1, &_ofsm_decl_fsm_##fsmId2 };
-#define _OFSM_DECLARE_GROUP_FSM_ARRAY_4(grpId, fsmId0, fsmId1, fsmId2, fsmId3) OFSM *_ofsm_decl_grp_fsms_##grpId[] = { &_ofsm_decl_fsm_##fsmId0, &_ofsm_decl_fsm_##fsmId1, &_ofsm_decl_fsm_##fsmId2, &_ofsm_decl_fsm_##fsmId3 };
-#define _OFSM_DECLARE_GROUP_FSM_ARRAY_5(grpId, fsmId0, fsmId1, fsmId2, fsmId3, fsmId4) OFSM *_ofsm_decl_grp_fsms_##grpId[] = { &_ofsm_decl_fsm_##fsmId0, &_ofsm_decl_fsm_##fsmId1, &_ofsm_decl_fsm_##fsmId2, &_ofsm_decl_fsm_##fsmId3, &_ofsm_decl_fsm_##fsmId4 };
+/*Variadic list mapping: _OFSM_DECLARE_MAP_LIST(f, a, b, c) expands into f(a), f(b), f(c).
+Recursion is emulated by repeated rescanning (_OFSM_DECLARE_EVAL), which allows up to 364 list elements.*/
+#define _OFSM_DECLARE_EVAL0(...) __VA_ARGS__
+#define _OFSM_DECLARE_EVAL1(...) _OFSM_DECLARE_EVAL0(_OFSM_DECLARE_EVAL0(_OFSM_DECLARE_EVAL0(__VA_ARGS__)))
+#define _OFSM_DECLARE_EVAL2(...) _OFSM_DECLARE_EVAL1(_OFSM_DECLARE_EVAL1(_OFSM_DECLARE_EVAL1(__VA_ARGS__)))
+#define _OFSM_DECLARE_EVAL3(...) _OFSM_DECLARE_EVAL2(_OFSM_DECLARE_EVAL2(_OFSM_DECLARE_EVAL2(__VA_ARGS__)))
+#define _OFSM_DECLARE_EVAL4(...) _OFSM_DECLARE_EVAL3(_OFSM_DECLARE_EVAL3(_OFSM_DECLARE_EVAL3(__VA_ARGS__)))
+#define _OFSM_DECLARE_EVAL(...)  _OFSM_DECLARE_EVAL4(_OFSM_DECLARE_EVAL4(_OFSM_DECLARE_EVAL4(__VA_ARGS__)))
+
+#define _OFSM_DECLARE_MAP_END(...)
+#define _OFSM_DECLARE_MAP_OUT
+#define _OFSM_DECLARE_MAP_COMMA ,
+#define _OFSM_DECLARE_MAP_GET_END2() 0, _OFSM_DECLARE_MAP_END
+#define _OFSM_DECLARE_MAP_GET_END1(...) _OFSM_DECLARE_MAP_GET_END2
+#define _OFSM_DECLARE_MAP_GET_END(...) _OFSM_DECLARE_MAP_GET_END1
+#define _OFSM_DECLARE_MAP_NEXT0(test, next, ...) next _OFSM_DECLARE_MAP_OUT
+#define _OFSM_DECLARE_MAP_LIST_NEXT1(test, next) _OFSM_DECLARE_MAP_NEXT0(test, _OFSM_DECLARE_MAP_COMMA next, 0)
+#define _OFSM_DECLARE_MAP_LIST_NEXT(test, next) _OFSM_DECLARE_MAP_LIST_NEXT1(_OFSM_DECLARE_MAP_GET_END test, next)
+#define _OFSM_DECLARE_MAP_LIST0(f, x, peek, ...) f(x) _OFSM_DECLARE_MAP_LIST_NEXT(peek, _OFSM_DECLARE_MAP_LIST1)(f, peek, __VA_ARGS__)
+#define _OFSM_DECLARE_MAP_LIST1(f, x, peek, ...) f(x) _OFSM_DECLARE_MAP_LIST_NEXT(peek, _OFSM_DECLARE_MAP_LIST0)(f, peek, __VA_ARGS__)
+#define _OFSM_DECLARE_MAP_LIST(f, ...) _OFSM_DECLARE_EVAL(_OFSM_DECLARE_MAP_LIST1(f, __VA_ARGS__, ()()(), ()()(), ()()(), 0))
+
+#define _OFSM_DECLARE_FSM_REF(fsmId) &_ofsm_decl_fsm_##fsmId
+#define _OFSM_DECLARE_GROUP_REF(grpId) &_ofsm_decl_grp_##grpId
+
+#define _OFSM_DECLARE_GROUP_FSM_ARRAY(grpId, ...) OFSM *_ofsm_decl_grp_fsms_##grpId[] = { _OFSM_DECLARE_MAP_LIST(_OFSM_DECLARE_FSM_REF, __VA_ARGS__) };\
+    static_assert(sizeof(_ofsm_decl_grp_fsms_##grpId) / sizeof(*_ofsm_decl_grp_fsms_##grpId) <= (_OFSM_INDEX_DATA_TYPE)-1, "Too many FSMs in the group; see OFSM_CONFIG_INDEX_DATA_TYPE");
+
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+#   define _OFSM_DECLARE_GROUP_DEADLINE_INIT , 0, 0, 0, OFSM_NO_DEADLINE, 0
+#   define _OFSM_DECLARE_GROUP_DEADLINE_FIELDS_INIT , OFSM_NO_DEADLINE, 0
+#else
+#   define _OFSM_DECLARE_GROUP_DEADLINE_INIT
+#   define _OFSM_DECLARE_GROUP_DEADLINE_FIELDS_INIT
+#endif
 
 #define _OFSM_DECLARE_GROUP(grpId) \
     OFSMGroup _ofsm_decl_grp_##grpId = {\
@@ -450,93 +1011,222 @@ Setup helper macros
         sizeof(_OFSM_DECLARE_GET(_ofsm_decl_grp_fsms_, grpId))/sizeof(*_OFSM_DECLARE_GET(_ofsm_decl_grp_fsms_, grpId)),\
         _OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId),\
         sizeof(_OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId))/sizeof(*_OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId))\
+        _OFSM_DECLARE_GROUP_DEADLINE_INIT\
     }
 
-#define _OFSM_DECLARE_GROUP_ARRAY_1(grpId0) OFSMGroup *_ofsm_decl_grp_arr[] = { &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId0) };
-#define _OFSM_DECLARE_GROUP_ARRAY_2(grpId0, grpId1) OFSMGroup *_ofsm_decl_grp_arr[] = { &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId0), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId1) };
-#define _OFSM_DECLARE_GROUP_ARRAY_3(grpId0, grpId1, grpId2) OFSMGroup *_ofsm_decl_grp_arr[] = { &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId0), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId1), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId2) };
-#define _OFSM_DECLARE_GROUP_ARRAY_4(grpId0, grpId1, grpId2, grpId3) OFSMGroup *_ofsm_decl_grp_arr[] = { &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId0), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId1), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId2), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId3) };
-#define _OFSM_DECLARE_GROUP_ARRAY_5(grpId0, grpId1, grpId2, grpId3, grpId4) OFSMGroup *_ofsm_decl_grp_arr[] = { &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId0), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId1), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId2), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId3), &_OFSM_DECLARE_GET(_ofsm_decl_grp_, grpId4) };
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+#   define _OFSM_DECLARE_FSM_ARRAY_GET(name, fsmArrayId) (_ofsm_decl_fsm_arr_##name##_##fsmArrayId)
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+#       define _OFSM_DECLARE_FSM_ARRAY_SLACK(fsmArrayId, instanceCount) _OFSM_TIME_DATA_TYPE _ofsm_decl_fsm_arr_wakeup_slack_##fsmArrayId[instanceCount];
+#       define _OFSM_DECLARE_FSM_ARRAY_SLACK_INIT(fsmArrayId) , _OFSM_DECLARE_FSM_ARRAY_GET(wakeup_slack, fsmArrayId)
+#   else
+#       define _OFSM_DECLARE_FSM_ARRAY_SLACK(fsmArrayId, instanceCount)
+#       define _OFSM_DECLARE_FSM_ARRAY_SLACK_INIT(fsmArrayId)
+#   endif
+#endif
 
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+#   define _OFSM_DECLARE_GROUP_FSM_ARRAY_FIELD_INIT , NULL
+#else
+#   define _OFSM_DECLARE_GROUP_FSM_ARRAY_FIELD_INIT
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+#   define _OFSM_DECLARE_GROUP_FSM_POOL_FIELD_INIT , NULL
+#else
+#   define _OFSM_DECLARE_GROUP_FSM_POOL_FIELD_INIT
+#endif
 
-#define _OFSM_DECLARE_GROUP_N(n, grpId, eventQueueSize, ...) \
+#define _OFSM_DECLARE_GROUP_ARRAY(...) OFSMGroup *_ofsm_decl_grp_arr[] = { _OFSM_DECLARE_MAP_LIST(_OFSM_DECLARE_GROUP_REF, __VA_ARGS__) };\
+    static_assert(sizeof(_ofsm_decl_grp_arr) / sizeof(*_ofsm_decl_grp_arr) <= (_OFSM_INDEX_DATA_TYPE)-1, "Too many groups; see OFSM_CONFIG_INDEX_DATA_TYPE");
+
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+#   define _OFSM_DECLARE_FSM_SLACK_INIT 0,                 /*wakeup slack*/
+#else
+#   define _OFSM_DECLARE_FSM_SLACK_INIT
+#endif
+#ifdef OFSM_CONFIG_SIMULATION
+#   define _OFSM_DECLARE_FSM_SIMULATION_INITIAL_STATE_INIT(initialState) initialState, /*simulation initial state*/
+#else
+#   define _OFSM_DECLARE_FSM_SIMULATION_INITIAL_STATE_INIT(initialState)
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER
+#   define _OFSM_DECLARE_FSM_INIT_HANDLER_INIT(initializationHandler) , initializationHandler /*initHandler*/
+#else
+#   define _OFSM_DECLARE_FSM_INIT_HANDLER_INIT(initializationHandler)
+#endif
+#define OFSM_DECLARE_FSM(fsmId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState) \
+    OFSM _ofsm_decl_fsm_##fsmId = {\
+            0,                                  /*wakeup time*/ \
+            _OFSM_DECLARE_FSM_SLACK_INIT \
+            _OFSM_FLAG_INFINITE_SLEEP,          /*flags*/ \
+            initialState,                       /*current state*/ \
+            (uint8_t)-1,                        /*skipNextEventCode*/ \
+            transitionTableEventCount,			/*transitionTableEventCount*/ \
+            _OFSM_DECLARE_FSM_SIMULATION_INITIAL_STATE_INIT(initialState) \
+            (OFSMTransition**)transitionTable, 	/*transitionTable*/ \
+            fsmPrivateDataPtr					/*fsmPrivateInfo*/ \
+            _OFSM_DECLARE_FSM_INIT_HANDLER_INIT(initializationHandler) \
+    };
+#define OFSM_DECLARE_GROUP(grpId, eventQueueSize, ...) \
     _OFSM_DECLARE_GROUP_EVENT_QUEUE(grpId, eventQueueSize);\
-    _OFSM_DECLARE_GROUP_FSM_ARRAY_##n(grpId, __VA_ARGS__);\
+    _OFSM_DECLARE_GROUP_FSM_ARRAY(grpId, __VA_ARGS__);\
     _OFSM_DECLARE_GROUP(grpId);
 
-#define _OFSM_DECLARE_N(n, ...)\
-    _OFSM_DECLARE_GROUP_ARRAY_##n(__VA_ARGS__);
+#define OFSM_DECLARE(...) _OFSM_DECLARE_GROUP_ARRAY(__VA_ARGS__);
+
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+/*instanceCount identical FSMs sharing transition table, private data and initialization handler; see FSM ARRAYS*/
+#   define OFSM_DECLARE_FSM_ARRAY(fsmArrayId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState, instanceCount) \
+        OFSM_DECLARE_FSM(arr_cursor_##fsmArrayId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState) \
+        uint8_t _ofsm_decl_fsm_arr_flags_##fsmArrayId[instanceCount];\
+        _OFSM_TIME_DATA_TYPE _ofsm_decl_fsm_arr_wakeup_time_##fsmArrayId[instanceCount];\
+        uint8_t _ofsm_decl_fsm_arr_current_state_##fsmArrayId[instanceCount];\
+        uint8_t _ofsm_decl_fsm_arr_skip_next_event_code_##fsmArrayId[instanceCount];\
+        _OFSM_DECLARE_FSM_ARRAY_SLACK(fsmArrayId, instanceCount)\
+        OFSMArray _ofsm_decl_fsm_arr_##fsmArrayId = {\
+            &_OFSM_DECLARE_GET(_ofsm_decl_fsm_arr_cursor_, fsmArrayId),\
+            initialState,\
+            _OFSM_DECLARE_FSM_ARRAY_GET(flags, fsmArrayId),\
+            _OFSM_DECLARE_FSM_ARRAY_GET(wakeup_time, fsmArrayId),\
+            _OFSM_DECLARE_FSM_ARRAY_GET(current_state, fsmArrayId),\
+            _OFSM_DECLARE_FSM_ARRAY_GET(skip_next_event_code, fsmArrayId)\
+            _OFSM_DECLARE_FSM_ARRAY_SLACK_INIT(fsmArrayId)\
+        };
 
-#ifdef OFSM_CONFIG_SIMULATION
-#   ifdef OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER
-#       define OFSM_DECLARE_FSM(fsmId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState) \
-        OFSM _ofsm_decl_fsm_##fsmId = {\
-                (OFSMTransition**)transitionTable, 	/*transitionTable*/ \
-                transitionTableEventCount,			/*transitionTableEventCount*/ \
-                fsmPrivateDataPtr,					/*fsmPrivateInfo*/ \
-                _OFSM_FLAG_INFINITE_SLEEP,          /*flags*/ \
-                0,                                  /*wakeup time*/ \
-                initialState,                       /*initial state*/ \
-                (uint8_t)-1,                        /*skipNextEventCode*/ \
-                initializationHandler,				/*initHandler*/ \
-                initialState                        /*simulation initial state*/ \
+/*group that consists of all instances of single FSM array*/
+#   define OFSM_DECLARE_GROUP_FSM_ARRAY(grpId, eventQueueSize, fsmArrayId) \
+        _OFSM_DECLARE_GROUP_EVENT_QUEUE(grpId, eventQueueSize);\
+        static_assert(sizeof(_OFSM_DECLARE_FSM_ARRAY_GET(flags, fsmArrayId)) <= (_OFSM_INDEX_DATA_TYPE)-1, "Too many FSMs in the array; see OFSM_CONFIG_INDEX_DATA_TYPE");\
+        OFSMGroup _ofsm_decl_grp_##grpId = {\
+            NULL,\
+            sizeof(_OFSM_DECLARE_FSM_ARRAY_GET(flags, fsmArrayId)),\
+            _OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId),\
+            sizeof(_OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId))/sizeof(*_OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId)),\
+            0, 0, 0\
+            _OFSM_DECLARE_GROUP_DEADLINE_FIELDS_INIT,\
+            &_OFSM_DECLARE_GET(_ofsm_decl_fsm_arr_, fsmArrayId)\
         };
-#   else
-#       define OFSM_DECLARE_FSM(fsmId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState) \
-        OFSM _ofsm_decl_fsm_##fsmId = {\
-                (OFSMTransition**)transitionTable, 	/*transitionTable*/ \
-                transitionTableEventCount,			/*transitionTableEventCount*/ \
-                fsmPrivateDataPtr,					/*fsmPrivateInfo*/ \
-                _OFSM_FLAG_INFINITE_SLEEP,          /*flags*/ \
-                0,                                  /*wakeup time*/ \
-                initialState,                       /*current state*/ \
-                (uint8_t)-1,                        /*skipNextEventCode*/ \
-                initialState                        /*simulation initial state*/ \
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+/*group of up to capacity FSMs spawned at run time; see FSM POOLS*/
+#   define OFSM_DECLARE_GROUP_FSM_POOL(grpId, eventQueueSize, capacity) \
+        _OFSM_DECLARE_GROUP_EVENT_QUEUE(grpId, eventQueueSize);\
+        static_assert((capacity) < (_OFSM_INDEX_DATA_TYPE)-1, "FSM pool capacity is too large; see OFSM_CONFIG_INDEX_DATA_TYPE");\
+        OFSM *_ofsm_decl_grp_fsms_##grpId[capacity];\
+        OFSM _ofsm_decl_pool_slots_##grpId[capacity];\
+        uint8_t _ofsm_decl_pool_slot_state_##grpId[capacity];\
+        _OFSM_INDEX_DATA_TYPE _ofsm_decl_pool_position_##grpId[capacity];\
+        _OFSM_INDEX_DATA_TYPE _ofsm_decl_pool_next_##grpId[capacity];\
+        OFSMPool _ofsm_decl_pool_##grpId = {\
+            _OFSM_DECLARE_GET(_ofsm_decl_pool_slots_, grpId),\
+            _OFSM_DECLARE_GET(_ofsm_decl_pool_slot_state_, grpId),\
+            _OFSM_DECLARE_GET(_ofsm_decl_pool_position_, grpId),\
+            _OFSM_DECLARE_GET(_ofsm_decl_pool_next_, grpId),\
+            capacity\
+        };\
+        OFSMGroup _ofsm_decl_grp_##grpId = {\
+            _OFSM_DECLARE_GET(_ofsm_decl_grp_fsms_, grpId),\
+            0,\
+            _OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId),\
+            sizeof(_OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId))/sizeof(*_OFSM_DECLARE_GET(_ofsm_decl_grp_eq_, grpId)),\
+            0, 0, 0\
+            _OFSM_DECLARE_GROUP_DEADLINE_FIELDS_INIT\
+            _OFSM_DECLARE_GROUP_FSM_ARRAY_FIELD_INIT,\
+            &_OFSM_DECLARE_GET(_ofsm_decl_pool_, grpId)\
         };
-#   endif
-#else
-#   ifdef OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER
-#       define OFSM_DECLARE_FSM(fsmId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState) \
-        OFSM _ofsm_decl_fsm_##fsmId = {\
-                (OFSMTransition**)transitionTable, 	/*transitionTable*/ \
-                transitionTableEventCount,			/*transitionTableEventCount*/ \
-                fsmPrivateDataPtr,					/*fsmPrivateInfo*/ \
-                _OFSM_FLAG_INFINITE_SLEEP,          /*flags*/ \
-                0,                                  /*wakeup time*/ \
-                initialState,                       /*current state*/ \
-                (uint8_t)-1                         /*skipNextEventCode*/ \
-                initializationHandler,				/*initHandler*/ \
+
+/*spawn FSM into pool group; returns NULL when pool is exhausted*/
+#   define ofsm_spawn_fsm(groupIndex, transitionTable, transitionTableEventCount, fsmPrivateDataPtr, initialState) \
+        _ofsm_spawn_fsm(groupIndex, (OFSMTransition**)transitionTable, transitionTableEventCount, fsmPrivateDataPtr, initialState)
+#   define fsm_get_fsm() (_ofsmCurrentFsmState->fsm)
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+/*event slots shared by groups declared with OFSM_DECLARE_GROUP_SHARED_QUEUE(); see SHARED EVENT POOL*/
+#   define OFSM_DECLARE_EVENT_POOL(eventPoolId, eventPoolSize) \
+        static_assert((eventPoolSize) < (_OFSM_INDEX_DATA_TYPE)-1, "Event pool is too large; see OFSM_CONFIG_INDEX_DATA_TYPE");\
+        OFSMEventData _ofsm_decl_event_pool_events_##eventPoolId[eventPoolSize];\
+        _OFSM_INDEX_DATA_TYPE _ofsm_decl_event_pool_next_##eventPoolId[eventPoolSize];\
+        OFSMEventPool _ofsm_decl_event_pool_##eventPoolId = {\
+            _OFSM_DECLARE_GET(_ofsm_decl_event_pool_events_, eventPoolId),\
+            _OFSM_DECLARE_GET(_ofsm_decl_event_pool_next_, eventPoolId),\
+            eventPoolSize\
         };
-#   else
-#       define OFSM_DECLARE_FSM(fsmId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState) \
-        OFSM _ofsm_decl_fsm_##fsmId = {\
-                (OFSMTransition**)transitionTable, 	/*transitionTable*/ \
-                transitionTableEventCount,			/*transitionTableEventCount*/ \
-                fsmPrivateDataPtr,					/*fsmPrivateInfo*/ \
-                _OFSM_FLAG_INFINITE_SLEEP,          /*flags*/ \
-                0,                                  /*wakeup time*/ \
-                initialState,                       /*current state*/ \
-                (uint8_t)-1                         /*skipNextEventCode*/ \
+
+/*group that queues its events into shared event pool; reservedEventCount events are always available to the group*/
+#   define OFSM_DECLARE_GROUP_SHARED_QUEUE(grpId, eventPoolId, reservedEventCount, ...) \
+        _OFSM_DECLARE_GROUP_FSM_ARRAY(grpId, __VA_ARGS__);\
+        OFSMGroup _ofsm_decl_grp_##grpId = {\
+            _OFSM_DECLARE_GET(_ofsm_decl_grp_fsms_, grpId),\
+            sizeof(_OFSM_DECLARE_GET(_ofsm_decl_grp_fsms_, grpId))/sizeof(*_OFSM_DECLARE_GET(_ofsm_decl_grp_fsms_, grpId)),\
+            NULL,\
+            reservedEventCount,\
+            0, 0, 0\
+            _OFSM_DECLARE_GROUP_DEADLINE_FIELDS_INIT\
+            _OFSM_DECLARE_GROUP_FSM_ARRAY_FIELD_INIT\
+            _OFSM_DECLARE_GROUP_FSM_POOL_FIELD_INIT,\
+            &_OFSM_DECLARE_GET(_ofsm_decl_event_pool_, eventPoolId)\
         };
-#   endif
-#endif /* OFSM_CONFIG_SIMULATION*/
-#define OFSM_DECLARE_GROUP_1(grpId, eventQueueSize, fsmId0) _OFSM_DECLARE_GROUP_N(1, grpId, eventQueueSize, fsmId0);
-#define OFSM_DECLARE_GROUP_2(grpId, eventQueueSize, fsmId0, fsmId1) _OFSM_DECLARE_GROUP_N(2, grpId, eventQueueSize, fsmId0, fsmId1);
-#define OFSM_DECLARE_GROUP_3(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2) _OFSM_DECLARE_GROUP_N(3, grpId, eventQueueSize, fsmId0, fsmId1, fsmId2);
-#define OFSM_DECLARE_GROUP_4(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3) _OFSM_DECLARE_GROUP_N(4, grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3);
-#define OFSM_DECLARE_GROUP_5(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3, fsmId4) _OFSM_DECLARE_GROUP_N(5, grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3, fsmId4);
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_TOPICS
+/*topic with precomputed list of subscribed group indexes; declare it before handlers that publish into it*/
+#   define OFSM_DECLARE_TOPIC(topicId, ...) \
+        const _OFSM_INDEX_DATA_TYPE _ofsm_decl_topic_subs_##topicId[] = { __VA_ARGS__ };\
+        OFSMTopic _ofsm_decl_topic_##topicId = {\
+            _OFSM_DECLARE_GET(_ofsm_decl_topic_subs_, topicId),\
+            sizeof(_OFSM_DECLARE_GET(_ofsm_decl_topic_subs_, topicId)) / sizeof(*_OFSM_DECLARE_GET(_ofsm_decl_topic_subs_, topicId))\
+        };
+OFSMQueueStatus _ofsm_publish(OFSMTopic *topic, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData);
+/*queue event into every group subscribed to the topic; returns the most severe status among them*/
+#   define ofsm_publish(topicId, forceNewEvent, eventCode, eventData) \
+        _ofsm_publish(&_OFSM_DECLARE_GET(_ofsm_decl_topic_, topicId), forceNewEvent, eventCode, eventData)
+#endif
+
+/*fixed arity declarations, kept for compatibility*/
+#define OFSM_DECLARE_GROUP_1(grpId, eventQueueSize, fsmId0) OFSM_DECLARE_GROUP(grpId, eventQueueSize, fsmId0);
+#define OFSM_DECLARE_GROUP_2(grpId, eventQueueSize, fsmId0, fsmId1) OFSM_DECLARE_GROUP(grpId, eventQueueSize, fsmId0, fsmId1);
+#define OFSM_DECLARE_GROUP_3(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2) OFSM_DECLARE_GROUP(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2);
+#define OFSM_DECLARE_GROUP_4(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3) OFSM_DECLARE_GROUP(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3);
+#define OFSM_DECLARE_GROUP_5(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3, fsmId4) OFSM_DECLARE_GROUP(grpId, eventQueueSize, fsmId0, fsmId1, fsmId2, fsmId3, fsmId4);
 
-#define OFSM_DECLARE_1(grpId0) _OFSM_DECLARE_N(1, grpId0);
-#define OFSM_DECLARE_2(grpId0, grpId1) _OFSM_DECLARE_N(2, grpId0, grpId1);
-#define OFSM_DECLARE_3(grpId0, grpId1, grpId2) _OFSM_DECLARE_N(3, grpId0, grpId1, grpId2);
-#define OFSM_DECLARE_4(grpId0, grpId1, grpId2, grpId3) _OFSM_DECLARE_N(4, grpId0, grpId1, grpId2, grpId3);
-#define OFSM_DECLARE_5(grpId0, grpId1, grpId2, grpId3, grpId4) _OFSM_DECLARE_N(5, grpId0, grpId1, grpId2, grpId3, grpId4);
+#define OFSM_DECLARE_1(grpId0) OFSM_DECLARE(grpId0);
+#define OFSM_DECLARE_2(grpId0, grpId1) OFSM_DECLARE(grpId0, grpId1);
+#define OFSM_DECLARE_3(grpId0, grpId1, grpId2) OFSM_DECLARE(grpId0, grpId1, grpId2);
+#define OFSM_DECLARE_4(grpId0, grpId1, grpId2, grpId3) OFSM_DECLARE(grpId0, grpId1, grpId2, grpId3);
+#define OFSM_DECLARE_5(grpId0, grpId1, grpId2, grpId3, grpId4) OFSM_DECLARE(grpId0, grpId1, grpId2, grpId3, grpId4);
 
 #define OFSM_DECLARE_BASIC(transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr) \
     OFSM_DECLARE_FSM(0, transitionTable1, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr); \
     OFSM_DECLARE_GROUP_1(0, 10, 0); \
     OFSM_DECLARE_1(0);
 
+#ifdef OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+/*orchestrator that runs listed groups; groups must not be shared between orchestrators*/
+#   define OFSM_DECLARE_ORCHESTRATOR(orchId, ...) \
+        OFSMGroup *_ofsm_decl_orch_grp_arr_##orchId[] = { _OFSM_DECLARE_MAP_LIST(_OFSM_DECLARE_GROUP_REF, __VA_ARGS__) };\
+        static_assert(sizeof(_ofsm_decl_orch_grp_arr_##orchId) / sizeof(*_ofsm_decl_orch_grp_arr_##orchId) <= (_OFSM_INDEX_DATA_TYPE)-1, "Too many groups; see OFSM_CONFIG_INDEX_DATA_TYPE");\
+        OFSMOrchestrator _ofsm_decl_orch_##orchId = {\
+            _OFSM_DECLARE_GET(_ofsm_decl_orch_grp_arr_, orchId),\
+            sizeof(_OFSM_DECLARE_GET(_ofsm_decl_orch_grp_arr_, orchId)) / sizeof(*_OFSM_DECLARE_GET(_ofsm_decl_orch_grp_arr_, orchId))\
+        };
+
+#   define ofsm_get_orchestrator(orchId) (&_OFSM_DECLARE_GET(_ofsm_decl_orch_, orchId))
+#   define ofsm_query_orchestrator() (_ofsmOrchestrator)
+#   ifdef OFSM_CONFIG_SIMULATION
+    /*makes OFSM_LOOP() of given orchestrator return (its thread may be joined afterwards)*/
+    void ofsm_simulation_orchestrator_exit(OFSMOrchestrator *orchestrator);
+#   endif
+
+/*select orchestrator for the calling thread and set it up; call OFSM_LOOP() on the same thread afterwards*/
+#   define OFSM_SETUP_ORCHESTRATOR(orchId) \
+        ofsm_orchestrator_select(ofsm_get_orchestrator(orchId)); \
+        _ofsmFlags |= (_OFSM_FLAG_INFINITE_SLEEP | _OFSM_FLAG_OFSM_FIRST_ITERATION);\
+        _ofsmTime = 0; \
+        _ofsm_setup();
+#endif
+
 #define OFSM_SETUP() \
     _ofsmGroups = (OFSMGroup**)_ofsm_decl_grp_arr; \
     _ofsmGroupCount = sizeof(_ofsm_decl_grp_arr) / sizeof(*_ofsm_decl_grp_arr); \
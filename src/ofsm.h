@@ -43,6 +43,7 @@ Important design decisions and usage notes:
   Thus, if rules (stated in this section) are followed. The same implementation can run with different speeds and environments.
 * As outcome of previous statement, it is recommended that event handlers rely on relative time (in ticks) supplied by OFSM (or in worse case on ofsm_get_time());
 * It is recommended that handlers never do a time math on their own, and rely completely on relative delays. As time math should account for timer overflow to work in all cases.
+  OFSM compares time using serial number arithmetic (difference modulo time data type range), which makes time register overflow transparent as long as delays stay below half of the range.
 * Event handlers are not expected to know transition states, and should rely on events to move FSM. (see Handlers API for details);
 * FSMs can be organized into groups of dependent state machines. NOTE: One group shares the same set of events. Each queued event processed by all FSMs within the group;
 * Events are never directly processed but queued, allowing better parallelism between multiple FSM.
@@ -76,12 +77,15 @@ OFSMTransition transitionTable1[][1 + E3] = {
 * OFSM_NOP_HANDLER can be used if no action is needed and only transition is required.
 * Set of preprocessor macros to help to declare state machine with list amount of effort. These macros include:
     OFSM_DECLARE_FSM(fsmId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr)
-    OFSM_DECLARE_GROUP_1(eventQueueSize, fsmId0) //setup group of 1 FSM
-    ...
-    OFSM_DECLARE_GROUP_5(eventQueueSize, fsmId0, ....,fsmId4) //setup group of 5 FSMs
-    OFSM_DECLARE_1(grpId0) //OFSM with 1 group
-    ...
-    OFSM_DECLARE_5(grpId0,....grpId4) //OFSM with 5 groups
+    OFSM_DECLARE_GROUP(grpId, eventQueueSize, fsmId0, ...) //setup group of any number of FSMs (up to 364 per declaration, see LIMITATIONS)
+    OFSM_DECLARE(grpId0, ...) //OFSM with any number of groups
+    OFSM_DECLARE_FSM_ARRAY(...), OFSM_DECLARE_GROUP_FSM_ARRAY(...) //identical FSMs stored as struct of arrays, see FSM ARRAYS
+    OFSM_DECLARE_GROUP_FSM_POOL(grpId, eventQueueSize, capacity) //group of FSMs created at run time, see FSM POOLS
+    OFSM_DECLARE_ORCHESTRATOR(orchId, grpId0, ...) //independent OFSM instance with its own groups, see ORCHESTRATOR INSTANCES
+    OFSM_DECLARE_EVENT_POOL(...), OFSM_DECLARE_GROUP_SHARED_QUEUE(...) //groups that take event slots from shared pool, see SHARED EVENT POOL
+    OFSM_DECLARE_TOPIC(topicId, grpId0, ...) //topic that listed groups subscribe to, see TOPICS
+    OFSM_DECLARE_GROUP_1(grpId, eventQueueSize, fsmId0) ... OFSM_DECLARE_GROUP_5(grpId, eventQueueSize, fsmId0, ....,fsmId4) //fixed arity forms of OFSM_DECLARE_GROUP
+    OFSM_DECLARE_1(grpId0) ... OFSM_DECLARE_5(grpId0,....grpId4) //fixed arity forms of OFSM_DECLARE
     OFSM_DECLARE_BASIC(transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr) //single FSM single Group declaration
 
 IMPORTANT:
@@ -118,6 +122,20 @@ Interrupt handlers may queue an event into any FSM group(s).
 To queue an event the following API can be used by interrupt handler:
 * ofsm_queue_group_event(groupIndex, eventCode, eventData)
 * ofsm_queue_global_event(eventCode, eventData) //queue the same event to all groups
+* ofsm_queue_group_event_deadline(groupIndex, forceNewEvent, eventCode, eventData, deadlineTicks) //requires OFSM_CONFIG_SUPPORT_EVENT_DEADLINE; see EVENT DEADLINES section
+All of them return OFSMQueueStatus: OFSM_QUEUE_STATUS_QUEUED, OFSM_QUEUE_STATUS_REPLACED (last queued event with the same code got replaced),
+OFSM_QUEUE_STATUS_BACKPRESSURE (see ELASTIC QUEUES) or OFSM_QUEUE_STATUS_DROPPED. ofsm_queue_global_event() returns the most severe status among groups.
+
+ISR STAGING
+-----------
+ofsm_queue...() replaces/coalesces events and maintains queue flags within atomic block, which makes interrupt handler longer.
+When OFSM_CONFIG_SUPPORT_ISR_STAGING is defined, interrupt handler may only copy raw event into small staging ring instead:
+* ofsm_isr_queue_group_event(groupIndex, forceNewEvent, eventCode, eventData) //returns OFSM_QUEUE_STATUS_QUEUED or OFSM_QUEUE_STATUS_DROPPED (ring is full)
+* ofsm_query_isr_staging_drop_count()                                         //number of events dropped because staging ring was full (saturates at 255)
+Main loop moves staged events (in order) into group queues at the beginning of each iteration, applying regular replacement rules.
+Staging ring has single producer: call ofsm_isr_queue_group_event() from interrupt handlers only (interrupts disabled), or from main code within OFSM_CONFIG_ATOMIC_BLOCK.
+Ring size is OFSM_CONFIG_ISR_STAGING_SIZE (power of 2, up to 128); each slot takes group index, event code, force flag and event data.
+Simulation status report is followed by: -IS[S:<staged events>,D:<dropped events>]; 'q[ueue],i,...' simulation command stages event.
 
 FSM EVENT HANDLERS API
 ======================
@@ -126,6 +144,8 @@ The following set of functions can be called from any event handler:
 
 * fsm_set_transition_delay(unsigned long delayTicks)
 * fsm_set_transition_delay_deep_sleep(unsigned long delayTicks)
+* fsm_set_transition_delay_slack(delayTicks, slackTicks)            //timeout may be delivered up to slackTicks late (OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK)
+* fsm_set_transition_delay_slack_deep_sleep(delayTicks, slackTicks)
 * fsm_set_infinite_delay()
 * fsm_set_infinite_delay_deep_sleep()
 * fsm_set_next_state(uint8_t nextStateId)            //TRY TO AVOID IT! overrides default transition state from the handler
@@ -141,8 +161,12 @@ The following set of functions can be called from any event handler:
 
 * fsm_queue_group_event(uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) //queue event into current group
 * fsm_queue_group_event_exclude_self(uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) //queue event into current group, but exclude current FSM from handling the queued event
+* fsm_queue_group_event_deadline(forceNewEvent, eventCode, eventData, deadlineTicks) //queue event into current group with relative deadline (OFSM_CONFIG_SUPPORT_EVENT_DEADLINE)
 
 * ofsm_queue_global_event(uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData)
+* ofsm_get_time(outCurrentTime)                        //current time (in ticks) of OFSM_CONFIG_TIME_DATA_TYPE
+    //NOTE: ofsm_get_time(outCurrentTime, outTimeFlags) is DEPRECATED. Time overflow flag is not maintained any more (time comparison is overflow safe),
+    //  two argument form is still accepted, but always returns 0 flags.
 * ofsm_debug_printf(level,format, ....)	                       //Simulation mode debug print
 
 CONFIGURATION
@@ -155,9 +179,31 @@ OFSM can be "shaped" in many different ways using configuration switches. NOTE:
 #define OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER              //Default: undefined. When defined OFMS implements supports for initialization handlers. This will consume a little bit of memory, as handler place holder and initialization logic will be implemented.
 #define OFSM_CONFIG_SUPPORT_EVENT_DATA                          //Default: undefined. When defined OFMS will support event data.
 #define OFSM_CONFIG_TICK_US                                     //Default: 1000 (1 millisecond). OFSM tick size in microseconds
+#define OFSM_CONFIG_TIME_DATA_TYPE unsigned long                //Default: unsigned long. Unsigned type of time (in ticks). For example: uint64_t for microsecond ticks on PC, or uint16_t to save memory. See LIMITATIONS.
+#define OFSM_CONFIG_INDEX_DATA_TYPE uint8_t                     //Default uint8_t. Unsigned type of group/FSM indices: limits number of groups and number of FSMs in a group. For example: uint16_t for more than 255 FSMs in a group.
 #define OFSM_CONFIG_DISABLE_BROWN_OUT_DETECTOR_ON_IDLE_SLEEP    //Default: undefined.
 #define OFSM_CONFIG_DISABLE_BROWN_OUT_DETECTOR_ON_DEEP_SLEEP    //Default: undefined.
 #define OFSM_CONFIG_QUERY_API_ENABLED                           //Default: undefined. When defined, ofsm_query_.... get implemented.
+#define OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK              //Default: undefined. When defined, transition delay may have slack, which allows OFSM to serve close wakeup times of different FSMs by single wakeup. See TIME MANAGEMENT AND SLEEP STRATEGIES.
+#define OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS                    //Default: undefined. When defined, OFSM counts ticks spent awake/in idle sleep/in deep sleep and wakeups by cause. See TIME MANAGEMENT AND SLEEP STRATEGIES.
+#define OFSM_CONFIG_SUPPORT_EVENT_DEADLINE                      //Default: undefined. When defined, queued events carry enqueue time and relative deadline, groups are served Earliest Deadline First. See EVENT DEADLINES.
+#define OFSM_CONFIG_SUPPORT_FSM_ARRAY                           //Default: undefined. When defined, identical FSMs can be declared as FSM array with per instance state stored in parallel arrays. See FSM ARRAYS.
+#define OFSM_CONFIG_SUPPORT_FSM_POOL                            //Default: undefined. When defined, FSMs can be spawned/destroyed at run time in pool groups. See FSM POOLS.
+#define OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL                   //Default: undefined. When defined, groups may queue events into event pool shared with other groups instead of own ring buffer. See SHARED EVENT POOL.
+#define OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE                       //Default: undefined. Host (simulation) builds only. When defined, group event ring buffer grows on demand and queuing reports backpressure. See ELASTIC QUEUES.
+#define OFSM_CONFIG_ELASTIC_QUEUE_MAX_SIZE 255                  //Default: max. value of OFSM_CONFIG_INDEX_DATA_TYPE. Default limit of ring buffer growth.
+#define OFSM_CONFIG_ELASTIC_QUEUE_HIGH_WATERMARK_PERCENT 75     //Default: 75. Default high watermark, percent of max. size.
+#define OFSM_CONFIG_SUPPORT_TOPICS                              //Default: undefined. When defined, events can be published into topics that groups subscribe to. See TOPICS.
+#define OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE                     //Default: undefined. When defined, global events are queued once into broadcast queue shared by all groups. See BROADCAST QUEUE.
+#define OFSM_CONFIG_BROADCAST_QUEUE_SIZE 4                      //Default: 4. Number of global events in broadcast queue; must be power of 2, up to 128.
+#define OFSM_CONFIG_SUPPORT_ISR_STAGING                         //Default: undefined. When defined, interrupt handlers may stage raw events with ofsm_isr_queue_group_event(). See ISR STAGING.
+#define OFSM_CONFIG_ISR_STAGING_SIZE 8                          //Default: 8. Number of events in ISR staging ring; must be power of 2, up to 128.
+#define OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES              //Default: undefined. When defined, OFSM state is kept in orchestrator object and several orchestrators may run on separate threads. See ORCHESTRATOR INSTANCES.
+#define OFSM_CONFIG_THREAD_LOCAL thread_local                   //Default: thread_local in simulation, empty otherwise. Storage class of current orchestrator pointer.
+#define OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS         //Default: undefined. When defined, hold time of every OFSM atomic block is recorded per call site. See CRITICAL SECTION STATISTICS.
+#define OFSM_CONFIG_CRITICAL_SECTION_HISTOGRAM_SIZE 8           //Default: 8. Number of log2 buckets of hold time histogram.
+#define OFSM_CONFIG_SUPPORT_SNAPSHOT                            //Default: undefined. When defined, OFSM run time state can be saved into buffer and restored from it. See SNAPSHOT.
+#define OFSM_CONFIG_CUSTOM_CRITICAL_SECTION_MICROS_FUNC micros  //Default: micros on MCU, steady_clock based function in simulation. Returns unsigned long microseconds.
 
 //By default OFSM piggybacks Arduino timer0 interrupt and micros()/millis() function to call heartbeat,
 //Custom heartbeat provider is expected to call ofsm_hearbeat(unsigned long currentTicktime);
@@ -178,7 +224,23 @@ OFSM can be "shaped" in many different ways using configuration switches. NOTE:
 // 4 - debug messages.
 #define OFSM_CONFIG_SIMULATION_DEBUG_LEVEL_OFSM OFSM_CONFIG_SIMULATION_DEBUG_LEVEL    //Default OFSM_CONFIG_SIMULATION_DEBUG_LEVEL. when level 0, all debug prints from OFSM will be disabled.
 #define OFSM_CONFIG_SIMULATION_TICK_MS 1000                  //Default 1000 milliseconds in one tick.
+#define OFSM_CONFIG_SIMULATION_TICKLESS                      //Default undefined. When defined, heartbeat provider thread sleeps until scheduled wakeup time instead of waking up every tick. Time is derived from monotonic clock.
+#define OFSM_CONFIG_SIMULATION_TICK_US 1000000               //Default OFSM_CONFIG_SIMULATION_TICK_MS * 1000. Tick size in microseconds used by tickless heartbeat provider (allows sub-millisecond ticks).
+#define OFSM_CONFIG_SIMULATION_F_CPU 16000000L              //Default 16000000L. Clock of MCU simulated by sleep planner model (see 'sl[eep]' command).
+#define OFSM_CONFIG_SIMULATION_WDT_CLOCK_ERROR_PPM 0         //Default 0. Default error (parts per million) of watchdog oscillator simulated by sleep planner model. Positive value means slower watchdog.
+#define OFSM_CONFIG_SIMULATION_ENERGY_MODEL                  //Default undefined. When defined, simulation estimates consumed energy (implies OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS). See PC SIMULATION REPORT FORMAT.
+#define OFSM_CONFIG_SIMULATION_ENERGY_ACTIVE_UA 12000        //Default 12000. Current draw (microamperes) while awake.
+#define OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_UA 3500     //Default 3500. Current draw (microamperes) in idle sleep.
+#define OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_UA 6        //Default 6. Current draw (microamperes) in deep sleep (power-down with watchdog timer).
+#define OFSM_CONFIG_SIMULATION_ENERGY_WAKEUP_NC 1200         //Default 1200. Charge (nanocoulombs) of main loop pass after each wakeup.
+#define OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_WAKEUP_NC 60 //Default 60. Charge (nanocoulombs) of each timer0 overflow interrupt during idle sleep.
+#define OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_WAKEUP_NC 12000 //Default 12000. Charge (nanocoulombs) of each start-up from deep sleep (watchdog step).
 #define OFSM_CONFIG_SIMULATION_SCRIPT_MODE_SLEEP_BETWEEN_EVENTS_MS 0     //Default 0. Sleep period (in milliseconds) before reading new simulation event. May be helpful in batch processing mode.
+#define OFSM_CONFIG_SIMULATION_SCRIPT_MAX_LINE_LENGTH 1024  //Default 1024. Longest simulation script line; the rest of longer line is dropped with an assert.
+#define OFSM_CONFIG_SIMULATION_SCRIPT_MAX_TOKENS 16         //Default 16. Max. number of comma separated tokens of simulation command; extra tokens are ignored.
+#define OFSM_CONFIG_SIMULATION_SCRIPT_BUFFER_SIZE 65536     //Default 65536. Read buffer size of simulation script file.
+#define OFSM_CONFIG_SIMULATION_TRACE                        //Default undefined. When defined, threaded simulation can record trace of its inputs and script mode can replay it. See PC SIMULATION TRACE RECORD AND REPLAY.
+#define OFSM_CONFIG_SIMULATION_CUSTOM_MAIN                  //Default undefined. When defined, simulation doesn't define main(); program provides its own (e.g. fuzzer harness). See PC SIMULATION FUZZER.
 #define OFSM_CONFIG_SIMULATION_SCRIPT_MODE					//Default undefined, When defined heartbeat is manually invoked. see PC SIMULATION SCRIPT MODE for details.
 
 //Default: 0 - (wakeup when queued, including timeout);
@@ -202,8 +264,10 @@ CUSTOMIZATION
 
 // --------------Simulation Specific Macros -------------------
 #define OFSM_CONFIG_CUSTOM_SIMULATION_CUSTOM_STATUS_REPORT_PRINTER_FUNC _ofsm_simulation_status_report_printer // typedef: void custom_func(OFSMSimulationStatusReport *r)
+#define OFSM_CONFIG_CUSTOM_SIMULATION_ENERGY_MODEL_FUNC _ofsm_simulation_energy_model // typedef: double custom_func(awakeTicks, sleepTicks, bool deepSleep); returns charge (microcoulombs) of awake period followed by sleep period.
 #define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC						    //Default: undefined; typedef: bool func(std::deque<std::string> &tokens); see PC SIMULATION EVENT GENERATOR for details.
 #define OFSM_CONFIG_CUSTOM_SIMULATION_EVENT_GENERATOR_FUNC _ofsm_simulation_event_generator //typedef: int _ofsm_simulation_event_generator(const char* fileName). Function: expected to call: ofsm_hearbeat(unsigned long currentTicktime)
+#define OFSM_CONFIG_CUSTOM_SIMULATION_TRANSITION_HOOK_FUNC                      //Default: undefined; typedef: void func(OFSM *fsm, groupIndex, fsmIndex, uint8_t eventCode); called before FSM handles event (fsm->currentState is source state). See PC SIMULATION FUZZER.
 
 TIME MANAGEMENT AND SLEEP STRATEGIES
 ====================================
@@ -220,6 +284,140 @@ For Example:
 	wakeup time is 100ms from now: first watchdog timer will be set for 64ms, then for 32ms and the rest ~4ms will be using idle sleep mode.
 NOTE: When implementing custom heartbeat provider or not using Arduino environment, consider to define OFSM_CONFIG_CUSTOM_WATCHDOG_INTERRUPT_HANDLER_FUNC along with
 	implementation of custom heartbeat functionality.
+When OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS is defined, sleep residency and wakeups are accounted in OFSMSleepStatistics (see ofsm.decl.h).
+	Use ofsm_query_sleep_statistics(OFSMSleepStatistics outStatistics) to get a copy of it.
+	Simulation accounts the same statistics (whole sleep period is a deep sleep if it was allowed) and prints them as a part of status report:
+	-SL[A:<awake ticks>,I:<idle sleep ticks>,D:<deep sleep ticks>,T:<timeout wakeups>,E:<event wakeups>,W:<watchdog wakeups>,X:<interrupted deep sleeps>]
+When OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK is defined, handler may call fsm_set_transition_delay_slack(delayTicks, slackTicks)
+	to indicate that timeout may be delivered anywhere within [delayTicks, delayTicks + slackTicks]. OFSM then wakes up at the latest time that is
+	still within slack of every FSM, and all FSMs which wakeup time has been reached are served by that single wakeup.
+	For Example: FSM A delay 100 slack 10, FSM B delay 105 (no slack): both get timeout at 105, instead of two wakeups at 100 and 105.
+	Slack is reset on every transition. Simulation status report is followed by: -CW[S:<number of wakeups saved by coalescing>]
+Sleep planner (split of sleep period into watchdog steps, time left and Arduino timer0 compensation) is shared with simulation,
+	where it runs against simulated watchdog timer and timer0 (see 'sl[eep]' simulation command).
+
+EVENT DEADLINES
+===============
+By default groups are served in declaration order: each pass of the main loop processes one pending event of every group.
+When OFSM_CONFIG_SUPPORT_EVENT_DEADLINE is defined, every queued event remembers the time (in ticks) it was queued and its relative deadline.
+Each pass of the main loop then processes only the head event of the group which has the least time left before its deadline (Earliest Deadline First).
+Events without deadline (OFSM_NO_DEADLINE) are served after the ones that have it; ties are resolved in group declaration order.
+* ofsm_set_group_event_deadline(groupIndex, deadlineTicks)     //default deadline of all events queued into the group, including TIMEOUT. Call after OFSM_SETUP(). Default: OFSM_NO_DEADLINE.
+* ofsm_queue_group_event_deadline(groupIndex, forceNewEvent, eventCode, eventData, deadlineTicks) //queue event with explicit deadline
+* ofsm_query_group_deadline_miss_count(groupIndex)             //number of events the group processed after their deadline had passed
+When queued event replaces previously queued one (see ofsm_queue...()), it keeps the original queue time and the earlier of both deadlines.
+
+FSM ARRAYS
+==========
+When OFSM_CONFIG_SUPPORT_FSM_ARRAY is defined, many identical FSMs can be declared as a single FSM array:
+* OFSM_DECLARE_FSM_ARRAY(fsmArrayId, transitionTable, transitionTableEventCount, initializationHandler, fsmPrivateDataPtr, initialState, instanceCount)
+* OFSM_DECLARE_GROUP_FSM_ARRAY(grpId, eventQueueSize, fsmArrayId)  //group of all instances of the FSM array; use it in OFSM_DECLARE(...) as any other group
+Transition table, event count, private data and initialization handler are stored once for all instances.
+Per instance state (flags, wakeup time, current state) is kept in parallel arrays, so that main loop scans contiguous memory (about 11 bytes per instance with 64 bits time, instead of OFSM struct and a pointer to it).
+Instance is identified by fsm_get_fsm_index(); fsm_get_private_data() returns the same pointer for all instances, for example, array of per instance data to be indexed by fsm_get_fsm_index().
+All instances start in initialState. Number of instances is limited by OFSM_CONFIG_INDEX_DATA_TYPE. ofsm_query_get_fsm() is not available for FSM array groups, use ofsm_query_fsm_...() instead.
+
+FSM POOLS
+=========
+When OFSM_CONFIG_SUPPORT_FSM_POOL is defined, FSMs can be created and destroyed at run time (for example, one FSM per connected device).
+* OFSM_DECLARE_GROUP_FSM_POOL(grpId, eventQueueSize, capacity)  //group with storage for up to capacity FSMs; starts empty
+* ofsm_spawn_fsm(groupIndex, transitionTable, transitionTableEventCount, fsmPrivateDataPtr, initialState) //returns OFSM* or NULL when pool is exhausted or group is not FSM pool group
+* ofsm_destroy_fsm(groupIndex, OFSM *fsm)                        //does nothing unless fsm is spawned from the pool of the group
+* fsm_get_fsm()                                                 //OFSM* of current FSM, e.g. ofsm_destroy_fsm(fsm_get_group_index(), fsm_get_fsm())
+Memory is reserved at declaration; spawn and destroy take O(1) time and never use heap. Group keeps spawned FSMs packed, so main loop doesn't visit free slots.
+Spawned FSM starts in infinite sleep; it handles events queued after the spawn. It has no initialization handler.
+FSM destroyed while events are being processed (e.g. from its own handler) is removed before its group processes next event.
+Destroying FSM moves the last FSM of the group into its position: fsm_get_fsm_index() of pool FSMs is not stable, use private data to identify them.
+
+SHARED EVENT POOL
+=================
+By default every group has own event ring buffer of eventQueueSize events, so RAM is provisioned for worst case burst of every group.
+When OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL is defined, groups may take event slots from pool shared with other groups:
+* OFSM_DECLARE_EVENT_POOL(eventPoolId, eventPoolSize)           //eventPoolSize event slots; size must be less than max. value of OFSM_CONFIG_INDEX_DATA_TYPE
+* OFSM_DECLARE_GROUP_SHARED_QUEUE(grpId, eventPoolId, reservedEventCount, fsmId0, ...) //group with FIFO of events linked through the pool
+Group can always queue up to reservedEventCount events. Beyond that it takes slots that are not reserved by other groups, as long as there are any.
+Therefore, eventPoolSize should be at least sum of reservations of all groups of the pool; the rest is shared by bursts of any group.
+Event replacement rules (see ofsm_queue...()) are the same as for ring buffer. When no slot is available, event is dropped and group buffer overflow flag is set until group processes its next event.
+Groups of the pool must belong to the same orchestrator (see ORCHESTRATOR INSTANCES). Regular, FSM array and FSM pool groups keep own ring buffers and may be used along with shared queue groups.
+Each pool slot costs one OFSM_CONFIG_INDEX_DATA_TYPE link in addition to event itself.
+
+ELASTIC QUEUES
+==============
+Host builds can afford memory, but not lost events. When OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE is defined (simulation only), group event ring buffer
+doubles its size (on heap) each time it is about to get full, up to max. size. Events keep their order. Buffer overflow happens only at max. size.
+Once number of pending events of the group reaches high watermark, ofsm_queue...() returns OFSM_QUEUE_STATUS_BACKPRESSURE (event is still queued), so that producer can throttle.
+* ofsm_set_group_event_queue_limit(groupIndex, maxSize, highWatermark) //call after OFSM_SETUP(); highWatermark 0 - never report backpressure
+Limits can't exceed max. value of OFSM_CONFIG_INDEX_DATA_TYPE. Groups of shared event pool (see SHARED EVENT POOL) don't grow.
+Simulation reset returns grown buffers to their declared size.
+
+TOPICS
+======
+Instead of queuing event into hard-coded group index (or into all groups), event can be published into a topic.
+When OFSM_CONFIG_SUPPORT_TOPICS is defined, topic is declared with list of group indexes (grpId) subscribed to it:
+* OFSM_DECLARE_TOPIC(topicId, grpId0, ...)                          //at least one group; declare topic before handlers that publish into it
+* ofsm_publish(topicId, forceNewEvent, eventCode, eventData)        //queues event into every subscribed group (see ofsm_queue_group_event()), returns the most severe status
+Example:
+    enum FsmGrpId {CrosswalkGrp = 0, RoadGrp, DisplayGrp};
+    OFSM_DECLARE_TOPIC(PedestrianTopic, RoadGrp, DisplayGrp);
+    ...
+    ofsm_publish(PedestrianTopic, false, PEDESTRIAN_AWAITS, 0);
+Subscriber list is built at compile time; publishing costs one ofsm_queue_group_event() per subscriber. Group indexes are relative to current orchestrator.
+
+BROADCAST QUEUE
+===============
+By default ofsm_queue_global_event() (as well as timeout event queued by heartbeat) copies event into every group queue, taking one slot of each group.
+When OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE is defined, global event is written once into broadcast queue of OFSM_CONFIG_BROADCAST_QUEUE_SIZE events;
+every group reads it through its own cursor, so that global event costs one write and one slot regardless of number of groups.
+Group events are stamped with broadcast sequence number when queued, so each group still gets its own and global events in FIFO order.
+Broadcast slot is released once all groups took the event. When broadcast queue is full, global event is dropped (OFSM_QUEUE_STATUS_DROPPED), group queues are not affected.
+Not forced global event (and timeout event) replaces the last global event with the same code, as long as no group took it and no group event was queued after it.
+With OFSM_CONFIG_SUPPORT_EVENT_DEADLINE global event takes the shortest default deadline among groups.
+Pending event count of simulation status report includes global events the group hasn't taken yet.
+
+ORCHESTRATOR INSTANCES
+======================
+When OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES is defined, all OFSM run time state (groups, time, wakeup time, flags, statistics and, in simulation, atomic block lock) is kept in OFSMOrchestrator object.
+Every thread works with its current orchestrator, which is the default one (set up by OFSM_SETUP()) until another one is selected. All OFSM API (ofsm_queue..., ofsm_heartbeat, ofsm_query..., fsm_...) works with current orchestrator.
+Orchestrators don't share any lock, so that several of them can run on separate threads (PC/host builds):
+* OFSM_DECLARE_ORCHESTRATOR(orchId, grpId0, ...)                //orchestrator of listed groups; group must not be listed in more than one orchestrator
+* ofsm_get_orchestrator(orchId)                                 //OFSMOrchestrator*
+* ofsm_orchestrator_select(OFSMOrchestrator*)                   //makes orchestrator current for the calling thread, returns previously current one
+* ofsm_query_orchestrator()                                     //current orchestrator
+* OFSM_SETUP_ORCHESTRATOR(orchId)                               //selects orchestrator and sets it up; follow by OFSM_LOOP() on the same thread
+* ofsm_simulation_orchestrator_exit(OFSMOrchestrator*)          //simulation only: makes OFSM_LOOP() of the orchestrator return
+Example (thread function):
+    OFSM_SETUP_ORCHESTRATOR(worker);
+    OFSM_LOOP();
+Other threads queue events and deliver heartbeats to such orchestrator after selecting it, e.g. prev = ofsm_orchestrator_select(ofsm_get_orchestrator(worker)); ofsm_queue_group_event(...); ofsm_orchestrator_select(prev);
+Group indexes are relative to the orchestrator. Simulation harness (event generator, heartbeat provider, reports) drives default orchestrator only.
+Without the switch, state is kept in global variables as before and there is no extra indirection.
+
+CRITICAL SECTION STATISTICS
+===========================
+OFSM wraps queuing, dequeuing, time reads, debug prints, etc. in OFSM_CONFIG_ATOMIC_BLOCK, which holds interrupts off on MCU (mutex in simulation).
+When OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS is defined, every such block measures how long it was held (micros() on MCU, steady_clock in simulation)
+and records it against its call site (OFSMCriticalSection):
+    OFSM_CRITICAL_SECTION_QUEUE, _DEQUEUE, _MAIN_LOOP, _HEARTBEAT, _GET_TIME, _DEBUG_PRINT, _SLEEP_STATISTICS, _FSM_POOL, _SNAPSHOT
+OFSMCriticalSectionStatistics of the site holds number of entries, max. hold time (us) and histogram of hold times:
+bucket 0 - below 1us, bucket k - [2^(k-1), 2^k) us, the last bucket - the rest. Histogram counters saturate at 65535.
+* ofsm_query_critical_section_statistics(site, outStatistics)   //copies statistics of the site into OFSMCriticalSectionStatistics outStatistics
+* ofsm_reset_critical_section_statistics()
+Measurement itself is included into hold time: two micros() calls and histogram update (micros() resolution is 4us on 16MHz AVR).
+Simulation status report is followed by: -CS[<site>:<max. hold us>/<entries>(<histogram buckets separated by '.'>),...];
+where site is Q - queue, D - dequeue, L - main loop, H - heartbeat, T - get time, P - debug print, S - sleep statistics, F - FSM pool, N - snapshot. Sites that were never entered are skipped.
+Statistics are cleared by simulation reset.
+
+SNAPSHOT
+========
+When OFSM_CONFIG_SUPPORT_SNAPSHOT is defined, run time state of current orchestrator can be copied into a buffer and brought back later:
+time, wakeup time and flags, sleep statistics, every group (flags, event queue and its content, shared event pool, broadcast cursor), every FSM (state, flags, wakeup time),
+FSM arrays, FSM pools (including which FSMs are spawned), broadcast queue and ISR staging ring.
+* ofsm_snapshot(buffer, bufferSize)                             //returns snapshot size; snapshot is written only when it fits into bufferSize, so ofsm_snapshot(NULL, 0) queries the size
+* ofsm_restore(snapshot, snapshotSize)                          //false, if snapshot doesn't match (e.g. taken with different configuration)
+Snapshot is raw copy of OFSM structures and is valid for the same program only. Sketch data (FSM private data, etc.) and critical section statistics are not part of it.
+Elastic ring buffer gets resized to its snapshot size; if that allocation fails, restore returns false and state is partially restored.
+Restore doesn't wake up main loop, call it where main loop runs (e.g. from handler) or wake it up.
+Typical use: test cases that share long precondition take snapshot once and restore it instead of replaying the precondition (see 'sn[apshot]' and 'rest[ore]' simulation commands).
 
 
 PC SIMULATION
@@ -253,10 +451,11 @@ The following are commands supported by event generator out of box;
 * e[exit] - exit simulation;
 * d[elay][,<sleep_milliseconds>] - forces event generator to sleep for <sleep_milliseconds> before reading next command; default sleep is 1000 milliseconds.
     -Example:
-        1) sleep,2000		//sleep for 2 seconds
-        2) s,2000			// the same as above
+        1) delay,2000		//sleep for 2 seconds
+        2) d,2000			// the same as above
 * q[ueue][,<modifiers>][,<event code>[,<event data>[,<group index>]]] - queue <event code> into OFSM.
-    -<modifiers> - (optional) either 'g' or 'f' or both; where: 'g' - if specified causes event to be queued for all groups (global event), 'f' - forces new event vs. possible replacement of previously queued
+    -<modifiers> - (optional) any of 'g', 'f', 'i'; where: 'g' - if specified causes event to be queued for all groups (global event), 'f' - forces new event vs. possible replacement of previously queued,
+        'i' - stages group event with ofsm_isr_queue_group_event() (see ISR STAGING); it reaches the group queue on next wakeup
     -Examples:
         1) queue,g,0,0,1	//queue global event code 0 event data 0 into all groups;
         2) q,1				//queue event code 1 event data 0 into group 0;
@@ -265,23 +464,47 @@ The following are commands supported by event generator out of box;
     -Examples:
         1) heartbeat,1000	//set current OFSM time to 1000 ticks
         2) h,1000			//same as above
-* s[tatus][,<group index>[,<fsm index>] // prints out status report about current state of specified FSM, if not specified <group index> and <fsm index> assumed to be 0
+        3) h,-1				//set current OFSM time to max value of time data type (useful to test time register overflow)
+* s[tatus][,<group index>[,<fsm index>[,<report line>]]] // prints out status report about current state of specified FSM, if not specified <group index> and <fsm index> assumed to be 0
     - see PC SIMULATION REPORT FORMAT for details about produced output.
+    - <report line> - tag of report line to be compared by assert (e.g. 'sl' for -SL[...] line); status line (-O[...]...) by default.
+    -Example:
+        status,0,0,sl = -SL[A:0,I:5,D:0,T:1,E:1,W:0,X:0]
 
+* ru[n],<ticks>				// (script mode only) advances OFSM time by <ticks>, jumping from one scheduled wakeup time to the next and processing all events in between.
+    The same FSM behavior as in real-time mode, but long scenarios take milliseconds. Example: run,600000 //10 minutes with 1 millisecond ticks
+* sl[eep],<sleep period us>[,d[,<watchdog clock error ppm>]] // runs MCU sleep planner against simulated watchdog timer and Arduino timer0 (see OFSM_CONFIG_SIMULATION_F_CPU).
+    'd' allows deep sleep; default clock error is OFSM_CONFIG_SIMULATION_WDT_CLOCK_ERROR_PPM. Prints (and makes assertable):
+    -SM[W:<watchdog prescaler of each deep sleep step>,I:<idle sleep wakeups>,E:<real time us>,U:<micros() us>,M:<millis() ms>]
+    -Example:
+        1) sleep,100000,d = -SM[W:2.1,I:5,E:0000101120,U:0000100352,M:0000000098] //64ms and 32ms watchdog steps, the rest is idle sleep
 * p[rint][,<string>]		// prints out <string>
 * w[akup]					// explicitly wakeup OFSM; ignored unless OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE > 0
 * r[eset]					// reset and restart OFSM; mostly used in script mode for creating of test case.
+* sn[apshot][,<slot>]		// (OFSM_CONFIG_SUPPORT_SNAPSHOT only) takes snapshot of OFSM state into <slot> (default 0); see SNAPSHOT.
+* rest[ore][,<slot>]		// (OFSM_CONFIG_SUPPORT_SNAPSHOT only) restores snapshot of <slot>. Slots survive 'r[eset]'.
+    -Example:
+        queue,1 ... heartbeat,5	//long precondition
+        snapshot,1
+        ...						//test case 1
+        restore,1
+        ...						//test case 2 starts from the same precondition
 
 You can define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC that will be called before command gets processed by the event generator.
 This way you can extend standard set of commands or change their default behavior.
 By returning true, the hook signals event generator that command was processed. Otherwise, event generator will continue processing the command as usual.
 Custom hook may call: ofsm_simulation_set_assert_compare_string(const char* assertCompareString) to allow support for test asserts.
 
+Event generator parses each line in place, without memory allocation (std::deque of tokens is only built for the custom hook).
+Script file is read through OFSM_CONFIG_SIMULATION_SCRIPT_BUFFER_SIZE buffer. tests/ofsmBenchmark.cpp measures how many commands per second
+event generator processes: it generates stress script (or runs one specified on the command line) and prints -BM[C:<commands>,T:<milliseconds>,R:<commands per second>] to stderr.
+
 PC SIMULATION SCRIPT MODE
 =========================
 * By default (OFSM_CONFIG_SIMULATION_SCRIPT_MODE is undefined). simulation process runs three threads:
         1) FSM thread: where FSM is running it's loop (in MCU world it corresponds to loop())
         2) Timer thread: this thread is running timer which periodically calls heartbeat to supply time into OFSM and wakes up OFSM in case of Timeout. (in MCU world it corresponds to timer interrupt handler or other time supplying mechanism)
+            When OFSM_CONFIG_SIMULATION_TICKLESS is defined, timer thread sleeps until OFSM wakeup time (or until OFSM goes back to sleep with new wakeup time) and it never wakes up while OFSM is in infinite sleep.
         3) Main thread: used by event generator. (in MCU world: external interrupts, such as button click ....)
     Such a mode allows dynamic/interactive testing of the OFSM.
 * Script Mode can be used for thorough state machine logic testing. In this mode everything runs in single thread;
@@ -291,13 +514,72 @@ PC SIMULATION SCRIPT MODE
     1) piping input data into simulated sketch executable (example: mysketch < TestScript.txt)
     2) or by specifying <script file>  on the command line. (example: mysketch TestScript.txt)
 
+PC SIMULATION PARALLEL RUNNER
+=============================
+On POSIX hosts script mode sketch can run many scripts at once: mysketch -j[<jobs>] [-v] <script file> [<script file>...]
+    Each script is split into cases; a case starts at 'r[eset]' command and lasts until the next one (lines before the first 'r[eset]' form a case of their own).
+    Script lines after 'e[xit]' command are ignored, as in serial run. Case that restores snapshot taken by earlier case (see 'rest[ore]') is merged
+    with that case and all cases in between, so that they run in the same worker.
+    Every case runs in its own forked worker process, <jobs> workers at a time (default: number of CPU cores); so cases are isolated and don't depend on reset of globals.
+    Worker output is collected and reported in script order, followed by summary:
+        FAIL <script file>:<first line>-<last line> (lines: <assert line>,...) //followed by assert messages of the case
+        -PR[S:<scripts>,C:<cases>,P:<passed cases>,F:<failed cases>]
+    Case fails if it produced any assert (see _ofsm_simulation_check_for_assert()) or worker exited abnormally. Exit code is number of failed cases.
+    '-v' reports every case (PASS or FAIL) along with its full output.
+    -Example:
+        mysketch -j8 ofsmTest.test ../examples/ofsmBlink/ofsmBlink.test
+    tests/ofsmParallelRunner.script exercises case splitting (including a failing case and a restore across 'r[eset]'); its header gives expected output.
+
+PC SIMULATION TRACE RECORD AND REPLAY
+=====================================
+Threaded simulation can't be reproduced by re-running it, as event timing depends on thread scheduling. When OFSM_CONFIG_SIMULATION_TRACE is defined,
+threaded sketch records its inputs into compact binary trace: mysketch --record <trace file> [<script file>]
+    Trace holds events queued by any thread other than FSM thread (script, other threads, simulated interrupts) and every heartbeat with its time (tick);
+    events queued by FSMs or by OFSM itself are not recorded, they are produced again on replay. Trace also marks setup(), every wakeup and
+    every main loop pass, along with digest of OFSM state before the pass. 'r[eset]' is recorded as well; 'rest[ore]' command is ignored while recording.
+    While recording, main loop pass (from wakeup until it goes back to sleep) holds simulation mutex, so that inputs of other threads fall between passes.
+Script mode build of the same sketch replays trace as fast as possible: mysketch --replay <trace file>
+    setup() and main loop passes are called in recorded order with recorded inputs in between, so replay goes through the same transitions as recording.
+    OFSM state digest is verified before every pass; the first pass that differs is reported as: ASSERT at trace record: <record>: Replay diverged...
+    Replay ends with summary: -TR[R:<records>,P:<main loop passes>,D:<diverged passes>]; exit code is 1 if replay diverged or trace is corrupted.
+    Both builds must use the same OFSM configuration (except simulation mode), otherwise replay diverges.
+    Replay requires OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE 2 or 3. Recorder requires default atomic block and enter sleep functions
+    and doesn't support OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES. Inputs that handlers get on their own (e.g. millis(), rand()) are not recorded.
+    -Example:
+        g++ -std=c++11 -I../src -o mysketch mysketch.cpp -lpthread && mysketch --record field.trace
+        g++ -std=c++11 -DUTEST -I../src -o mysketch mysketch.cpp && mysketch --replay field.trace
+
+PC SIMULATION FUZZER
+====================
+tests/ofsmFuzz.cpp is libFuzzer compatible harness of script mode sketch (ofsmTest.cpp by default). It calls script mode entry points directly
+(no script parsing, no iostream), so it runs hundreds of thousands of executions per second. Every input byte sequence is decoded into commands:
+group/global/interrupt queue (optionally forced), heartbeat, wakeup and run; event codes go one past FSM's event count to reach 'unexpected event'.
+    Coverage of (state, event) cells of every FSM is collected by OFSM_CONFIG_CUSTOM_SIMULATION_TRANSITION_HOOK_FUNC and fed to libFuzzer as extra counters.
+    After every command harness checks invariants (e.g. wakeup time in the past without queue overflow, infinite sleep while FSM waits for timeout);
+    violation is reported as -FV[<message>...] and aborts. Overflow excuses wakeup time in the past only until main loop drains all queues again.
+    Queue overflows are counted; OFSM_FUZZ_ABORT_ON_OVERFLOW makes them violations too.
+    At exit, coverage of every FSM is reported as -FC(<group>,<fsm>)[C:<covered cells>,H:<cells with handler>,S:<visited states>] followed by uncovered cells,
+    then -FZ[E:<executions>,C:<commands>,O:<executions with overflow>,W:<commands checked against wakeup time invariant>,T:<milliseconds>,R:<executions per second>].
+    Without libFuzzer (g++ only), harness runs random inputs (ofsmFuzz -n<executions> -s<seed>) or re-runs given input files. See ofsmFuzz.cpp for command lines.
+
 PC SIMULATION REPORT FORMAT
 ===========================
 see implementation of _ofsm_simulation_create_status_report() and _ofsm_simulation_status_report_printer() in ofsm.impl.h for details.
+Status line is followed by optional lines of enabled features; each line starts with -<tag>[ and any of them can be compared by assert (see s[tatus] command).
+In threaded (non script) mode status report is followed by heartbeat provider line: -HB[L:<last lag>us,M:<max lag>us,C:<caught up ticks>],
+where lag is how late heartbeat was delivered relative to monotonic clock. Heartbeat time is derived from monotonic clock, so lag never accumulates;
+when heartbeat is late by more than a tick, time catches up in a single heartbeat.
+When OFSM_CONFIG_SIMULATION_ENERGY_MODEL is defined, status report is followed by: -EN[Q:<consumed mAh>,R:<mAh per simulated hour>].
+Energy model is applied to every awake and sleep period OFSM goes through (OFSM_CONFIG_TICK_US is used to convert ticks into time);
+sleep period is split into watchdog steps and idle sleep by sleep planner model (see 'sl[eep]' command). Use ru[n] command to compare designs,
+example: run,3600000 followed by status, gives consumption of one hour with 1 millisecond ticks.
 
 LIMITATIONS
 ============
-* Number of events in single FSM, number of FSMs in single group, number of groups within OFSM must not exceed 255!
+* Number of events in single FSM must not exceed 255!
+* Number of FSMs in single group and number of groups within OFSM must not exceed max. value of OFSM_CONFIG_INDEX_DATA_TYPE (255 by default). Violation is reported at compile time.
+* Single OFSM_DECLARE_GROUP or OFSM_DECLARE declaration accepts up to 364 ids; a larger list must be split, for example, into several groups.
+* Transition delay must be less than half of OFSM_CONFIG_TIME_DATA_TYPE range (2147483647 ticks for 32 bits), otherwise wakeup time is considered to be in the past.
 
 */
 #ifndef __OFSM_H_
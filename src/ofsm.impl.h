@@ -15,26 +15,85 @@
 Global variables
 -----------------------------------------*/
 
+#ifdef OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+OFSMOrchestrator                            _ofsmDefaultOrchestrator;   /*runs groups declared with OFSM_DECLARE(); used by simulation harness*/
+OFSM_CONFIG_THREAD_LOCAL OFSMOrchestrator*  _ofsmOrchestrator = &_ofsmDefaultOrchestrator;
+#else
 OFSMGroup**				_ofsmGroups;
-uint8_t                 _ofsmGroupCount;
+_OFSM_INDEX_DATA_TYPE   _ofsmGroupCount;
 OFSMState*				_ofsmCurrentFsmState;
 volatile uint16_t       _ofsmFlags;
 volatile _OFSM_TIME_DATA_TYPE  _ofsmWakeupTime;
 volatile _OFSM_TIME_DATA_TYPE  _ofsmTime;
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+volatile OFSMSleepStatistics _ofsmSleepStatistics;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+_OFSM_INDEX_DATA_TYPE   _ofsmEdfGroupIndex; /*group selected to process its pending event during current iteration*/
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+OFSMCriticalSectionStatistics _ofsmCriticalSectionStatistics[OFSM_CRITICAL_SECTION_COUNT];
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+OFSMEventData           _ofsmBroadcastQueue[OFSM_CONFIG_BROADCAST_QUEUE_SIZE];
+_OFSM_INDEX_DATA_TYPE   _ofsmBroadcastPending[OFSM_CONFIG_BROADCAST_QUEUE_SIZE];  /*number of groups that haven't taken the event yet*/
+volatile uint8_t        _ofsmBroadcastHead;     /*free running sequence numbers*/
+volatile uint8_t        _ofsmBroadcastTail;
+uint8_t                 _ofsmBroadcastGroupEventQueued; /*group event was queued after the last broadcast event*/
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+OFSMStagedEvent         _ofsmIsrStaging[OFSM_CONFIG_ISR_STAGING_SIZE];
+volatile uint8_t        _ofsmIsrStagingHead;    /*free running counters; written by ISR*/
+volatile uint8_t        _ofsmIsrStagingTail;    /*written by main loop*/
+volatile uint8_t        _ofsmIsrStagingDropCount;
+#endif
+#endif /*OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES*/
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+double                  _ofsmSimulationEnergyChargeUC;      /*estimated charge (microcoulombs) consumed during _ofsmSimulationEnergyElapsedUs*/
+double                  _ofsmSimulationEnergyElapsedUs;
+_OFSM_TIME_DATA_TYPE    _ofsmSimulationEnergyAwakeTicks;    /*awake period that preceded current sleep*/
+#endif
+#if defined(OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK) && defined(OFSM_CONFIG_SIMULATION)
+unsigned long           _ofsmSimulationSavedWakeupCount;    /*number of wakeups avoided by coalescing of FSM wakeup times*/
+unsigned long           _ofsmSimulationPendingSavedWakeups; /*wakeups that will be saved when scheduled wakeup time is reached*/
+std::vector<_OFSM_TIME_DATA_TYPE> _ofsmSimulationWakeupTimes; /*wakeup times of all FSMs (except in infinite sleep) collected by last pass*/
+#endif
 
 /*--------------------------------------
 Common (simulation and non-simulation code)
 ----------------------------------------*/
 
-static inline void _ofsm_fsm_process_event(OFSM *fsm, uint8_t groupIndex, uint8_t fsmIndex, OFSMEventData *e)
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+/*called at the end of atomic block, while it is still held*/
+void _ofsm_critical_section_record(uint8_t site, unsigned long holdUs)
+{
+    OFSMCriticalSectionStatistics *s = &(_ofsmCriticalSectionStatistics[site]);
+    uint8_t bucket = 0;
+    s->count++;
+    if (holdUs > s->maxHoldUs) {
+        s->maxHoldUs = holdUs;
+    }
+    while (holdUs && bucket < OFSM_CONFIG_CRITICAL_SECTION_HISTOGRAM_SIZE - 1) {
+        holdUs >>= 1;
+        bucket++;
+    }
+    if (s->histogram[bucket] != (uint16_t)-1) {
+        s->histogram[bucket]++;
+    }
+}/*_ofsm_critical_section_record*/
+#endif
+
+static inline void _ofsm_fsm_process_event(OFSM *fsm, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_INDEX_DATA_TYPE fsmIndex, OFSMEventData *e)
 {
     OFSMTransition *t;
     uint8_t oldFlags;
     _OFSM_TIME_DATA_TYPE oldWakeupTime;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    _OFSM_TIME_DATA_TYPE oldWakeupSlack;
+#endif
     uint8_t wakeupTimeGTcurrentTime;
     OFSMState fsmState;
     _OFSM_TIME_DATA_TYPE currentTime;
-    uint8_t timeFlags;
 
 #ifdef OFSM_CONFIG_SIMULATION
     long delay = -1;
@@ -52,11 +111,11 @@ static inline void _ofsm_fsm_process_event(OFSM *fsm, uint8_t groupIndex, uint8_
         return;
     }
 
-    ofsm_get_time(currentTime, timeFlags);
+    ofsm_get_time(currentTime);
 
     //check if wake time has been reached, wake up immediately if not timeout event, ignore non-handled   events.
     t = _OFSM_GET_TRANSTION(fsm, e->eventCode);
-    wakeupTimeGTcurrentTime = _OFSM_TIME_A_GT_B(fsm->wakeupTime, (fsm->flags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW), currentTime, (timeFlags & _OFSM_FLAG_OFSM_TIMER_OVERFLOW));
+    wakeupTimeGTcurrentTime = _OFSM_TIME_A_GT_B(fsm->wakeupTime, currentTime);
     if (!t->eventHandler || (0 == e->eventCode && (((fsm->flags & _OFSM_FLAG_INFINITE_SLEEP) && !(_ofsmFlags & _OFSM_FLAG_OFSM_FIRST_ITERATION)) || wakeupTimeGTcurrentTime))) {
         if (!t->eventHandler) {
 #ifdef OFSM_CONFIG_SIMULATION
@@ -72,6 +131,10 @@ static inline void _ofsm_fsm_process_event(OFSM *fsm, uint8_t groupIndex, uint8_
         return;
     }
 
+#if defined(OFSM_CONFIG_SIMULATION) && defined(OFSM_CONFIG_CUSTOM_SIMULATION_TRANSITION_HOOK_FUNC)
+    OFSM_CONFIG_CUSTOM_SIMULATION_TRANSITION_HOOK_FUNC(fsm, groupIndex, fsmIndex, e->eventCode); /*fsm->currentState is still the source state*/
+#endif
+
 #ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
     _ofsm_debug_printf(2,  "F(%i)G(%i): State: %i. Processing eventCode %i eventData %i(0x%08X)...\n", fsmIndex, groupIndex, fsm->currentState, e->eventCode, e->eventData, (int)e->eventData);
 #else
@@ -81,6 +144,10 @@ static inline void _ofsm_fsm_process_event(OFSM *fsm, uint8_t groupIndex, uint8_
     oldFlags = fsm->flags;
     oldWakeupTime = fsm->wakeupTime;
     fsm->wakeupTime = 0;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    oldWakeupSlack = fsm->wakeupSlack;
+    fsm->wakeupSlack = 0;
+#endif
     fsm->flags &= ~_OFSM_FLAG_FSM_FLAG_ALL; //clear flags
 
     if(t->eventHandler != OFSM_NOP_HANDLER) {
@@ -105,6 +172,9 @@ static inline void _ofsm_fsm_process_event(OFSM *fsm, uint8_t groupIndex, uint8_
         if (fsm->flags & _OFSM_FLAG_FSM_PREVENT_TRANSITION) {
             fsm->flags = oldFlags | _OFSM_FLAG_FSM_PREVENT_TRANSITION;
             fsm->wakeupTime = oldWakeupTime;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            fsm->wakeupSlack = oldWakeupSlack;
+#endif
             _ofsm_debug_printf(3,  "F(%i)G(%i): Handler requested no transition. FSM state was restored.\n", fsmIndex, groupIndex);
             return;
         }
@@ -142,39 +212,347 @@ static inline void _ofsm_fsm_process_event(OFSM *fsm, uint8_t groupIndex, uint8_
         delay = fsm->wakeupTime;
 #endif
         fsm->wakeupTime += currentTime;
-        if (fsm->wakeupTime < currentTime) {
-            fsm->flags |= _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW;
-        }
     }
     _ofsm_debug_printf(2,  "F(%i)G(%i): Transitioning from state %i ==> %c%i. Transition delay: %ld\n", fsmIndex, groupIndex,  prevState, overridenState, fsm->currentState, delay);
 }/*_ofsm_fsm_process_event*/
 
-static inline void _ofsm_group_process_pending_event(OFSMGroup *group, uint8_t groupIndex, _OFSM_TIME_DATA_TYPE *groupEarliestWakeupTime, uint8_t *groupAndedFsmFlags)
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+/*load state of FSM array instance into the cursor FSM*/
+static inline OFSM* _ofsm_fsm_array_load(OFSMArray *fsmArray, _OFSM_INDEX_DATA_TYPE fsmIndex)
+{
+    OFSM *fsm = fsmArray->cursor;
+    fsm->flags = (fsmArray->flags)[fsmIndex];
+    fsm->wakeupTime = (fsmArray->wakeupTime)[fsmIndex];
+    fsm->currentState = (fsmArray->currentState)[fsmIndex];
+    fsm->skipNextEventCode = (fsmArray->skipNextEventCode)[fsmIndex];
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    fsm->wakeupSlack = (fsmArray->wakeupSlack)[fsmIndex];
+#   endif
+    return fsm;
+}/*_ofsm_fsm_array_load*/
+
+/*store state of the cursor FSM back into FSM array instance*/
+static inline void _ofsm_fsm_array_store(OFSMArray *fsmArray, _OFSM_INDEX_DATA_TYPE fsmIndex)
+{
+    OFSM *fsm = fsmArray->cursor;
+    (fsmArray->flags)[fsmIndex] = fsm->flags;
+    (fsmArray->wakeupTime)[fsmIndex] = fsm->wakeupTime;
+    (fsmArray->currentState)[fsmIndex] = fsm->currentState;
+    (fsmArray->skipNextEventCode)[fsmIndex] = fsm->skipNextEventCode;
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    (fsmArray->wakeupSlack)[fsmIndex] = fsm->wakeupSlack;
+#   endif
+}/*_ofsm_fsm_array_store*/
+
+/*put all instances into initial state*/
+static void _ofsm_fsm_array_reset(OFSMArray *fsmArray, _OFSM_INDEX_DATA_TYPE instanceCount)
+{
+    _OFSM_INDEX_DATA_TYPE i;
+    for (i = 0; i < instanceCount; i++) {
+        (fsmArray->flags)[i] = _OFSM_FLAG_INFINITE_SLEEP;
+        (fsmArray->wakeupTime)[i] = 0;
+        (fsmArray->currentState)[i] = fsmArray->initialState;
+        (fsmArray->skipNextEventCode)[i] = (uint8_t)-1;
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+        (fsmArray->wakeupSlack)[i] = 0;
+#   endif
+    }
+}/*_ofsm_fsm_array_reset*/
+#endif /*OFSM_CONFIG_SUPPORT_FSM_ARRAY*/
+
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+/*free all pool slots and empty the group*/
+static void _ofsm_fsm_pool_reset(OFSMGroup *group)
+{
+    OFSMPool *pool = group->fsmPool;
+    _OFSM_INDEX_DATA_TYPE i;
+    for (i = 0; i < pool->capacity; i++) {
+        (pool->slotState)[i] = _OFSM_POOL_SLOT_FREE;
+        (pool->next)[i] = i + 1;
+    }
+    pool->freeHead = 0;
+    pool->pendingHead = pool->capacity;
+    group->groupSize = 0;
+}/*_ofsm_fsm_pool_reset*/
+
+/*remove destroyed FSMs from the group and return their slots to the pool; must be called from within atomic block, while group FSMs are not being iterated*/
+static inline void _ofsm_fsm_pool_release_destroyed(OFSMGroup *group)
+{
+    OFSMPool *pool = group->fsmPool;
+    _OFSM_INDEX_DATA_TYPE slot;
+    _OFSM_INDEX_DATA_TYPE position;
+    while (pool->pendingHead != pool->capacity) {
+        slot = pool->pendingHead;
+        pool->pendingHead = (pool->next)[slot];
+        /*move last FSM of the group into released position*/
+        position = (pool->position)[slot];
+        group->groupSize--;
+        (group->fsms)[position] = (group->fsms)[group->groupSize];
+        (pool->position)[(group->fsms)[position] - pool->slots] = position;
+        /*return slot to free list*/
+        (pool->slotState)[slot] = _OFSM_POOL_SLOT_FREE;
+        (pool->next)[slot] = pool->freeHead;
+        pool->freeHead = slot;
+    }
+}/*_ofsm_fsm_pool_release_destroyed*/
+#endif /*OFSM_CONFIG_SUPPORT_FSM_POOL*/
+
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+/*free all slots of event pools and reserve events of shared queue groups*/
+static void _ofsm_event_pool_reset()
+{
+    _OFSM_INDEX_DATA_TYPE i;
+    OFSMGroup *group;
+    OFSMEventPool *pool;
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        pool = (_ofsmGroups)[i]->eventPool;
+        if (pool) {
+            for (pool->freeHead = 0; pool->freeHead < pool->size; pool->freeHead++) {
+                (pool->next)[pool->freeHead] = pool->freeHead + 1;
+            }
+            pool->freeHead = 0;
+            pool->freeCount = pool->size;
+            pool->reservedFree = 0;
+        }
+    }
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        if (group->eventPool) {
+            group->eventCount = 0;
+            group->eventPool->reservedFree += group->eventQueueSize;
+        }
+    }
+}/*_ofsm_event_pool_reset*/
+
+/*true when group can take one more slot from the pool*/
+static inline bool _ofsm_event_pool_can_acquire(OFSMGroup *group)
+{
+    OFSMEventPool *pool = group->eventPool;
+    return pool->freeCount > 0 && (group->eventCount < group->eventQueueSize || pool->freeCount > pool->reservedFree);
+}/*_ofsm_event_pool_can_acquire*/
+
+/*take free slot and append it to group FIFO; _ofsm_event_pool_can_acquire() must be true*/
+static inline OFSMEventData* _ofsm_event_pool_push(OFSMGroup *group)
+{
+    OFSMEventPool *pool = group->eventPool;
+    _OFSM_INDEX_DATA_TYPE slot = pool->freeHead;
+    pool->freeHead = (pool->next)[slot];
+    pool->freeCount--;
+    if (group->eventCount < group->eventQueueSize) {
+        pool->reservedFree--;
+    }
+    if (group->eventCount) {
+        (pool->next)[group->eventTail] = slot;
+    }
+    else {
+        group->eventHead = slot;
+    }
+    group->eventTail = slot;
+    group->eventCount++;
+    return &(pool->events)[slot];
+}/*_ofsm_event_pool_push*/
+
+/*remove head event of group FIFO and return its slot to the pool*/
+static inline void _ofsm_event_pool_pop(OFSMGroup *group)
+{
+    OFSMEventPool *pool = group->eventPool;
+    _OFSM_INDEX_DATA_TYPE slot = group->eventHead;
+    group->eventHead = (pool->next)[slot];
+    group->eventCount--;
+    (pool->next)[slot] = pool->freeHead;
+    pool->freeHead = slot;
+    pool->freeCount++;
+    if (group->eventCount < group->eventQueueSize) {
+        pool->reservedFree++;
+    }
+}/*_ofsm_event_pool_pop*/
+#endif /*OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL*/
+
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+static void _ofsm_broadcast_reset()
+{
+    _OFSM_INDEX_DATA_TYPE i;
+    _ofsmBroadcastHead = _ofsmBroadcastTail = 0;
+    _ofsmBroadcastGroupEventQueued = 0;
+    memset((void*)_ofsmBroadcastPending, 0, sizeof(_ofsmBroadcastPending));
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        (_ofsmGroups)[i]->broadcastCursor = 0;
+    }
+}/*_ofsm_broadcast_reset*/
+
+/*group takes broadcast event at its cursor; slot is released once all groups took it (groups take events in order, so slots get released in order too)*/
+static inline void _ofsm_broadcast_pop(OFSMGroup *group)
+{
+    _ofsmBroadcastPending[group->broadcastCursor & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)]--;
+    group->broadcastCursor++;
+    while (_ofsmBroadcastTail != _ofsmBroadcastHead && 0 == _ofsmBroadcastPending[_ofsmBroadcastTail & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)]) {
+        _ofsmBroadcastTail++;
+    }
+}/*_ofsm_broadcast_pop*/
+#endif /*OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE*/
+
+/*number of events queued into the group ring buffer (or shared event pool)*/
+static inline _OFSM_INDEX_DATA_TYPE _ofsm_group_local_pending_event_count(OFSMGroup *group)
+{
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+    if (group->eventPool) {
+        return group->eventCount;
+    }
+#endif
+    if (group->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW) {
+        if (group->currentEventIndex == group->nextEventIndex) {
+            return group->eventQueueSize;
+        }
+        return group->eventQueueSize - (group->currentEventIndex - group->nextEventIndex);
+    }
+    if (group->nextEventIndex < group->currentEventIndex) {
+        return group->eventQueueSize - (group->currentEventIndex - group->nextEventIndex);
+    }
+    return group->nextEventIndex - group->currentEventIndex;
+}/*_ofsm_group_local_pending_event_count*/
+
+/*number of events pending for the group*/
+static inline _OFSM_INDEX_DATA_TYPE _ofsm_group_pending_event_count(OFSMGroup *group)
+{
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+    return _ofsm_group_local_pending_event_count(group) + (uint8_t)(_ofsmBroadcastHead - group->broadcastCursor);
+#else
+    return _ofsm_group_local_pending_event_count(group);
+#endif
+}/*_ofsm_group_pending_event_count*/
+
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+/*set up default limits of ring buffers; on simulation reset, return grown rings to their declared buffers*/
+static void _ofsm_elastic_queue_reset()
+{
+    _OFSM_INDEX_DATA_TYPE i;
+    OFSMGroup *group;
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        if (!group->eventQueueInitial) {
+            if (!group->eventQueue) {
+                continue; /*group doesn't have ring buffer*/
+            }
+            group->eventQueueInitial = group->eventQueue;
+            group->eventQueueInitialSize = group->eventQueueSize;
+            group->eventQueueMaxSize = OFSM_CONFIG_ELASTIC_QUEUE_MAX_SIZE;
+            group->eventQueueHighWatermark = (_OFSM_INDEX_DATA_TYPE)((unsigned long)group->eventQueueMaxSize * OFSM_CONFIG_ELASTIC_QUEUE_HIGH_WATERMARK_PERCENT / 100);
+        }
+        if (group->eventQueue != group->eventQueueInitial) {
+            delete[] group->eventQueue;
+            group->eventQueue = group->eventQueueInitial;
+            group->eventQueueSize = group->eventQueueInitialSize;
+        }
+    }
+}/*_ofsm_elastic_queue_reset*/
+
+/*double ring buffer size (up to eventQueueMaxSize), keeping queued events in order; called from within atomic block when ring is about to get full*/
+static inline void _ofsm_elastic_queue_grow(OFSMGroup *group)
+{
+    unsigned long newSize = (unsigned long)group->eventQueueSize * 2;
+    OFSMEventData *eventQueue;
+    _OFSM_INDEX_DATA_TYPE i;
+    _OFSM_INDEX_DATA_TYPE k;
+    if (newSize > group->eventQueueMaxSize) {
+        newSize = group->eventQueueMaxSize;
+    }
+    eventQueue = new (std::nothrow) OFSMEventData[newSize];
+    if (!eventQueue) {
+        return; /*ring will overflow as usual*/
+    }
+    /*ring is one event short of being full; ring of size 1 is empty then (current == next without overflow flag)*/
+    k = group->currentEventIndex;
+    i = 0;
+    while (k != group->nextEventIndex) {
+        eventQueue[i++] = (group->eventQueue)[k++];
+        if (k == group->eventQueueSize) {
+            k = 0;
+        }
+    }
+    if (group->eventQueue != group->eventQueueInitial) {
+        delete[] group->eventQueue;
+    }
+    _ofsm_debug_printf(3, "G: Event queue has grown from %i to %lu events.\n", (int)group->eventQueueSize, newSize);
+    group->eventQueue = eventQueue;
+    group->eventQueueSize = (_OFSM_INDEX_DATA_TYPE)newSize;
+    group->currentEventIndex = 0;
+    group->nextEventIndex = i;
+}/*_ofsm_elastic_queue_grow*/
+#endif /*OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE*/
+
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+/*groupLatestWakeupTime receives the earliest of (wakeupTime + wakeupSlack), i.e. the latest time all group FSMs can be waked up at once*/
+static inline void _ofsm_group_process_pending_event(OFSMGroup *group, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_TIME_DATA_TYPE *groupEarliestWakeupTime, uint8_t *groupAndedFsmFlags, _OFSM_TIME_DATA_TYPE *groupLatestWakeupTime)
+#else
+static inline void _ofsm_group_process_pending_event(OFSMGroup *group, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_TIME_DATA_TYPE *groupEarliestWakeupTime, uint8_t *groupAndedFsmFlags)
+#endif
 {
     OFSMEventData e;
     OFSM *fsm;
 	uint8_t andedFsmFlags = (uint8_t)0xFFFF;
-    _OFSM_TIME_DATA_TYPE earliestWakeupTime = 0xFFFFFFFF;
-    uint8_t i;
+    _OFSM_TIME_DATA_TYPE earliestWakeupTime = 0;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    _OFSM_TIME_DATA_TYPE latestWakeupTime = 0;
+    _OFSM_TIME_DATA_TYPE fsmWakeupSlack;
+#endif
+    uint8_t fsmFlags;
+    _OFSM_TIME_DATA_TYPE fsmWakeupTime;
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+    OFSMArray *fsmArray = group->fsmArray;
+#endif
+    _OFSM_INDEX_DATA_TYPE i;
+    _OFSM_INDEX_DATA_TYPE groupSize;
     uint8_t eventPending = 1;
 
-    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
-        if (group->currentEventIndex == group->nextEventIndex && !(group->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW)) {
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_DEQUEUE) {
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+        if (group->fsmPool) {
+            _ofsm_fsm_pool_release_destroyed(group);
+        }
+#endif
+        groupSize = group->groupSize; /*FSMs spawned while the event is being processed will handle next one*/
+        if (_OFSM_GROUP_EVENT_QUEUE_IS_EMPTY(group)) {
             eventPending = 0;
         }
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+        else if (groupIndex != _ofsmEdfGroupIndex) {
+            eventPending = 0; /*other group's head event has earlier deadline; only collect wakeup info*/
+        }
+#endif
         else {
             /*copy event (instead of reference), because event data can be modified during ...queue_event... from interrupt.*/
-            e = ((group->eventQueue)[group->currentEventIndex]);
+            e = *_OFSM_GROUP_EVENT_QUEUE_HEAD(group);
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+            if (e.deadline != OFSM_NO_DEADLINE && (_OFSM_TIME_DATA_TYPE)(_ofsmTime - e.enqueueTime) > e.deadline) {
+                group->deadlineMissCount++;
+            }
+#endif
 
-            group->currentEventIndex++;
-            if (group->currentEventIndex == group->eventQueueSize) {
-                group->currentEventIndex = 0;
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+            if (_OFSM_GROUP_BROADCAST_EVENT_IS_NEXT(group)) {
+                _ofsm_broadcast_pop(group); /*group's own queue (and its overflow flag) stays as is*/
             }
+            else
+#endif
+            {
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+                if (group->eventPool) {
+                    _ofsm_event_pool_pop(group);
+                }
+                else
+#endif
+                {
+                    group->currentEventIndex++;
+                    if (group->currentEventIndex == group->eventQueueSize) {
+                        group->currentEventIndex = 0;
+                    }
+                }
 
-            group->flags &= ~_OFSM_FLAG_GROUP_BUFFER_OVERFLOW; //clear buffer overflow
+                group->flags &= ~_OFSM_FLAG_GROUP_BUFFER_OVERFLOW; //clear buffer overflow
+            }
 
             /*set: other events pending if nextEventIdex points further in the queue */
-            if (group->currentEventIndex != group->nextEventIndex) {
+            if (!_OFSM_GROUP_EVENT_QUEUE_IS_EMPTY(group)) {
                 _ofsmFlags |= _OFSM_FLAG_OFSM_EVENT_QUEUED;
             }
         }
@@ -188,42 +566,184 @@ static inline void _ofsm_group_process_pending_event(OFSMGroup *group, uint8_t g
     }
 
     //iterate over fsms
-    for (i = 0; i < group->groupSize; i++) {
-        fsm = (group->fsms)[i];
-        //if queue is empty don't call fsm just collect info
-        if (eventPending) {
-            _ofsm_fsm_process_event(fsm, groupIndex, i, &e);
+    for (i = 0; i < groupSize; i++) {
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+        if (fsmArray) {
+            //instance state is processed in the cursor FSM, wakeup info is collected from parallel arrays
+            if (eventPending) {
+                fsm = _ofsm_fsm_array_load(fsmArray, i);
+                _ofsm_fsm_process_event(fsm, groupIndex, i, &e);
+                _ofsm_fsm_array_store(fsmArray, i);
+            }
+            fsmFlags = (fsmArray->flags)[i];
+            fsmWakeupTime = (fsmArray->wakeupTime)[i];
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            fsmWakeupSlack = (fsmArray->wakeupSlack)[i];
+#   endif
+        }
+        else
+#endif
+        {
+            fsm = (group->fsms)[i];
+            //if queue is empty don't call fsm just collect info
+            if (eventPending) {
+                _ofsm_fsm_process_event(fsm, groupIndex, i, &e);
+            }
+            fsmFlags = fsm->flags;
+            fsmWakeupTime = fsm->wakeupTime;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            fsmWakeupSlack = fsm->wakeupSlack;
+#endif
         }
 
-        //Take sleep period unless infinite sleep
-        if (!(fsm->flags & _OFSM_FLAG_INFINITE_SLEEP)) {
-            if(_OFSM_TIME_A_GT_B(earliestWakeupTime, (andedFsmFlags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW), fsm->wakeupTime, (fsm->flags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW))) {
-                earliestWakeupTime = fsm->wakeupTime;
+        //Take sleep period unless infinite sleep; until first FSM with wakeup time is found, anded flags keep infinite sleep flag set
+        if (!(fsmFlags & _OFSM_FLAG_INFINITE_SLEEP)) {
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            if((andedFsmFlags & _OFSM_FLAG_INFINITE_SLEEP) || _OFSM_TIME_A_GT_B(latestWakeupTime, fsmWakeupTime + fsmWakeupSlack)) {
+                latestWakeupTime = fsmWakeupTime + fsmWakeupSlack;
+            }
+#   ifdef OFSM_CONFIG_SIMULATION
+            _ofsmSimulationWakeupTimes.push_back(fsmWakeupTime);
+#   endif
+#endif
+            if((andedFsmFlags & _OFSM_FLAG_INFINITE_SLEEP) || _OFSM_TIME_A_GT_B(earliestWakeupTime, fsmWakeupTime)) {
+                earliestWakeupTime = fsmWakeupTime;
             }
         }
-        andedFsmFlags &= fsm->flags;
+        andedFsmFlags &= fsmFlags;
     }
 
     *groupEarliestWakeupTime = earliestWakeupTime;
     *groupAndedFsmFlags  = andedFsmFlags;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    *groupLatestWakeupTime = latestWakeupTime;
+#endif
 }/*_ofsm_group_process_pending_event*/
 
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+/*Earliest Deadline First: returns index of the group whose head event has the least time left before its deadline.
+Ties (and events without deadline) are resolved in group declaration order. Returns _ofsmGroupCount if all queues are empty.*/
+static inline _OFSM_INDEX_DATA_TYPE _ofsm_edf_select_group()
+{
+    _OFSM_INDEX_DATA_TYPE i;
+    _OFSM_INDEX_DATA_TYPE selectedIndex = _ofsmGroupCount;
+    _OFSM_INDEX_DATA_TYPE pendingGroupCount = 0;
+    OFSMGroup *group;
+    OFSMEventData *head;
+    _OFSM_TIME_DATA_TYPE age;
+    _OFSM_TIME_DATA_TYPE timeLeft;
+    _OFSM_TIME_DATA_TYPE earliestTimeLeft = 0;
+
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_MAIN_LOOP) {
+        for (i = 0; i < _ofsmGroupCount; i++) {
+            group = (_ofsmGroups)[i];
+            if (_OFSM_GROUP_EVENT_QUEUE_IS_EMPTY(group)) {
+                continue;
+            }
+            pendingGroupCount++;
+            head = _OFSM_GROUP_EVENT_QUEUE_HEAD(group);
+            timeLeft = OFSM_NO_DEADLINE;
+            if (head->deadline != OFSM_NO_DEADLINE) {
+                age = _ofsmTime - head->enqueueTime; /*time overflow will be accounted for*/
+                timeLeft = (age >= head->deadline) ? 0 : head->deadline - age;
+            }
+            if (selectedIndex == _ofsmGroupCount || timeLeft < earliestTimeLeft) {
+                selectedIndex = i;
+                earliestTimeLeft = timeLeft;
+            }
+        }
+        /*groups that were not selected will be served during next iteration*/
+        if (pendingGroupCount > 1) {
+            _ofsmFlags |= _OFSM_FLAG_OFSM_EVENT_QUEUED;
+        }
+    }
+    return selectedIndex;
+}/*_ofsm_edf_select_group*/
+#endif /*OFSM_CONFIG_SUPPORT_EVENT_DEADLINE*/
+
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+/*move events staged by ISRs into group event queues (in the order they were staged).
+Main loop is the only consumer, so tail doesn't need a lock; head is read once, events staged meanwhile are picked up by next iteration.*/
+static inline void _ofsm_isr_staging_drain()
+{
+    uint8_t head = _ofsmIsrStagingHead;
+    uint8_t tail = _ofsmIsrStagingTail;
+    OFSMStagedEvent *e;
+    while (tail != head) {
+        e = &(_ofsmIsrStaging[tail & (OFSM_CONFIG_ISR_STAGING_SIZE - 1)]);
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
+        ofsm_queue_group_event(e->groupIndex, e->forceNewEvent, e->eventCode, e->eventData);
+#else
+        ofsm_queue_group_event(e->groupIndex, e->forceNewEvent, e->eventCode, 0);
+#endif
+        tail++;
+        _ofsmIsrStagingTail = tail; /*release slot only after event was copied*/
+    }
+}/*_ofsm_isr_staging_drain*/
+
+static inline void _ofsm_isr_staging_reset()
+{
+    _ofsmIsrStagingHead = _ofsmIsrStagingTail = 0;
+    _ofsmIsrStagingDropCount = 0;
+}/*_ofsm_isr_staging_reset*/
+#endif
+
 void _ofsm_setup() {
+#if defined(OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER) || defined(OFSM_CONFIG_SUPPORT_FSM_ARRAY) || defined(OFSM_CONFIG_SUPPORT_FSM_POOL)
+    _OFSM_INDEX_DATA_TYPE i;
+    OFSMGroup *group;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER
+    _OFSM_INDEX_DATA_TYPE k;
+    OFSM *fsm;
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+    //FSM array instances start in initial state of the array
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        if (group->fsmArray) {
+            _ofsm_fsm_array_reset(group->fsmArray, group->groupSize);
+        }
+    }
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+    _ofsm_event_pool_reset();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+    _ofsm_elastic_queue_reset();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+    _ofsm_isr_staging_reset();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+    _ofsm_broadcast_reset();
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+    //FSM pools start empty
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        if (group->fsmPool) {
+            _ofsm_fsm_pool_reset(group);
+        }
+    }
+#endif
 
 #ifdef OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER
     //configure FSMs, call all initialization handlers
-#   ifndef OFSM_CONFIG_SIMULATION
-    uint8_t i, k;
-    OFSMGroup *group;
-    OFSM *fsm;
-#   endif
     OFSMState fsmState;
     OFSMEventData e;
     fsmState.e = &e;
     for (i = 0; i < _ofsmGroupCount; i++) {
         group = (_ofsmGroups)[i];
         for (k = 0; k < group->groupSize; k++) {
+#   ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+            fsm = group->fsmArray ? _ofsm_fsm_array_load(group->fsmArray, k) : (group->fsms)[k];
+#   else
             fsm = (group->fsms)[k];
+#   endif
             _ofsm_debug_printf(4, "F(%i)G(%i): Initializing...\n", k, i );
             fsmState.fsm = fsm;
             fsmState.timeLeftBeforeTimeout = 0;
@@ -233,52 +753,339 @@ void _ofsm_setup() {
             if (fsm->initHandler) {
                 (fsm->initHandler)();
             }
+#   ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+            if (group->fsmArray) {
+                _ofsm_fsm_array_store(group->fsmArray, k);
+            }
+#   endif
         }
     }
 #endif
 } /*_ofsm_setup*/
 
+#if defined(OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK) && defined(OFSM_CONFIG_SIMULATION)
+/*number of distinct FSM wakeup times (besides the first one) that will be served by wakeup at wakeupTime;
+uses wakeup times collected by last pass over all groups (see _ofsm_group_process_pending_event())*/
+static unsigned long _ofsm_simulation_count_coalesced_wakeups(_OFSM_TIME_DATA_TYPE wakeupTime)
+{
+    std::vector<_OFSM_TIME_DATA_TYPE>::iterator due;
+    unsigned long distinctCount;
+
+    due = std::remove_if(_ofsmSimulationWakeupTimes.begin(), _ofsmSimulationWakeupTimes.end(),
+        [wakeupTime](_OFSM_TIME_DATA_TYPE t) { return _OFSM_TIME_A_GT_B(t, wakeupTime); });
+    std::sort(_ofsmSimulationWakeupTimes.begin(), due);
+    distinctCount = (unsigned long)(std::unique(_ofsmSimulationWakeupTimes.begin(), due) - _ofsmSimulationWakeupTimes.begin());
+    return distinctCount > 0 ? distinctCount - 1 : 0;
+}/*_ofsm_simulation_count_coalesced_wakeups*/
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+/*account time spent awake since last wakeup; called right before entering sleep*/
+static inline void _ofsm_sleep_statistics_enter()
+{
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_SLEEP_STATISTICS) {
+        _ofsmSleepStatistics.awakeTicks += _ofsmTime - _ofsmSleepStatistics.markTime;
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+        _ofsmSimulationEnergyAwakeTicks = _ofsmTime - _ofsmSleepStatistics.markTime;
+#endif
+        _ofsmSleepStatistics.markTime = _ofsmTime;
+        _ofsmSleepStatistics.markTimeoutWakeupCount = _ofsmSleepStatistics.timeoutWakeupCount;
+        _ofsmSleepStatistics.markDeepSleepTicks = _ofsmSleepStatistics.deepSleepTicks;
+        _ofsmSleepStatistics.asleep = 1;
+    }
+}/*_ofsm_sleep_statistics_enter*/
+
+/*account sleep period and wakeup cause; called right after wakeup.
+On MCU deep sleep ticks are accounted by _ofsm_enter_sleep(), the rest of the period is an idle sleep.
+In simulation the whole period is a deep sleep if it was allowed.*/
+static inline void _ofsm_sleep_statistics_exit()
+{
+    _OFSM_TIME_DATA_TYPE sleepTicks;
+    uint8_t wakeupByTimeout;
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_SLEEP_STATISTICS) {
+        if (_ofsmSleepStatistics.asleep) {
+            sleepTicks = _ofsmTime - _ofsmSleepStatistics.markTime;
+            wakeupByTimeout = _ofsmSleepStatistics.timeoutWakeupCount != _ofsmSleepStatistics.markTimeoutWakeupCount;
+#ifdef OFSM_CONFIG_SIMULATION
+            if (_ofsmFlags & _OFSM_FLAG_ALLOW_DEEP_SLEEP) {
+                _ofsmSleepStatistics.deepSleepTicks += sleepTicks;
+                if (!wakeupByTimeout) {
+                    _ofsmSleepStatistics.interruptedDeepSleepCount++;
+                }
+            }
+#   ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+            _ofsmSimulationEnergyElapsedUs += ((double)_ofsmSimulationEnergyAwakeTicks + (double)sleepTicks) * OFSM_CONFIG_TICK_US;
+            _ofsmSimulationEnergyChargeUC += OFSM_CONFIG_CUSTOM_SIMULATION_ENERGY_MODEL_FUNC(_ofsmSimulationEnergyAwakeTicks, sleepTicks, (_ofsmFlags & _OFSM_FLAG_ALLOW_DEEP_SLEEP) != 0);
+#   endif
+#endif
+            _ofsmSleepStatistics.idleSleepTicks += sleepTicks - (_ofsmSleepStatistics.deepSleepTicks - _ofsmSleepStatistics.markDeepSleepTicks);
+            if (!wakeupByTimeout) {
+                _ofsmSleepStatistics.eventWakeupCount++;
+            }
+            _ofsmSleepStatistics.markTime = _ofsmTime;
+            _ofsmSleepStatistics.asleep = 0;
+        }
+    }
+}/*_ofsm_sleep_statistics_exit*/
+#endif /*OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS*/
+
+#if defined(_OFSM_IMPL_SIMULATION_TRACE_RECORD) || defined(_OFSM_IMPL_SIMULATION_TRACE_REPLAY)
+/*--------------------------------------
+Simulation trace: binary log of everything that threaded simulation receives from other threads than FSM thread.
+Header: "OFSMTRC", format version, sizes of time, index and event data types. Each record starts with record type:
+    'B'                                             - FSM thread start: setup()
+    'W'                                             - main loop waked up from sleep
+    'P', digest                                     - main loop pass; digest (uint32_t) of OFSM state before the pass
+    'H', time                                       - heartbeat; it is the tick of all following records
+    'E', flags, groupIndex, eventCode, eventData[, deadlineTicks] - queued event
+    'R'                                             - reset
+----------------------------------------*/
+#define _OFSM_SIMULATION_TRACE_VERSION 1
+#define _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT 0x01
+#define _OFSM_SIMULATION_TRACE_FLAG_GLOBAL 0x02
+#define _OFSM_SIMULATION_TRACE_FLAG_ISR 0x04
+#define _OFSM_SIMULATION_TRACE_FLAG_DEADLINE 0x08
+
+static const char _ofsmSimulationTraceMagic[] = "OFSMTRC";
+FILE *_ofsmSimulationTraceFile;
+
+static inline void _ofsm_simulation_trace_hash(uint32_t *h, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t*)data;
+    while (size--) {
+        *h = (*h ^ *p++) * 16777619UL;
+    }
+}
+
+/*FNV-1a digest of OFSM time, queues and FSMs; OFSM flags are left out, they depend on the way main loop sleeps*/
+static uint32_t _ofsm_simulation_trace_digest() {
+    uint32_t h = 2166136261UL;
+    _OFSM_INDEX_DATA_TYPE i, k, index;
+    _OFSM_TIME_DATA_TYPE time;
+    uint8_t value;
+    OFSMGroup *group;
+
+    time = _ofsmTime;
+    _ofsm_simulation_trace_hash(&h, &time, sizeof(time));
+    time = _ofsmWakeupTime;
+    _ofsm_simulation_trace_hash(&h, &time, sizeof(time));
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        value = group->flags;
+        _ofsm_simulation_trace_hash(&h, &value, sizeof(value));
+        index = group->currentEventIndex;
+        _ofsm_simulation_trace_hash(&h, &index, sizeof(index));
+        index = group->nextEventIndex;
+        _ofsm_simulation_trace_hash(&h, &index, sizeof(index));
+        index = group->groupSize;
+        _ofsm_simulation_trace_hash(&h, &index, sizeof(index));
+        for (k = 0; k < group->groupSize; k++) {
+            value = _OFSM_GROUP_FSM_CURRENT_STATE(group, k);
+            _ofsm_simulation_trace_hash(&h, &value, sizeof(value));
+            value = _OFSM_GROUP_FSM_FLAGS(group, k);
+            _ofsm_simulation_trace_hash(&h, &value, sizeof(value));
+            time = _OFSM_GROUP_FSM_WAKEUP_TIME(group, k);
+            _ofsm_simulation_trace_hash(&h, &time, sizeof(time));
+        }
+    }
+    return h;
+}/*_ofsm_simulation_trace_digest*/
+#endif
+
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+std::thread::id _ofsmSimulationTraceFsmThreadId;
+uint8_t _ofsmSimulationTraceSuspended;      /*events queued by OFSM itself (e.g. timeout queued by heartbeat) are not recorded*/
+bool _ofsmSimulationTracePassLocked;         /*FSM thread holds simulation mutex for the whole main loop pass*/
+bool _ofsmSimulationTracePassStarted;
+
+bool _ofsm_simulation_trace_record_open(const char *fileName) {
+    uint8_t header[sizeof(_ofsmSimulationTraceMagic) + 3];
+    _ofsmSimulationTraceFile = fopen(fileName, "wb");
+    if (!_ofsmSimulationTraceFile) {
+        std::cerr << "Unable to create " << fileName << ". Exiting..." << std::endl;
+        return false;
+    }
+    memcpy(header, _ofsmSimulationTraceMagic, sizeof(_ofsmSimulationTraceMagic) - 1);
+    header[sizeof(_ofsmSimulationTraceMagic) - 1] = _OFSM_SIMULATION_TRACE_VERSION;
+    header[sizeof(_ofsmSimulationTraceMagic)] = sizeof(_OFSM_TIME_DATA_TYPE);
+    header[sizeof(_ofsmSimulationTraceMagic) + 1] = sizeof(_OFSM_INDEX_DATA_TYPE);
+    header[sizeof(_ofsmSimulationTraceMagic) + 2] = sizeof(OFSM_CONFIG_EVENT_DATA_TYPE);
+    fwrite(header, sizeof(header), 1, _ofsmSimulationTraceFile);
+    return true;
+}
+
+void _ofsm_simulation_trace_record_close() {
+    FILE *f;
+    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+        f = _ofsmSimulationTraceFile;
+        _ofsmSimulationTraceFile = NULL;
+    }
+    if (f) {
+        fclose(f);
+    }
+}
+
+/*must be called from within atomic block*/
+static inline void _ofsm_simulation_trace_write(uint8_t type, const void *data, size_t size) {
+    if (_ofsmSimulationTraceFile) {
+        fputc(type, _ofsmSimulationTraceFile);
+        if (size) {
+            fwrite(data, size, 1, _ofsmSimulationTraceFile);
+        }
+    }
+}
+
+/*must be called from within atomic block*/
+static inline void _ofsm_simulation_trace_event(uint8_t flags, _OFSM_INDEX_DATA_TYPE groupIndex, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData, _OFSM_TIME_DATA_TYPE deadlineTicks) {
+    if (!_ofsmSimulationTraceFile || _ofsmSimulationTraceSuspended || std::this_thread::get_id() == _ofsmSimulationTraceFsmThreadId) {
+        return; /*FSM thread regenerates its own events on replay*/
+    }
+    _ofsm_simulation_trace_write('E', &flags, sizeof(flags));
+    fwrite(&groupIndex, sizeof(groupIndex), 1, _ofsmSimulationTraceFile);
+    fwrite(&eventCode, sizeof(eventCode), 1, _ofsmSimulationTraceFile);
+    fwrite(&eventData, sizeof(eventData), 1, _ofsmSimulationTraceFile);
+    if (flags & _OFSM_SIMULATION_TRACE_FLAG_DEADLINE) {
+        fwrite(&deadlineTicks, sizeof(deadlineTicks), 1, _ofsmSimulationTraceFile);
+    }
+}
+
+/*records event and queues it within the same atomic block, so that it can't be taken by main loop pass that has started before it was recorded*/
+#   define _OFSM_SIMULATION_TRACE_QUEUE(status, flags, groupIndex, eventCode, eventData, deadlineTicks, queueCall) \
+    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { \
+        _ofsm_simulation_trace_event((flags), (groupIndex), (eventCode), (eventData), (deadlineTicks)); \
+        status = queueCall; \
+    }
+
+/*main loop pass and its wakeup are not interleaved with other threads, so that replay can take them as single step*/
+static inline void _ofsm_simulation_trace_lock_pass() {
+    if (_ofsmSimulationTraceFile && !_ofsmSimulationTracePassLocked) {
+        OFSM_CONFIG_ATOMIC_RESTORESTATE.lock();
+        _ofsmSimulationTracePassLocked = true;
+    }
+}
+
+static inline void _ofsm_simulation_trace_unlock_pass() {
+    _ofsmSimulationTracePassStarted = false;
+    if (_ofsmSimulationTracePassLocked) {
+        _ofsmSimulationTracePassLocked = false;
+        OFSM_CONFIG_ATOMIC_RESTORESTATE.unlock();
+    }
+}
+
+/*FSM thread: setup() and the first main loop pass*/
+void _ofsm_simulation_trace_begin() {
+    _ofsmSimulationTracePassLocked = _ofsmSimulationTracePassStarted = false;
+    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+        _ofsmSimulationTraceFsmThreadId = std::this_thread::get_id();
+        _ofsm_simulation_trace_lock_pass();
+        _ofsm_simulation_trace_write('B', NULL, 0);
+    }
+}
+
+/*FSM thread: main loop is waked up; wakeup clears OFSM flags*/
+void _ofsm_simulation_trace_wakeup() {
+    _ofsm_simulation_trace_lock_pass();
+    _ofsm_simulation_trace_write('W', NULL, 0);
+}
+
+/*must be called from within atomic block*/
+static inline void _ofsm_simulation_trace_pass() {
+    uint32_t digest;
+    if (_ofsmSimulationTraceFile && !_ofsmSimulationTracePassStarted) {
+        _ofsm_simulation_trace_lock_pass();
+        _ofsmSimulationTracePassStarted = true;
+        digest = _ofsm_simulation_trace_digest();
+        _ofsm_simulation_trace_write('P', &digest, sizeof(digest));
+    }
+}
+
+void _ofsm_simulation_trace_reset() {
+    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+        _ofsm_simulation_trace_write('R', NULL, 0);
+    }
+}
+#else
+#   define _OFSM_SIMULATION_TRACE_QUEUE(status, flags, groupIndex, eventCode, eventData, deadlineTicks, queueCall) status = queueCall;
+#endif /*_OFSM_IMPL_SIMULATION_TRACE_RECORD*/
+
 void _ofsm_start() {
-    uint8_t i;
+    _OFSM_INDEX_DATA_TYPE i;
     OFSMGroup *group;
     uint8_t andedFsmFlags;
     _OFSM_TIME_DATA_TYPE earliestWakeupTime;
     uint8_t groupAndedFsmFlags;
     _OFSM_TIME_DATA_TYPE groupEarliestWakeupTime;
     _OFSM_TIME_DATA_TYPE currentTime;
-    uint8_t timeFlags;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    _OFSM_TIME_DATA_TYPE latestWakeupTime;
+    _OFSM_TIME_DATA_TYPE groupLatestWakeupTime;
+#endif
 #ifdef OFSM_CONFIG_SIMULATION
 	bool doReturn = false;
 #endif
 
+#if defined(OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS) && defined(OFSM_CONFIG_SIMULATION_SCRIPT_MODE)
+    if (_ofsmFlags & _OFSM_FLAG_OFSM_EVENT_QUEUED) {
+        _ofsm_sleep_statistics_exit(); /*in script mode each step with queued event is a wakeup; MCU doesn't leave sleep until event is queued*/
+    }
+#endif
+
 	/*start main loop*/
     do
     {
-        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+        _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_MAIN_LOOP) {
             _ofsmFlags |= _OFSM_FLAG_OFSM_IN_PROCESS;   /*prevents _ofsm_check_timeout() to ever accessing _ofsmWakeupTime and queue timeout while in process*/
             _ofsmFlags &= ~(_OFSM_FLAG_OFSM_EVENT_QUEUED); /*reset event queued flag*/
 #ifdef OFSM_CONFIG_SIMULATION
             if (_ofsmFlags &_OFSM_FLAG_OFSM_SIMULATION_EXIT) {
                 doReturn = true; /*don't return or break here!!, or ATOMIC_BLOCK mutex will remain blocked*/
             }
+#endif
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+            else {
+                _ofsm_simulation_trace_pass();
+            }
 #endif
         }
 #ifdef OFSM_CONFIG_SIMULATION
         if (doReturn) {
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+            _ofsm_simulation_trace_unlock_pass();
+#endif
             return;
         }
 #endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+        _ofsm_isr_staging_drain();
+#endif
 
 
         andedFsmFlags = (uint8_t)0xFFFF;
-        earliestWakeupTime = 0xFFFFFFFF;
+        earliestWakeupTime = 0;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+        latestWakeupTime = 0;
+#   ifdef OFSM_CONFIG_SIMULATION
+        _ofsmSimulationWakeupTimes.clear();
+#   endif
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+        _ofsmEdfGroupIndex = _ofsm_edf_select_group();
+#endif
         for (i = 0; i < _ofsmGroupCount; i++) {
             group = (_ofsmGroups)[i];
             _ofsm_debug_printf(4,  "O: Processing event for group index %i...\n", i);
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            _ofsm_group_process_pending_event(group, i, &groupEarliestWakeupTime, &groupAndedFsmFlags, &groupLatestWakeupTime);
+#else
             _ofsm_group_process_pending_event(group, i, &groupEarliestWakeupTime, &groupAndedFsmFlags);
+#endif
 
             if (!(groupAndedFsmFlags & _OFSM_FLAG_INFINITE_SLEEP)) {
-                if(_OFSM_TIME_A_GT_B(earliestWakeupTime, (andedFsmFlags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW), groupEarliestWakeupTime, (groupAndedFsmFlags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW))) {
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+                if((andedFsmFlags & _OFSM_FLAG_INFINITE_SLEEP) || _OFSM_TIME_A_GT_B(latestWakeupTime, groupLatestWakeupTime)) {
+                    latestWakeupTime = groupLatestWakeupTime;
+                }
+#endif
+                if((andedFsmFlags & _OFSM_FLAG_INFINITE_SLEEP) || _OFSM_TIME_A_GT_B(earliestWakeupTime, groupEarliestWakeupTime)) {
                     earliestWakeupTime = groupEarliestWakeupTime;
                 }
             }
@@ -292,27 +1099,38 @@ void _ofsm_start() {
         }
 
         if (!(andedFsmFlags & _OFSM_FLAG_INFINITE_SLEEP)) {
-            ofsm_get_time(currentTime, timeFlags);
-            if (_OFSM_TIME_A_GTE_B(currentTime, ((uint8_t)timeFlags & _OFSM_FLAG_OFSM_TIMER_OVERFLOW), earliestWakeupTime, (andedFsmFlags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW))) {
+            ofsm_get_time(currentTime);
+            if (_OFSM_TIME_A_GTE_B(currentTime, earliestWakeupTime)) {
                 _ofsm_debug_printf(3,  "O: Reached timeout. Queue global timeout event.\n");
                 ofsm_queue_global_event(false, 0, 0);
                 continue;
             }
         }
 
-        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+        /*nothing is due yet; sleep until the latest time that is still within slack of every FSM, so that close wakeup times are served by single wakeup*/
+        earliestWakeupTime = latestWakeupTime;
+#   ifdef OFSM_CONFIG_SIMULATION
+        _ofsmSimulationPendingSavedWakeups = (andedFsmFlags & _OFSM_FLAG_INFINITE_SLEEP) ? 0 : _ofsm_simulation_count_coalesced_wakeups(latestWakeupTime);
+#   endif
+#endif
+        _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_MAIN_LOOP) {
 			_ofsmWakeupTime = earliestWakeupTime;
 			_ofsmFlags = (_ofsmFlags & ~_OFSM_FLAG_ALL) | (andedFsmFlags & _OFSM_FLAG_ALL);
-			//if scheduled time is in overflow and timer is in overflow reset timer overflow flag
-			if ((_ofsmFlags & _OFSM_FLAG_INFINITE_SLEEP) || ((_ofsmFlags & _OFSM_FLAG_OFSM_TIMER_OVERFLOW) && (_ofsmFlags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW)))
-            {
-                _ofsmFlags &= ~(_OFSM_FLAG_OFSM_TIMER_OVERFLOW | _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW);
-            }
 			_ofsmFlags &= ~(_OFSM_FLAG_OFSM_FIRST_ITERATION | _OFSM_FLAG_OFSM_IN_PROCESS);
 		}
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+        _ofsm_simulation_trace_unlock_pass();
+#endif
 #ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
         _ofsm_debug_printf(4,  "O: Entering sleep... Wakeup Time %ld.\n", _ofsmFlags & _OFSM_FLAG_INFINITE_SLEEP ? -1 : (long int)_ofsmWakeupTime);
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+        _ofsm_sleep_statistics_enter();
+#endif
         OFSM_CONFIG_CUSTOM_ENTER_SLEEP_FUNC();
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+        _ofsm_sleep_statistics_exit();
+#endif
 
         _ofsm_debug_printf(4,  "O: Waked up.\n");
     } while (1);
@@ -321,77 +1139,148 @@ void _ofsm_start() {
         break; /*process single event per step*/
 #	endif
     } while (_ofsmFlags & _OFSM_FLAG_OFSM_EVENT_QUEUED);
+#   ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    if (!(_ofsmFlags & _OFSM_FLAG_OFSM_EVENT_QUEUED) && !_ofsmSleepStatistics.asleep) {
+        _ofsm_sleep_statistics_enter();
+    }
+#   endif
     _ofsm_debug_printf(4, "O: Step through OFSM is complete.\n");
 #endif
 
 }/*_ofsm_start*/
 
-void _ofsm_queue_group_event(uint8_t groupIndex, OFSMGroup *group, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
-    uint8_t copyNextEventIndex;
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+OFSMQueueStatus _ofsm_queue_group_event_deadline(_OFSM_INDEX_DATA_TYPE groupIndex, OFSMGroup *group, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData, _OFSM_TIME_DATA_TYPE deadlineTicks) {
+#else
+OFSMQueueStatus _ofsm_queue_group_event(_OFSM_INDEX_DATA_TYPE groupIndex, OFSMGroup *group, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
+#endif
+    _OFSM_INDEX_DATA_TYPE copyNextEventIndex;
     OFSMEventData *event;
+    bool queueFull;
+    OFSMQueueStatus status = OFSM_QUEUE_STATUS_DROPPED;
 #ifdef OFSM_CONFIG_SIMULATION
     uint8_t debugFlags = 0x1; /*set buffer overflow*/
 #endif
-    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_QUEUE) {
         copyNextEventIndex = group->nextEventIndex;
 
 		/*since even is queued we must erase deep sleep flag to indicate that deep sleep was interrupted and infinite timeout */
 		_ofsmFlags &= ~(_OFSM_FLAG_OFSM_IN_DEEP_SLEEP);
 
-        if (!(group->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW)) {
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+        queueFull = group->eventPool ? !_ofsm_event_pool_can_acquire(group) : (group->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW) != 0;
+#else
+        queueFull = (group->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW) != 0;
+#endif
 #ifdef OFSM_CONFIG_SIMULATION
+        if (!queueFull) {
             debugFlags = 0; /*remove buffer overflow*/
+        }
 #endif
-            if (group->nextEventIndex == group->currentEventIndex) {
-                forceNewEvent = true; /*all event are processed by FSM and event should never reuse previous event slot.*/
-            }
-            else if (0 == eventCode) {
-                forceNewEvent = false; /*always replace timeout event*/
-            }
+        /*checked even if queue is full: group of shared event pool may have no slots while its own queue is empty, then there is no previous event to replace*/
+        if (_OFSM_GROUP_LOCAL_EVENT_QUEUE_IS_EMPTY(group)) {
+            forceNewEvent = true; /*all event are processed by FSM and event should never reuse previous event slot.*/
+        }
+        else if (!queueFull && 0 == eventCode) {
+            forceNewEvent = false; /*always replace timeout event*/
         }
 
         /*update previous event if previous event codes matches*/
         if (!forceNewEvent) {
-            if (copyNextEventIndex == 0) {
-                copyNextEventIndex = group->eventQueueSize;
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+            if (group->eventPool) {
+                event = &(group->eventPool->events[group->eventTail]);
+            }
+            else
+#endif
+            {
+                event = &(group->eventQueue[(copyNextEventIndex == 0 ? group->eventQueueSize : copyNextEventIndex) - 1]);
             }
-            event = &(group->eventQueue[copyNextEventIndex - 1]);
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+            if (event->eventCode != eventCode || event->broadcastSeq != _ofsmBroadcastHead) { /*global event queued after the last one is the last one now*/
+#else
             if (event->eventCode != eventCode) {
+#endif
                 forceNewEvent = 1;
             }
             else {
 #ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
                 event->eventData = eventData;
 #endif
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+                /*replaced event keeps its place in the queue, but takes the earlier of both deadlines*/
+                if (deadlineTicks != OFSM_NO_DEADLINE) {
+                    _OFSM_TIME_DATA_TYPE age = _ofsmTime - event->enqueueTime;
+                    /*compare time left rather than absolute deadlines, so that large deadlines don't wrap around; missed deadline stays missed*/
+                    if (event->deadline == OFSM_NO_DEADLINE || (age < event->deadline && deadlineTicks < event->deadline - age)) {
+                        event->deadline = age + deadlineTicks;
+                    }
+                }
+#endif
+                status = OFSM_QUEUE_STATUS_REPLACED;
 #ifdef OFSM_CONFIG_SIMULATION
                 debugFlags |= 0x2; /*set event replaced flag*/
 #endif
             }
         }
 
-        if (!(group->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW)) {
+        if (!queueFull) {
             if (forceNewEvent) {
-                group->nextEventIndex++;
-                if (group->nextEventIndex >= group->eventQueueSize) {
-                    group->nextEventIndex = 0;
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+                if (group->eventPool) {
+                    event = _ofsm_event_pool_push(group);
+                }
+                else
+#endif
+                {
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+                    /*grow the ring instead of letting it get full*/
+                    if (group->eventQueueSize < group->eventQueueMaxSize && (copyNextEventIndex + 1 == group->eventQueueSize ? 0 : copyNextEventIndex + 1) == group->currentEventIndex) {
+                        _ofsm_elastic_queue_grow(group);
+                        copyNextEventIndex = group->nextEventIndex;
+                    }
+#endif
+                    group->nextEventIndex++;
+                    if (group->nextEventIndex >= group->eventQueueSize) {
+                        group->nextEventIndex = 0;
+                    }
+                    event = &(group->eventQueue[copyNextEventIndex]);
+
+                    /*event buffer overflow disable further events*/
+                    if (group->nextEventIndex == group->currentEventIndex) {
+                        group->flags |= _OFSM_FLAG_GROUP_BUFFER_OVERFLOW; /*set buffer overflow flag, so that no new events get queued*/
+                    }
                 }
 
                 /*queue event*/
-                event = &(group->eventQueue[copyNextEventIndex]);
                 event->eventCode = eventCode;
 #ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
                 event->eventData = eventData;
 #endif
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+                event->enqueueTime = _ofsmTime;
+                event->deadline = deadlineTicks;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+                event->broadcastSeq = _ofsmBroadcastHead;
+                _ofsmBroadcastGroupEventQueued = 1;
+#endif
 
                 /*set event queued flag, so that _ofsm_start() knows if it need to continue processing*/
                 _ofsmFlags |= (_OFSM_FLAG_OFSM_EVENT_QUEUED);
-
-                /*event buffer overflow disable further events*/
-                if (group->nextEventIndex == group->currentEventIndex) {
-                    group->flags |= _OFSM_FLAG_GROUP_BUFFER_OVERFLOW; /*set buffer overflow flag, so that no new events get queued*/
-                }
+                status = OFSM_QUEUE_STATUS_QUEUED;
             }
         }
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+        if (status != OFSM_QUEUE_STATUS_DROPPED && group->eventQueueHighWatermark && _ofsm_group_local_pending_event_count(group) >= group->eventQueueHighWatermark) {
+            status = OFSM_QUEUE_STATUS_BACKPRESSURE;
+        }
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+        if (status == OFSM_QUEUE_STATUS_DROPPED && forceNewEvent && group->eventPool) {
+            group->flags |= _OFSM_FLAG_GROUP_BUFFER_OVERFLOW; /*event is dropped: no slot is available to the group*/
+        }
+#endif
     }
 #ifdef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
 #   if OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE == 0
@@ -419,10 +1308,35 @@ void _ofsm_queue_group_event(uint8_t groupIndex, OFSMGroup *group, bool forceNew
         _ofsm_debug_printf(4,  "G(%i): currentEventIndex %i, nextEventIndex %i.\n", groupIndex, group->currentEventIndex, group->nextEventIndex);
     }
 #endif
+    return status;
+}/*_ofsm_queue_group_event*/
+
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+/*regular queuing uses group default deadline (see ofsm_set_group_event_deadline())*/
+OFSMQueueStatus _ofsm_queue_group_event(_OFSM_INDEX_DATA_TYPE groupIndex, OFSMGroup *group, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
+    return _ofsm_queue_group_event_deadline(groupIndex, group, forceNewEvent, eventCode, eventData, group->eventDeadline);
 }/*_ofsm_queue_group_event*/
+#endif
 
-void ofsm_queue_group_event(uint8_t groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData)
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+OFSMQueueStatus ofsm_queue_group_event_deadline(_OFSM_INDEX_DATA_TYPE groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData, _OFSM_TIME_DATA_TYPE deadlineTicks)
 {
+    OFSMQueueStatus status;
+#ifdef OFSM_CONFIG_SIMULATION
+    if (groupIndex >= _ofsmGroupCount) {
+        _ofsm_debug_printf(1,  "O: Invalid Group Index %i!!! Dropped eventCode %i. \n", groupIndex, eventCode);
+        return OFSM_QUEUE_STATUS_DROPPED;
+    }
+#endif
+    _OFSM_SIMULATION_TRACE_QUEUE(status, _OFSM_SIMULATION_TRACE_FLAG_DEADLINE | (forceNewEvent ? _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT : 0), groupIndex, eventCode, eventData, deadlineTicks,
+        _ofsm_queue_group_event_deadline(groupIndex, _ofsmGroups[groupIndex], forceNewEvent, eventCode, eventData, deadlineTicks));
+    return status;
+}/*ofsm_queue_group_event_deadline*/
+#endif /*OFSM_CONFIG_SUPPORT_EVENT_DEADLINE*/
+
+OFSMQueueStatus ofsm_queue_group_event(_OFSM_INDEX_DATA_TYPE groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData)
+{
+    OFSMQueueStatus status;
 #ifdef OFSM_CONFIG_SIMULATION
     if (groupIndex >= _ofsmGroupCount) {
 #ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
@@ -430,23 +1344,396 @@ void ofsm_queue_group_event(uint8_t groupIndex, bool forceNewEvent, uint8_t even
 #else
         _ofsm_debug_printf(1,  "O: Invalid Group Index %i!!! Dropped eventCode %i. \n", groupIndex, eventCode);
 #endif
-        return;
+        return OFSM_QUEUE_STATUS_DROPPED;
     }
 #endif
-    _ofsm_queue_group_event(groupIndex, _ofsmGroups[groupIndex], forceNewEvent, eventCode, eventData);
+    _OFSM_SIMULATION_TRACE_QUEUE(status, (forceNewEvent ? _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT : 0), groupIndex, eventCode, eventData, 0,
+        _ofsm_queue_group_event(groupIndex, _ofsmGroups[groupIndex], forceNewEvent, eventCode, eventData));
+    return status;
 }/*ofsm_queue_group_event*/
 
-void ofsm_queue_global_event(bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
-    uint8_t i;
+#ifdef OFSM_CONFIG_SUPPORT_TOPICS
+OFSMQueueStatus _ofsm_publish(OFSMTopic *topic, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
+    _OFSM_INDEX_DATA_TYPE i;
+    OFSMQueueStatus status = OFSM_QUEUE_STATUS_QUEUED;
+    OFSMQueueStatus groupStatus;
+
+    for (i = 0; i < topic->subscriberCount; i++) {
+        groupStatus = ofsm_queue_group_event((topic->subscribers)[i], forceNewEvent, eventCode, eventData);
+        if (groupStatus > status) {
+            status = groupStatus;
+        }
+    }
+    return status;
+}/*_ofsm_publish*/
+#endif
+
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+/*single copy of the event in broadcast queue serves all groups*/
+static OFSMQueueStatus _ofsm_queue_global_event(bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
+    OFSMEventData *event;
+    OFSMQueueStatus status = OFSM_QUEUE_STATUS_DROPPED;
+    uint8_t head;
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+    _OFSM_INDEX_DATA_TYPE i;
+    _OFSM_TIME_DATA_TYPE deadlineTicks = OFSM_NO_DEADLINE;
+#endif
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_QUEUE) {
+        _ofsmFlags &= ~(_OFSM_FLAG_OFSM_IN_DEEP_SLEEP);
+        head = _ofsmBroadcastHead;
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+        /*event takes the tightest of group default deadlines*/
+        for (i = 0; i < _ofsmGroupCount; i++) {
+            if ((_ofsmGroups)[i]->eventDeadline < deadlineTicks) {
+                deadlineTicks = (_ofsmGroups)[i]->eventDeadline;
+            }
+        }
+#endif
+        event = &(_ofsmBroadcastQueue[(uint8_t)(head - 1) & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)]);
+        /*last event can be replaced as long as none of the groups took it and it is still the last event of every group*/
+        if ((!forceNewEvent || 0 == eventCode) && head != _ofsmBroadcastTail && event->eventCode == eventCode && !_ofsmBroadcastGroupEventQueued
+            && _ofsmBroadcastPending[(uint8_t)(head - 1) & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)] == _ofsmGroupCount) {
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
+            event->eventData = eventData;
+#endif
+            status = OFSM_QUEUE_STATUS_REPLACED;
+        }
+        else if ((uint8_t)(head - _ofsmBroadcastTail) < OFSM_CONFIG_BROADCAST_QUEUE_SIZE) {
+            event = &(_ofsmBroadcastQueue[head & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)]);
+            event->eventCode = eventCode;
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
+            event->eventData = eventData;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+            event->enqueueTime = _ofsmTime;
+            event->deadline = deadlineTicks;
+#endif
+            _ofsmBroadcastPending[head & (OFSM_CONFIG_BROADCAST_QUEUE_SIZE - 1)] = _ofsmGroupCount;
+            _ofsmBroadcastHead = head + 1;
+            _ofsmBroadcastGroupEventQueued = 0;
+            status = OFSM_QUEUE_STATUS_QUEUED;
+        }
+        if (status != OFSM_QUEUE_STATUS_DROPPED) {
+            _ofsmFlags |= (_OFSM_FLAG_OFSM_EVENT_QUEUED);
+        }
+    }
+#ifdef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+#   if OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE == 0
+        OFSM_CONFIG_CUSTOM_WAKEUP_FUNC();
+#   endif
+#else
+    OFSM_CONFIG_CUSTOM_WAKEUP_FUNC();
+#endif
+    if (status == OFSM_QUEUE_STATUS_DROPPED) {
+        _ofsm_debug_printf(1,  "O: Broadcast queue overflow. eventCode %i dropped.\n", eventCode);
+    }
+    return status;
+}/*_ofsm_queue_global_event*/
+#else
+/*returns the most severe status among all groups*/
+static OFSMQueueStatus _ofsm_queue_global_event(bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
+    _OFSM_INDEX_DATA_TYPE i;
     OFSMGroup *group;
+    OFSMQueueStatus status = OFSM_QUEUE_STATUS_QUEUED;
+    OFSMQueueStatus groupStatus;
 
     for (i = 0; i < _ofsmGroupCount; i++) {
         group = (_ofsmGroups)[i];
         _ofsm_debug_printf(4,  "O: Event queuing group %i...\n", i);
-        _ofsm_queue_group_event(i, group, forceNewEvent, eventCode, eventData);
+        groupStatus = _ofsm_queue_group_event(i, group, forceNewEvent, eventCode, eventData);
+        if (groupStatus > status) {
+            status = groupStatus;
+        }
     }
+    return status;
+}/*_ofsm_queue_global_event*/
+#endif /*OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE*/
+
+OFSMQueueStatus ofsm_queue_global_event(bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData) {
+    OFSMQueueStatus status;
+    _OFSM_SIMULATION_TRACE_QUEUE(status, _OFSM_SIMULATION_TRACE_FLAG_GLOBAL | (forceNewEvent ? _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT : 0), 0, eventCode, eventData, 0,
+        _ofsm_queue_global_event(forceNewEvent, eventCode, eventData));
+    return status;
 }/*ofsm_queue_global_event*/
 
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+OFSM* _ofsm_spawn_fsm(_OFSM_INDEX_DATA_TYPE groupIndex, OFSMTransition **transitionTable, uint8_t transitionTableEventCount, void *fsmPrivateDataPtr, uint8_t initialState)
+{
+    OFSMGroup *group;
+    OFSMPool *pool;
+    OFSM *fsm = NULL;
+    _OFSM_INDEX_DATA_TYPE slot;
+
+#ifdef OFSM_CONFIG_SIMULATION
+    if (groupIndex >= _ofsmGroupCount) {
+        _ofsm_debug_printf(1, "O: Invalid Group Index %i!!! Cannot spawn FSM.\n", groupIndex);
+        return NULL;
+    }
+#endif
+    group = _ofsmGroups[groupIndex];
+    pool = group->fsmPool;
+    if (!pool) {
+        _ofsm_debug_printf(1, "G(%i): Group is not FSM pool group!!! Cannot spawn FSM.\n", groupIndex);
+        return NULL;
+    }
+
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_FSM_POOL) {
+        if (pool->freeHead != pool->capacity) {
+            slot = pool->freeHead;
+            pool->freeHead = (pool->next)[slot];
+            (pool->slotState)[slot] = _OFSM_POOL_SLOT_SPAWNED;
+
+            fsm = &((pool->slots)[slot]);
+            fsm->transitionTable = transitionTable;
+            fsm->transitionTableEventCount = transitionTableEventCount;
+            fsm->fsmPrivateInfo = fsmPrivateDataPtr;
+            fsm->flags = _OFSM_FLAG_INFINITE_SLEEP;
+            fsm->wakeupTime = 0;
+            fsm->currentState = initialState;
+            fsm->skipNextEventCode = (uint8_t)-1;
+#   ifdef OFSM_CONFIG_SUPPORT_INITIALIZATION_HANDLER
+            fsm->initHandler = NULL;
+#   endif
+#   ifdef OFSM_CONFIG_SIMULATION
+            fsm->simulationInitialState = initialState;
+#   endif
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            fsm->wakeupSlack = 0;
+#   endif
+            /*append to the group*/
+            (pool->position)[slot] = group->groupSize;
+            (group->fsms)[group->groupSize] = fsm;
+            group->groupSize++;
+        }
+    }
+    _ofsm_debug_printf(3, "G(%i): %s FSM.\n", groupIndex, fsm ? "Spawned" : "Pool is exhausted, cannot spawn");
+    return fsm;
+}/*_ofsm_spawn_fsm*/
+
+/*FSM that is destroyed while main loop is processing events may still handle current event;
+it is removed from the group before the group processes next event*/
+void ofsm_destroy_fsm(_OFSM_INDEX_DATA_TYPE groupIndex, OFSM *fsm)
+{
+    OFSMGroup *group;
+    OFSMPool *pool;
+    _OFSM_INDEX_DATA_TYPE slot;
+
+#ifdef OFSM_CONFIG_SIMULATION
+    if (groupIndex >= _ofsmGroupCount) {
+        _ofsm_debug_printf(1, "O: Invalid Group Index %i!!! Cannot destroy FSM.\n", groupIndex);
+        return;
+    }
+#endif
+    group = _ofsmGroups[groupIndex];
+    pool = group->fsmPool;
+    if (!pool || fsm < pool->slots || fsm >= pool->slots + pool->capacity) {
+        _ofsm_debug_printf(1, "G(%i): FSM is not from the group FSM pool!!! Cannot destroy FSM.\n", groupIndex);
+        return;
+    }
+    slot = (_OFSM_INDEX_DATA_TYPE)(fsm - pool->slots);
+
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_FSM_POOL) {
+        if ((pool->slotState)[slot] == _OFSM_POOL_SLOT_SPAWNED) {
+            (pool->slotState)[slot] = _OFSM_POOL_SLOT_DESTROY_PENDING;
+            (pool->next)[slot] = pool->pendingHead;
+            pool->pendingHead = slot;
+            if (_ofsmFlags & _OFSM_FLAG_OFSM_IN_PROCESS) {
+                _ofsmFlags |= _OFSM_FLAG_OFSM_EVENT_QUEUED; /*re-process groups, so that FSM is released and wakeup time is re-evaluated*/
+            }
+            else {
+                _ofsm_fsm_pool_release_destroyed(group);
+            }
+        }
+    }
+    _ofsm_debug_printf(3, "G(%i): Destroyed FSM.\n", groupIndex);
+}/*ofsm_destroy_fsm*/
+#endif /*OFSM_CONFIG_SUPPORT_FSM_POOL*/
+
+#ifdef OFSM_CONFIG_SUPPORT_SNAPSHOT
+/*the same walk over OFSM state both writes snapshot and restores it, so that the two never get out of sync*/
+struct _OFSMSnapshotCursor {
+    uint8_t*    buffer;
+    size_t      bufferSize;
+    size_t      position;
+    bool        isRestore;
+    bool        isFailed;
+};
+
+static inline void _ofsm_snapshot_bytes(_OFSMSnapshotCursor *c, void *data, size_t size)
+{
+    /*when buffer is too small, snapshot size is still counted*/
+    if (c->position + size <= c->bufferSize) {
+        if (c->isRestore) {
+            memcpy(data, c->buffer + c->position, size);
+        }
+        else {
+            memcpy(c->buffer + c->position, data, size);
+        }
+    }
+    c->position += size;
+}/*_ofsm_snapshot_bytes*/
+
+#define _OFSM_SNAPSHOT_FIELD(c, field) _ofsm_snapshot_bytes(c, (void*)&(field), sizeof(field))
+#define _OFSM_SNAPSHOT_ARRAY(c, array, count) _ofsm_snapshot_bytes(c, (void*)(array), (count) * sizeof(*(array)))
+
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+/*make ring buffer of restored size; its content is restored by caller*/
+static bool _ofsm_snapshot_resize_event_queue(OFSMGroup *group, _OFSM_INDEX_DATA_TYPE size)
+{
+    OFSMEventData *eventQueue = group->eventQueueInitial;
+    if (size == group->eventQueueSize) {
+        return true;
+    }
+    if (size != group->eventQueueInitialSize) {
+        eventQueue = new (std::nothrow) OFSMEventData[size];
+        if (!eventQueue) {
+            return false;
+        }
+    }
+    if (group->eventQueue != group->eventQueueInitial) {
+        delete[] group->eventQueue;
+    }
+    group->eventQueue = eventQueue;
+    group->eventQueueSize = size;
+    return true;
+}/*_ofsm_snapshot_resize_event_queue*/
+#endif
+
+/*must be called from within atomic block*/
+static void _ofsm_snapshot_walk(_OFSMSnapshotCursor *c)
+{
+    _OFSM_INDEX_DATA_TYPE i, k;
+    OFSMGroup *group;
+
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmFlags);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmWakeupTime);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmTime);
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmSleepStatistics);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmBroadcastQueue);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmBroadcastPending);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmBroadcastHead);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmBroadcastTail);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmBroadcastGroupEventQueued);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmIsrStaging);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmIsrStagingHead);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmIsrStagingTail);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmIsrStagingDropCount);
+#endif
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmSimulationEnergyChargeUC);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmSimulationEnergyElapsedUs);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmSimulationEnergyAwakeTicks);
+#endif
+#if defined(OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK) && defined(OFSM_CONFIG_SIMULATION)
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmSimulationSavedWakeupCount);
+    _OFSM_SNAPSHOT_FIELD(c, _ofsmSimulationPendingSavedWakeups);
+#endif
+
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        _OFSM_SNAPSHOT_FIELD(c, group->flags);
+        _OFSM_SNAPSHOT_FIELD(c, group->nextEventIndex);
+        _OFSM_SNAPSHOT_FIELD(c, group->currentEventIndex);
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+        _OFSM_SNAPSHOT_FIELD(c, group->deadlineMissCount);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+        _OFSM_SNAPSHOT_FIELD(c, group->broadcastCursor);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+        if (group->eventQueue) {
+            _OFSM_INDEX_DATA_TYPE eventQueueSize = group->eventQueueSize;
+            _OFSM_SNAPSHOT_FIELD(c, eventQueueSize);
+            if (c->isRestore && !_ofsm_snapshot_resize_event_queue(group, eventQueueSize)) {
+                c->isFailed = true;
+                return;
+            }
+        }
+#endif
+        if (group->eventQueue) {
+            _OFSM_SNAPSHOT_ARRAY(c, group->eventQueue, group->eventQueueSize);
+        }
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+        if (group->eventPool) {
+            /*pool shared by several groups is walked with each of them*/
+            _OFSM_SNAPSHOT_FIELD(c, group->eventHead);
+            _OFSM_SNAPSHOT_FIELD(c, group->eventTail);
+            _OFSM_SNAPSHOT_FIELD(c, group->eventCount);
+            _OFSM_SNAPSHOT_ARRAY(c, group->eventPool->events, group->eventPool->size);
+            _OFSM_SNAPSHOT_ARRAY(c, group->eventPool->next, group->eventPool->size);
+            _OFSM_SNAPSHOT_FIELD(c, group->eventPool->freeHead);
+            _OFSM_SNAPSHOT_FIELD(c, group->eventPool->freeCount);
+            _OFSM_SNAPSHOT_FIELD(c, group->eventPool->reservedFree);
+        }
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+        if (group->fsmArray) {
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmArray->flags, group->groupSize);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmArray->wakeupTime, group->groupSize);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmArray->currentState, group->groupSize);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmArray->skipNextEventCode, group->groupSize);
+#   ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmArray->wakeupSlack, group->groupSize);
+#   endif
+            continue;
+        }
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+        if (group->fsmPool) {
+            /*whole capacity, so that snapshot size doesn't depend on number of spawned FSMs; slots keep transition table and private data they were spawned with*/
+            _OFSM_SNAPSHOT_FIELD(c, group->groupSize);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsms, group->fsmPool->capacity);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmPool->slots, group->fsmPool->capacity);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmPool->slotState, group->fsmPool->capacity);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmPool->position, group->fsmPool->capacity);
+            _OFSM_SNAPSHOT_ARRAY(c, group->fsmPool->next, group->fsmPool->capacity);
+            _OFSM_SNAPSHOT_FIELD(c, group->fsmPool->freeHead);
+            _OFSM_SNAPSHOT_FIELD(c, group->fsmPool->pendingHead);
+            continue;
+        }
+#endif
+        for (k = 0; k < group->groupSize; k++) {
+            _ofsm_snapshot_bytes(c, (void*)(group->fsms)[k], sizeof(OFSM));
+        }
+    }
+}/*_ofsm_snapshot_walk*/
+
+size_t ofsm_snapshot(void *buffer, size_t bufferSize)
+{
+    _OFSMSnapshotCursor c = { (uint8_t*)buffer, (buffer ? bufferSize : 0), sizeof(size_t), false, false };
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_SNAPSHOT) {
+        _ofsm_snapshot_walk(&c);
+    }
+    /*snapshot starts with its size*/
+    if (c.position <= c.bufferSize) {
+        memcpy(buffer, &c.position, sizeof(size_t));
+    }
+    return c.position;
+}/*ofsm_snapshot*/
+
+bool ofsm_restore(const void *snapshot, size_t snapshotSize)
+{
+    _OFSMSnapshotCursor c = { (uint8_t*)snapshot, snapshotSize, sizeof(size_t), true, false };
+    size_t size = 0;
+    if (snapshotSize >= sizeof(size_t)) {
+        memcpy(&size, snapshot, sizeof(size_t));
+    }
+    if (size != snapshotSize) {
+        return false;
+    }
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_SNAPSHOT) {
+        _ofsm_snapshot_walk(&c);
+    }
+    _ofsm_debug_printf(3, "G: %s snapshot.\n", (c.isFailed || c.position != snapshotSize) ? "Failed to restore" : "Restored");
+    return !c.isFailed && c.position == snapshotSize;
+}/*ofsm_restore*/
+#endif /*OFSM_CONFIG_SUPPORT_SNAPSHOT*/
+
 static inline void _ofsm_check_timeout()
 {
     /*not need as it is called from within atomic block	OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) { */
@@ -454,7 +1741,14 @@ static inline void _ofsm_check_timeout()
     if (_ofsmFlags & (_OFSM_FLAG_OFSM_IN_PROCESS | _OFSM_FLAG_INFINITE_SLEEP)) {
         return;
     }
-    if (_OFSM_TIME_A_GTE_B(_ofsmTime, (_ofsmFlags & _OFSM_FLAG_OFSM_TIMER_OVERFLOW), _ofsmWakeupTime, (_ofsmFlags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW))) {
+    if (_OFSM_TIME_A_GTE_B(_ofsmTime, _ofsmWakeupTime)) {
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+        _ofsmSleepStatistics.timeoutWakeupCount++;
+#endif
+#if defined(OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK) && defined(OFSM_CONFIG_SIMULATION)
+        _ofsmSimulationSavedWakeupCount += _ofsmSimulationPendingSavedWakeups;
+        _ofsmSimulationPendingSavedWakeups = 0;
+#endif
         ofsm_queue_global_event(false, 0, 0); /*this call will wakeup main loop*/
 
 #if OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE == 1 /*in this mode ofsm_queue_... will not wakeup*/
@@ -465,17 +1759,137 @@ static inline void _ofsm_check_timeout()
 
 static inline void ofsm_heartbeat(_OFSM_TIME_DATA_TYPE currentTime)
 {
-    _OFSM_TIME_DATA_TYPE prevTime;
-    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
-		prevTime = _ofsmTime;
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_HEARTBEAT) {
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+        _ofsm_simulation_trace_write('H', &currentTime, sizeof(currentTime));
+        _ofsmSimulationTraceSuspended++; /*timeout event is queued again by replayed heartbeat*/
+#endif
         _ofsmTime = currentTime;
-        if (_ofsmTime < prevTime) {
-            _ofsmFlags |= _OFSM_FLAG_OFSM_TIMER_OVERFLOW;
-        }
         _ofsm_check_timeout();
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+        _ofsmSimulationTraceSuspended--;
+#endif
     }
 }/*ofsm_heartbeat*/
 
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+/*single producer side of ISR staging ring. ISR runs with interrupts disabled, so it needs no lock;
+event is only copied into the ring, it gets coalesced and queued by main loop (see _ofsm_isr_staging_drain()).*/
+static inline OFSMQueueStatus _ofsm_isr_stage_event(_OFSM_INDEX_DATA_TYPE groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData)
+{
+    uint8_t head = _ofsmIsrStagingHead;
+    OFSMStagedEvent *e;
+    if ((uint8_t)(head - _ofsmIsrStagingTail) >= OFSM_CONFIG_ISR_STAGING_SIZE) {
+        if (_ofsmIsrStagingDropCount != (uint8_t)-1) {
+            _ofsmIsrStagingDropCount++; /*saturates*/
+        }
+        return OFSM_QUEUE_STATUS_DROPPED;
+    }
+    e = &(_ofsmIsrStaging[head & (OFSM_CONFIG_ISR_STAGING_SIZE - 1)]);
+    e->groupIndex = groupIndex;
+    e->eventCode = eventCode;
+    e->forceNewEvent = forceNewEvent;
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DATA
+    e->eventData = eventData;
+#endif
+    _ofsmIsrStagingHead = head + 1; /*publish event only after it was written*/
+    /*interrupt deep sleep and let main loop know that it has work to do*/
+    _ofsmFlags = (_ofsmFlags & ~(_OFSM_FLAG_OFSM_IN_DEEP_SLEEP)) | _OFSM_FLAG_OFSM_EVENT_QUEUED;
+    return OFSM_QUEUE_STATUS_QUEUED;
+}/*_ofsm_isr_stage_event*/
+
+static inline OFSMQueueStatus ofsm_isr_queue_group_event(_OFSM_INDEX_DATA_TYPE groupIndex, bool forceNewEvent, uint8_t eventCode, OFSM_CONFIG_EVENT_DATA_TYPE eventData)
+{
+#ifdef OFSM_CONFIG_SIMULATION
+    /*simulated interrupts are threads; serialize them as MCU would*/
+    OFSMQueueStatus status = OFSM_QUEUE_STATUS_DROPPED;
+    _OFSM_ATOMIC_BLOCK(OFSM_CRITICAL_SECTION_QUEUE) {
+#   ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+        _ofsm_simulation_trace_event(_OFSM_SIMULATION_TRACE_FLAG_ISR | (forceNewEvent ? _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT : 0), groupIndex, eventCode, eventData, 0);
+#   endif
+        status = _ofsm_isr_stage_event(groupIndex, forceNewEvent, eventCode, eventData);
+    }
+#   ifdef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+#       if OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE == 0
+    OFSM_CONFIG_CUSTOM_WAKEUP_FUNC();
+#       endif
+#   else
+    OFSM_CONFIG_CUSTOM_WAKEUP_FUNC();
+#   endif
+    return status;
+#else
+    return _ofsm_isr_stage_event(groupIndex, forceNewEvent, eventCode, eventData);
+#endif
+}/*ofsm_isr_queue_group_event*/
+#endif
+
+/*--------------------------------------
+Sleep planner: splits sleep period into watchdog timer steps and calculates Arduino timer0 compensation.
+It is shared by MCU sleep code and by simulation sleep model.
+----------------------------------------*/
+
+#define _OFSM_MIN_DEEP_SLEEP_US 16000L /*shortest watchdog period*/
+
+/*chip specific MAX watchdog sleep period (simulation models ATmega328P)*/
+#if !defined(WDP3) && !defined(OFSM_CONFIG_SIMULATION)
+#	define _OFSM_MAX_SLEEP_MASK  0B111 /*2 sec*/
+#else
+#   define _OFSM_MAX_SLEEP_MASK 0B1001 /*8 sec*/
+#endif
+
+#ifndef MICROSECONDS_PER_TIMER0_OVERFLOW
+	/* In Arduino environment the prescaler is set so that timer0 ticks every 64 clock cycles, and the
+	 the overflow handler is called every 256 ticks. */
+#	ifdef OFSM_CONFIG_SIMULATION
+#		define MICROSECONDS_PER_TIMER0_OVERFLOW ((64L * 256L) / (OFSM_CONFIG_SIMULATION_F_CPU / 1000000L))
+#	else
+#		define MICROSECONDS_PER_TIMER0_OVERFLOW (clockCyclesToMicroseconds(64 * 256))
+#	endif
+    /* the fractional number of milliseconds per timer0 overflow. we shift right
+    * by three to fit these numbers into a byte. (for the clock speeds we care
+    * about - 8 and 16 MHz - this doesn't lose precision.) */
+#   define FRACT_INC ((MICROSECONDS_PER_TIMER0_OVERFLOW % 1000) >> 3)
+#   define FRACT_MAX (1000 >> 3)
+    /* the whole number of milliseconds per timer0 overflow*/
+#   define MILLIS_INC (MICROSECONDS_PER_TIMER0_OVERFLOW / 1000)
+#endif
+
+/*deep sleep is used for the next step only if all FSMs allowed it and the rest of the sleep period fits at least the shortest watchdog period*/
+#define _ofsm_plan_is_deep_sleep_step(allowDeepSleep, sleepPeriodUs) ((allowDeepSleep) && (sleepPeriodUs) >= _OFSM_MIN_DEEP_SLEEP_US)
+
+/*selects the longest watchdog period that fits into sleep period (which must be >= _OFSM_MIN_DEEP_SLEEP_US).
+Returns period of the step in microseconds; outPrescaler receives watchdog prescaler index (0 - 16ms ... _OFSM_MAX_SLEEP_MASK)*/
+static inline unsigned long _ofsm_plan_deep_sleep_step(unsigned long sleepPeriodUs, uint8_t *outPrescaler)
+{
+    uint8_t prescaler;
+    unsigned long probe = _OFSM_MIN_DEEP_SLEEP_US;
+
+    if(sleepPeriodUs >= (_OFSM_MIN_DEEP_SLEEP_US << _OFSM_MAX_SLEEP_MASK)) {
+        *outPrescaler = _OFSM_MAX_SLEEP_MASK;
+        return _OFSM_MIN_DEEP_SLEEP_US << _OFSM_MAX_SLEEP_MASK;
+    }
+    for (prescaler = 0; probe <= (sleepPeriodUs - (_OFSM_MIN_DEEP_SLEEP_US << prescaler)); prescaler++) {
+        probe = probe << 1;
+    }
+    *outPrescaler = prescaler;
+    return probe;
+}/*_ofsm_plan_deep_sleep_step*/
+
+/*timer0 doesn't run in deep sleep; calculates number of timer0 overflows and milliseconds
+to be added to Arduino time-keeping variables after uninterrupted watchdog step of delayUs*/
+static inline void _ofsm_plan_timer0_compensation(unsigned long delayUs, unsigned long *outOverflowCount, unsigned long *outMillis)
+{
+    unsigned long overflowCount = delayUs / MICROSECONDS_PER_TIMER0_OVERFLOW;
+    *outOverflowCount = overflowCount;
+    *outMillis = overflowCount * MILLIS_INC + (unsigned long)(overflowCount/FRACT_MAX);
+}/*_ofsm_plan_timer0_compensation*/
+
+/*rest of the sleep period after elapsedUs of sleepPeriodUs has passed; sleep is over when it returns 0*/
+static inline unsigned long _ofsm_plan_time_left_us(unsigned long elapsedUs, unsigned long sleepPeriodUs)
+{
+    return elapsedUs >= sleepPeriodUs ? 0 : sleepPeriodUs - elapsedUs;
+}/*_ofsm_plan_time_left_us*/
+
 /*--------------------------------------
 SIMULATION specific code
 ----------------------------------------*/
@@ -483,53 +1897,112 @@ SIMULATION specific code
 #ifdef OFSM_CONFIG_SIMULATION
 
 struct OFSMSimulationStatusReport {
-    uint8_t grpIndex;
-    uint8_t fsmIndex;
+    _OFSM_INDEX_DATA_TYPE grpIndex;
+    _OFSM_INDEX_DATA_TYPE fsmIndex;
     _OFSM_TIME_DATA_TYPE ofsmTime;
     //OFSM status
     bool ofsmInfiniteSleep;
 	bool ofsmDeepSleepMode;
-    bool ofsmTimerOverflow;
-    bool ofsmScheduledTimeOverflow;
     _OFSM_TIME_DATA_TYPE ofsmScheduledWakeupTime;
     //Group status
     bool grpEventBufferOverflow;
-    uint8_t grpPendingEventCount;
+    int grpPendingEventCount;
     //FSM status
     bool fsmInfiniteSleep;
     bool fsmTransitionPrevented;
     bool fsmTransitionStateOverriden;
-    bool fsmScheduledTimeOverflow;
     _OFSM_TIME_DATA_TYPE fsmScheduledWakeupTime;
     uint8_t fsmCurrentState;
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    OFSMSleepStatistics sleepStatistics;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    unsigned long savedWakeupCount;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+    uint8_t isrStagedEventCount;
+    uint8_t isrStagingDropCount;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+    OFSMCriticalSectionStatistics criticalSectionStatistics[OFSM_CRITICAL_SECTION_COUNT];
+#endif
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+    double energyMAh;               /*estimated consumption since reset*/
+    double energyMAhPerHour;        /*estimated consumption per simulated hour (average current in mA)*/
+#endif
+    //Heartbeat provider status (threaded mode)
+    unsigned long heartbeatLagUs;
+    unsigned long heartbeatMaxLagUs;
+    unsigned long heartbeatCatchUpTicks;
+    const char *assertLineTag;      /*tag of report line to be compared by assert (e.g. "SL" for -SL[...] line); "O" - status line*/
 };
 
-std::mutex cvm;
-std::condition_variable cv;
+#ifdef OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+#   define _ofsmSimulationSleepCvm (_ofsmOrchestrator->simulationSleepMutex)
+#   define _ofsmSimulationSleepCv  (_ofsmOrchestrator->simulationSleepCv)
+#else
+std::mutex _ofsmSimulationSleepCvm;
+std::condition_variable _ofsmSimulationSleepCv;
+#endif
+
+volatile unsigned long _ofsmSimulationHeartbeatLagUs;        /*how late (in microseconds) last heartbeat was delivered relative to monotonic clock*/
+volatile unsigned long _ofsmSimulationHeartbeatMaxLagUs;
+volatile unsigned long _ofsmSimulationHeartbeatCatchUpTicks;  /*total number of ticks that were caught up by late heartbeats*/
 
-static inline std::string &ltrim(std::string &s) {
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), std::not1(std::ptr_fun<int, int>(std::isspace))));
-    return s;
+/*must be called from within atomic block*/
+static inline void _ofsm_simulation_heartbeat_record_lag(long long lagUs, _OFSM_TIME_DATA_TYPE catchUpTicks) {
+    _ofsmSimulationHeartbeatLagUs = (unsigned long)(lagUs < 0 ? 0 : lagUs);
+    if (_ofsmSimulationHeartbeatLagUs > _ofsmSimulationHeartbeatMaxLagUs) {
+        _ofsmSimulationHeartbeatMaxLagUs = _ofsmSimulationHeartbeatLagUs;
+    }
+    _ofsmSimulationHeartbeatCatchUpTicks += (unsigned long)catchUpTicks;
 }
 
-static inline std::string &rtrim(std::string &s) {
-    s.erase(std::find_if(s.rbegin(), s.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
+/*trims string in place; returns pointer to first non-space character*/
+static inline char *_ofsm_simulation_trim(char *s) {
+    char *end;
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = 0;
     return s;
 }
 
-static inline std::string &trim(std::string &s) {
-    return ltrim(rtrim(s));
+/*must be called from within atomic block*/
+void _ofsm_simulation_set_assert_compare_string(const char *str) {
+    size_t len;
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+    len = strlen(str);
+    while (len > 0 && isspace((unsigned char)str[len - 1])) {
+        len--;
+    }
+    if (len > sizeof(_ofsm_simulation_assert_compare_string) - 1) {
+        len = sizeof(_ofsm_simulation_assert_compare_string) - 1;
+    }
+    memcpy((char*)_ofsm_simulation_assert_compare_string, str, len);
+    _ofsm_simulation_assert_compare_string[len] = 0;
 }
 
-static inline std::string &toLower(std::string &s) {
-    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-    return s;
+#ifdef _OFSM_IMPL_SIMULATION_STATUS_REPORT_PRINTER
+/*prints report line "-<tag>[...]"; line becomes assert compare string when its tag is the requested one*/
+static void _ofsm_simulation_status_report_print_line(OFSMSimulationStatusReport *r, const char *line) {
+    size_t tagLength = strlen(r->assertLineTag);
+    if ('-' == line[0] && 0 == strncmp(line + 1, r->assertLineTag, tagLength) && '[' == line[1 + tagLength]) {
+        ofsm_simulation_set_assert_compare_string(line);
+    }
+    std::cout << line << std::endl;
 }
 
-#ifdef _OFSM_IMPL_SIMULATION_STATUS_REPORT_PRINTER
 void _ofsm_simulation_status_report_printer(OFSMSimulationStatusReport *r) {
-    char buf[80];
-    _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-O[%c%c]-G(%i)[%c,%03d]-F(%i)[%c%c%c]-S(%i)-TW[%010lu%c,O:%010lu%c,F:%010lu%c]"
+    char buf[160];
+    /*'.' after each time used to be time overflow marker; it is kept, so that existing test scripts remain valid*/
+    _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-O[%c%c]-G(%i)[%c,%03d]-F(%i)[%c%c%c]-S(%i)-TW[%010lu.,O:%010lu.,F:%010lu.]"
         //OFSM (-O)
         , (r->ofsmInfiniteSleep ? 'I' : 'i')
 		, (r->ofsmDeepSleepMode ? 'D' : 'd')
@@ -546,82 +2019,167 @@ void _ofsm_simulation_status_report_printer(OFSMSimulationStatusReport *r) {
         , r->fsmCurrentState
         //CurrentTime, Wakeup time (-TW)
         , (long unsigned int)r->ofsmTime
-        , (r->ofsmTimerOverflow ? '!' : '.')
         , (long unsigned int)r->ofsmScheduledWakeupTime
-        , (r->ofsmScheduledTimeOverflow ? '!' : '.')
         , (long unsigned int)r->fsmScheduledWakeupTime
-        , (r->fsmScheduledTimeOverflow ? '!' : '.')
         );
-    ofsm_simulation_set_assert_compare_string(buf);
-    std::cout << buf << std::endl;
+    _ofsm_simulation_status_report_print_line(r, buf);
+#ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+    _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-HB[L:%luus,M:%luus,C:%lu]", r->heartbeatLagUs, r->heartbeatMaxLagUs, r->heartbeatCatchUpTicks);
+    _ofsm_simulation_status_report_print_line(r, buf);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    /*ticks: A - awake, I - idle sleep, D - deep sleep; wakeups: T - timeout, E - event, W - watchdog; X - interrupted deep sleeps*/
+    _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-SL[A:%lu,I:%lu,D:%lu,T:%lu,E:%lu,W:%lu,X:%lu]"
+        , (long unsigned int)r->sleepStatistics.awakeTicks
+        , (long unsigned int)r->sleepStatistics.idleSleepTicks
+        , (long unsigned int)r->sleepStatistics.deepSleepTicks
+        , r->sleepStatistics.timeoutWakeupCount
+        , r->sleepStatistics.eventWakeupCount
+        , r->sleepStatistics.watchdogWakeupCount
+        , r->sleepStatistics.interruptedDeepSleepCount);
+    _ofsm_simulation_status_report_print_line(r, buf);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-CW[S:%lu]", r->savedWakeupCount); /*wakeups saved by coalescing*/
+    _ofsm_simulation_status_report_print_line(r, buf);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+    _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-IS[S:%u,D:%u]", (unsigned int)r->isrStagedEventCount, (unsigned int)r->isrStagingDropCount); /*staged events, dropped events*/
+    _ofsm_simulation_status_report_print_line(r, buf);
+#endif
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+    _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-EN[Q:%.6fmAh,R:%.6fmAh/h]", r->energyMAh, r->energyMAhPerHour);
+    _ofsm_simulation_status_report_print_line(r, buf);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+    /*sites (see OFSMCriticalSection): Q - queue, D - dequeue, L - main loop, H - heartbeat, T - get time, P - debug print, S - sleep statistics, F - FSM pool, N - snapshot;
+    <site>:<max. hold us>/<count>(<histogram>); sites that were never entered are skipped*/
+    const char *sites = "QDLHTPSFN";
+    const char *separator = "";
+    std::string line = "-CS[";
+    int k;
+    for (int i = 0; i < OFSM_CRITICAL_SECTION_COUNT; i++) {
+        if (r->criticalSectionStatistics[i].count) {
+            _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "%s%c:%lu/%lu(", separator, sites[i], r->criticalSectionStatistics[i].maxHoldUs, r->criticalSectionStatistics[i].count);
+            line += buf;
+            for (k = 0; k < OFSM_CONFIG_CRITICAL_SECTION_HISTOGRAM_SIZE; k++) {
+                _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), k ? ".%u" : "%u", (unsigned int)r->criticalSectionStatistics[i].histogram[k]);
+                line += buf;
+            }
+            line += ")";
+            separator = ",";
+        }
+    }
+    line += "]";
+    _ofsm_simulation_status_report_print_line(r, line.c_str());
+#endif
 }
 #endif
 
-void _ofsm_simulation_create_status_report(OFSMSimulationStatusReport *r, uint8_t groupIndex, uint8_t fsmIndex) {
+void _ofsm_simulation_create_status_report(OFSMSimulationStatusReport *r, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_INDEX_DATA_TYPE fsmIndex) {
     OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
         r->grpIndex = groupIndex;
         r->fsmIndex = fsmIndex;
+        r->assertLineTag = "O";
         r->ofsmTime = _ofsmTime;
         //OFSM
         r->ofsmInfiniteSleep = (bool)((_ofsmFlags & _OFSM_FLAG_INFINITE_SLEEP) > 0);
 		r->ofsmDeepSleepMode = (bool)((_ofsmFlags & _OFSM_FLAG_ALLOW_DEEP_SLEEP) > 0);
-        r->ofsmTimerOverflow = (bool)((_ofsmFlags & _OFSM_FLAG_OFSM_TIMER_OVERFLOW) > 0);
-        r->ofsmScheduledTimeOverflow = (bool)((_ofsmFlags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW) > 0);
         r->ofsmScheduledWakeupTime = _ofsmWakeupTime;
         if (r->ofsmInfiniteSleep) {
             r->ofsmScheduledWakeupTime = 0;
-            r->ofsmScheduledTimeOverflow = 0;
         }
         //Group
         OFSMGroup *grp = (_ofsmGroups[groupIndex]);
         r->grpEventBufferOverflow = (bool)((grp->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW) > 0);
-        if (r->grpEventBufferOverflow) {
-            if (grp->currentEventIndex == grp->nextEventIndex) {
-                r->grpPendingEventCount = grp->eventQueueSize;
-            }
-            else {
-                r->grpPendingEventCount = grp->eventQueueSize - (grp->currentEventIndex - grp->nextEventIndex);
-            }
-        }
-        else {
-            if (grp->nextEventIndex < grp->currentEventIndex) {
-                r->grpPendingEventCount = grp->eventQueueSize - (grp->currentEventIndex - grp->nextEventIndex);
-            }
-            else {
-                r->grpPendingEventCount = grp->nextEventIndex - grp->currentEventIndex;
-            }
-        }
+        r->grpPendingEventCount = _ofsm_group_pending_event_count(grp);
         //FSM
-        OFSM *fsm = (grp->fsms)[fsmIndex];
-        r->fsmInfiniteSleep = (bool)((fsm->flags & _OFSM_FLAG_INFINITE_SLEEP) > 0);
-        r->fsmTransitionPrevented = (bool)((fsm->flags & _OFSM_FLAG_FSM_PREVENT_TRANSITION) > 0);
-        r->fsmTransitionStateOverriden = (bool)((fsm->flags & _OFSM_FLAG_FSM_NEXT_STATE_OVERRIDE) > 0);
-        r->fsmScheduledTimeOverflow = (bool)((fsm->flags & _OFSM_FLAG_SCHEDULED_TIME_OVERFLOW) > 0);
-        r->fsmScheduledWakeupTime = fsm->wakeupTime;
-        r->fsmCurrentState = fsm->currentState;
+        uint8_t fsmFlags = _OFSM_GROUP_FSM_FLAGS(grp, fsmIndex);
+        r->fsmInfiniteSleep = (bool)((fsmFlags & _OFSM_FLAG_INFINITE_SLEEP) > 0);
+        r->fsmTransitionPrevented = (bool)((fsmFlags & _OFSM_FLAG_FSM_PREVENT_TRANSITION) > 0);
+        r->fsmTransitionStateOverriden = (bool)((fsmFlags & _OFSM_FLAG_FSM_NEXT_STATE_OVERRIDE) > 0);
+        r->fsmScheduledWakeupTime = _OFSM_GROUP_FSM_WAKEUP_TIME(grp, fsmIndex);
+        r->fsmCurrentState = _OFSM_GROUP_FSM_CURRENT_STATE(grp, fsmIndex);
         if (r->fsmInfiniteSleep) {
             r->fsmScheduledWakeupTime = 0;
-            r->fsmScheduledTimeOverflow = 0;
         }
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+        ofsm_query_sleep_statistics(r->sleepStatistics);
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+        r->savedWakeupCount = _ofsmSimulationSavedWakeupCount;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+        r->isrStagedEventCount = (uint8_t)(_ofsmIsrStagingHead - _ofsmIsrStagingTail);
+        r->isrStagingDropCount = ofsm_query_isr_staging_drop_count();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+        memcpy(r->criticalSectionStatistics, _ofsmCriticalSectionStatistics, sizeof(r->criticalSectionStatistics));
+#endif
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+        r->energyMAh = _ofsmSimulationEnergyChargeUC / 3600000.0; /*1 mAh = 3.6 C*/
+        r->energyMAhPerHour = _ofsmSimulationEnergyElapsedUs ? _ofsmSimulationEnergyChargeUC / _ofsmSimulationEnergyElapsedUs * 1000.0 : 0;
+#endif
+        //Heartbeat
+        r->heartbeatLagUs = _ofsmSimulationHeartbeatLagUs;
+        r->heartbeatMaxLagUs = _ofsmSimulationHeartbeatMaxLagUs;
+        r->heartbeatCatchUpTicks = _ofsmSimulationHeartbeatCatchUpTicks;
+    }
+}
+
+#ifdef OFSM_CONFIG_SIMULATION_TICKLESS
+std::mutex _ofsmSimulationHeartbeatCvm;
+std::condition_variable _ofsmSimulationHeartbeatCv;
+unsigned long _ofsmSimulationHeartbeatRearmCount;
+std::chrono::steady_clock::time_point _ofsmSimulationTicklessOrigin;
+_OFSM_TIME_DATA_TYPE _ofsmSimulationTicklessOffset; /*accounts for time set by 'h[eartbeat]' command*/
+
+/*wake tickless heartbeat provider, so that it re-reads wakeup time*/
+void _ofsm_simulation_heartbeat_rearm() {
+    std::unique_lock<std::mutex> lk(_ofsmSimulationHeartbeatCvm);
+    _ofsmSimulationHeartbeatRearmCount++;
+    _ofsmSimulationHeartbeatCv.notify_one();
+    lk.unlock();
+}
+
+/*derive current time from monotonic clock and supply it into OFSM*/
+void _ofsm_simulation_tickless_sync_time() {
+    _OFSM_TIME_DATA_TYPE ticks = (_OFSM_TIME_DATA_TYPE)(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _ofsmSimulationTicklessOrigin).count() / OFSM_CONFIG_SIMULATION_TICK_US);
+    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+        ticks += _ofsmSimulationTicklessOffset;
+        if (_OFSM_TIME_A_GT_B(_ofsmTime, ticks)) {
+            _ofsmSimulationTicklessOffset += _ofsmTime - ticks;
+            ticks = _ofsmTime;
+        }
+        ofsm_heartbeat(ticks);
     }
 }
+#endif /* OFSM_CONFIG_SIMULATION_TICKLESS */
 
 #ifdef _OFSM_IMPL_SIMULATION_ENTER_SLEEP
 void _ofsm_simulation_enter_sleep() {
         _ofsmFlags &= ~_OFSM_FLAG_OFSM_IN_PROCESS; /*enable wakeup on timeout*/
-        std::unique_lock<std::mutex> lk(cvm);
-
-        cv.wait(lk);
-        _ofsmFlags &= ~(_OFSM_FLAG_OFSM_EVENT_QUEUED | _OFSM_FLAG_INFINITE_SLEEP);
+        std::unique_lock<std::mutex> lk(_ofsmSimulationSleepCvm);
+#ifdef OFSM_CONFIG_SIMULATION_TICKLESS
+        _ofsm_simulation_heartbeat_rearm(); /*wakeup time might have moved*/
+#endif
+        _ofsmSimulationSleepCv.wait(lk);
         lk.unlock();
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+        _ofsm_simulation_trace_wakeup();
+#endif
+        _ofsmFlags &= ~(_OFSM_FLAG_OFSM_EVENT_QUEUED | _OFSM_FLAG_INFINITE_SLEEP);
+#ifdef OFSM_CONFIG_SIMULATION_TICKLESS
+        _ofsm_simulation_tickless_sync_time(); /*events are about to be processed, make sure time is current*/
+#endif
 }
 #endif /* _OFSM_IMPL_SIMULATION_ENTER_SLEEP */
 
 #ifdef _OFSM_IMPL_SIMULATION_WAKEUP
 void _ofsm_simulation_wakeup() {
 #   ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
-    std::unique_lock<std::mutex> lk(cvm);
-    cv.notify_one();
+    std::unique_lock<std::mutex> lk(_ofsmSimulationSleepCvm);
+    _ofsmSimulationSleepCv.notify_one();
     lk.unlock();
 #   else
     //in script mode call _ofsm_start() directly; it will return
@@ -630,10 +2188,25 @@ void _ofsm_simulation_wakeup() {
 }
 #endif /* _OFSM_IMPL_SIMULATION_WAKEUP */
 
-int _ofsm_simulation_check_for_assert(std::string &assertCompareString, int lineNumber) {
-    std::string lastOut = (char*)_ofsm_simulation_assert_compare_string;
-    trim(lastOut);
-    if (assertCompareString != lastOut) {
+#ifdef OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+void ofsm_simulation_orchestrator_exit(OFSMOrchestrator *orchestrator) {
+    OFSMOrchestrator *prev = ofsm_orchestrator_select(orchestrator);
+    OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+        _ofsmFlags |= (_OFSM_FLAG_OFSM_SIMULATION_EXIT | _OFSM_FLAG_OFSM_EVENT_QUEUED);
+    }
+#   ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+    std::unique_lock<std::mutex> lk(_ofsmSimulationSleepCvm);
+    _ofsmSimulationSleepCv.notify_one();
+    lk.unlock();
+#   endif
+    ofsm_orchestrator_select(prev);
+}
+#endif
+
+/*assertCompareString is expected to be trimmed; last output is trimmed by ofsm_simulation_set_assert_compare_string()*/
+int _ofsm_simulation_check_for_assert(const char *assertCompareString, int lineNumber) {
+    const char *lastOut = (const char*)_ofsm_simulation_assert_compare_string;
+    if (0 != strcmp(assertCompareString, lastOut)) {
         std::cout << "ASSERT at line: " << lineNumber << std::endl;
         std::cout << "\tExpected: " << assertCompareString << std::endl;
         std::cout << "\tProduced: " << lastOut << std::endl;
@@ -646,6 +2219,9 @@ void setup();
 void loop();
 
 void _ofsm_simulation_fsm_thread(int ignore) {
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+    _ofsm_simulation_trace_begin();
+#endif
     setup();
     loop();
 #ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
@@ -653,32 +2229,219 @@ void _ofsm_simulation_fsm_thread(int ignore) {
 #endif
 }/*_ofsm_simulation_fsm_thread*/
 
+/*Ticks are derived from monotonic clock relative to thread start, so oversleeping doesn't accumulate.
+When heartbeat is late by more than one tick, time catches up in a single heartbeat call.*/
 void _ofsm_simulation_heartbeat_provider_thread(int tickSize) {
     _OFSM_TIME_DATA_TYPE currentTime = 0;
+    _OFSM_TIME_DATA_TYPE clockTicks = 0;
+    _OFSM_TIME_DATA_TYPE elapsedTicks;
+    std::chrono::milliseconds tick(tickSize);
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point scheduled;
+    std::chrono::steady_clock::time_point now;
+    bool doReturn = false;
+    _ofsmSimulationHeartbeatLagUs = _ofsmSimulationHeartbeatMaxLagUs = _ofsmSimulationHeartbeatCatchUpTicks = 0;
+    while (1) {
+        scheduled = origin + tick * (clockTicks + 1);
+        std::this_thread::sleep_until(scheduled);
+        now = std::chrono::steady_clock::now();
+        elapsedTicks = (_OFSM_TIME_DATA_TYPE)((now - origin) / tick) - clockTicks;
+        clockTicks += elapsedTicks;
+
+        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+            _OFSM_TIME_DATA_TYPE time;
+            ofsm_get_time(time);
+            if (_OFSM_TIME_A_GT_B(time, currentTime)) {
+                currentTime = time;
+            }
+            _ofsm_simulation_heartbeat_record_lag(std::chrono::duration_cast<std::chrono::microseconds>(now - scheduled).count(), elapsedTicks - 1);
+            if (_ofsmFlags & _OFSM_FLAG_OFSM_SIMULATION_EXIT) {
+                doReturn = true; /*don't return here, as simulation ATOMIC_BLOCK mutex will remain blocked*/
+            }
+        }
+        if (doReturn) {
+#ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+            _ofsm_debug_printf(1, "Exiting Heartbeat provider thread...\n");
+#endif
+            return;
+        }
+        currentTime += elapsedTicks;
+        ofsm_heartbeat(currentTime);
+    }
+}/*_ofsm_simulation_heartbeat_provider_thread*/
+
+#ifdef OFSM_CONFIG_SIMULATION_TICKLESS
+/*Tickless heartbeat provider: instead of waking up every tick, sleeps until scheduled wakeup time (or forever when OFSM is in infinite sleep).
+It gets re-armed by _ofsm_simulation_heartbeat_rearm() every time OFSM enters sleep.*/
+void _ofsm_simulation_tickless_heartbeat_provider_thread(long tickSizeUs) {
     bool doReturn = false;
+    bool waitForRearm;
+    unsigned long rearmCount;
+    _OFSM_TIME_DATA_TYPE clockWakeupTime = 0;
+    _ofsmSimulationTicklessOrigin = std::chrono::steady_clock::now();
+    _ofsmSimulationTicklessOffset = 0;
+    _ofsmSimulationHeartbeatLagUs = _ofsmSimulationHeartbeatMaxLagUs = _ofsmSimulationHeartbeatCatchUpTicks = 0;
     while (1) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(tickSize));
+        std::unique_lock<std::mutex> lk(_ofsmSimulationHeartbeatCvm);
+        rearmCount = _ofsmSimulationHeartbeatRearmCount;
+        lk.unlock();
+
+        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+            waitForRearm = (_ofsmFlags & (_OFSM_FLAG_INFINITE_SLEEP | _OFSM_FLAG_OFSM_IN_PROCESS)) != 0;
+            clockWakeupTime = _ofsmWakeupTime - _ofsmSimulationTicklessOffset;
+            if (_ofsmFlags & _OFSM_FLAG_OFSM_SIMULATION_EXIT) {
+                doReturn = true; /*don't return here, as simulation ATOMIC_BLOCK mutex will remain blocked*/
+            }
+        }
+        if (doReturn) {
+            _ofsm_debug_printf(1, "Exiting Heartbeat provider thread...\n");
+            return;
+        }
+
+        lk.lock();
+        if (waitForRearm) {
+            _ofsmSimulationHeartbeatCv.wait(lk, [rearmCount] { return rearmCount != _ofsmSimulationHeartbeatRearmCount; });
+            lk.unlock();
+        }
+        else {
+            std::chrono::steady_clock::time_point scheduled = _ofsmSimulationTicklessOrigin + std::chrono::microseconds(tickSizeUs) * clockWakeupTime;
+            if (!_ofsmSimulationHeartbeatCv.wait_until(lk, scheduled, [rearmCount] { return rearmCount != _ofsmSimulationHeartbeatRearmCount; })) {
+                lk.unlock();
+                OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+                    _ofsm_simulation_heartbeat_record_lag(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - scheduled).count(), 0);
+                }
+            }
+            else {
+                lk.unlock();
+            }
+        }
+        _ofsm_simulation_tickless_sync_time();
+    }
+}/*_ofsm_simulation_tickless_heartbeat_provider_thread*/
+#endif /* OFSM_CONFIG_SIMULATION_TICKLESS */
+
+#ifdef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+/*process events until all queues are empty, the same way real-time main loop does before entering sleep*/
+void _ofsm_simulation_process_pending_events() {
+    do {
+        _ofsm_start();
+    } while (_ofsmFlags & _OFSM_FLAG_OFSM_EVENT_QUEUED);
+}/*_ofsm_simulation_process_pending_events*/
+
+/*Virtual time engine: advances OFSM time by 'ticks', jumping from one scheduled wakeup time directly to the next one.
+Heartbeat is called with exact wakeup time, thus FSMs observe the same time as in real-time mode.
+Returns number of wakeups (timeouts) that have been processed.*/
+unsigned long _ofsm_simulation_run(_OFSM_TIME_DATA_TYPE ticks) {
+    _OFSM_TIME_DATA_TYPE endTime = _ofsmTime + ticks;
+    unsigned long wakeupCount = 0;
+
+    _ofsm_simulation_process_pending_events();
+    while ((_ofsmFlags & _OFSM_FLAG_INFINITE_SLEEP) == 0 && _OFSM_TIME_A_GTE_B(endTime, _ofsmWakeupTime)) {
+        /*heartbeat queues timeout (and accounts it as timeout wakeup); current time is kept, if wakeup time has been already reached*/
+        ofsm_heartbeat(_OFSM_TIME_A_GT_B(_ofsmWakeupTime, _ofsmTime) ? _ofsmWakeupTime : _ofsmTime);
+        wakeupCount++;
+        _ofsm_simulation_process_pending_events();
+    }
+    ofsm_heartbeat(endTime);
+    _ofsm_debug_printf(3, "G: Run for %lu ticks is complete. Processed %lu wakeups.\n", (long unsigned int)ticks, wakeupCount);
+    return wakeupCount;
+}/*_ofsm_simulation_run*/
+#endif /* OFSM_CONFIG_SIMULATION_SCRIPT_MODE */
+
+/*Sleep planner model: runs MCU sleep planner (see _ofsm_enter_sleep()) against simulated watchdog timer and Arduino timer0.
+Watchdog timer runs from its own oscillator with clockErrorPpm error, timer0 runs from the system clock and is stopped in deep sleep.
+Idle sleep is waked up by every timer0 overflow interrupt.*/
+struct OFSMSimulationSleepModel {
+    /*simulated Arduino time-keeping variables*/
+    unsigned long timer0OverflowCount;
+    unsigned long timer0Millis;
+    unsigned char timer0Fract;
+    unsigned long timer0Us;             /*time since last timer0 overflow*/
+    unsigned long long elapsedUs;       /*real time spent in sleep*/
+    unsigned long long idleUs;          /*part of elapsedUs spent in idle sleep*/
+    unsigned long watchdogStepCount;
+    unsigned long idleWakeupCount;
+    std::string watchdogPrescalers;     /*sleep decomposition: watchdog prescaler of every deep sleep step*/
+};
 
-        OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
-            _OFSM_TIME_DATA_TYPE time;
-            ofsm_get_time(time, time);
-            if (time > currentTime) {
-                currentTime = time;
-            }
-            if (_ofsmFlags & _OFSM_FLAG_OFSM_SIMULATION_EXIT) {
-                doReturn = true; /*don't return here, as simulation ATOMIC_BLOCK mutex will remain blocked*/
+static inline unsigned long _ofsm_simulation_sleep_model_micros(OFSMSimulationSleepModel *m) {
+    return m->timer0OverflowCount * MICROSECONDS_PER_TIMER0_OVERFLOW + m->timer0Us;
+}
+
+/*sleep for sleepPeriodUs the same way _ofsm_enter_sleep() does, when there is no event queued*/
+void _ofsm_simulation_sleep_model(OFSMSimulationSleepModel *m, unsigned long sleepPeriodUs, bool allowDeepSleep, long clockErrorPpm) {
+    /*_ofsm_sleep_timer_set()*/
+    unsigned long timerStartUs = _ofsm_simulation_sleep_model_micros(m);
+    unsigned long timerPeriodUs = sleepPeriodUs;
+    unsigned long delayUs;
+    unsigned long overflowCount;
+    unsigned long millis;
+    uint8_t prescaler;
+
+    while (sleepPeriodUs > 0) {
+        if (_ofsm_plan_is_deep_sleep_step(allowDeepSleep, sleepPeriodUs)) {
+            delayUs = _ofsm_plan_deep_sleep_step(sleepPeriodUs, &prescaler);
+            m->elapsedUs += delayUs + (long long)delayUs * clockErrorPpm / 1000000L;
+            /*watchdog interrupt handler (_ofsm_wdt_vector())*/
+            _ofsm_plan_timer0_compensation(delayUs, &overflowCount, &millis);
+            m->timer0OverflowCount += overflowCount;
+            m->timer0Millis += millis;
+            m->watchdogStepCount++;
+            if (m->watchdogPrescalers.length()) {
+                m->watchdogPrescalers += ".";
             }
+            m->watchdogPrescalers += std::to_string(prescaler);
         }
-        if (doReturn) {
-#ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
-            _ofsm_debug_printf(1, "Exiting Heartbeat provider thread...\n");
-#endif
-            return;
+        else {
+            /*idle sleep is waked up by each timer0 overflow, until the rest of the period is over;
+            account all of them at once, the same way timer0 overflow interrupt handler (Arduino wiring.c) does one by one*/
+            delayUs = MICROSECONDS_PER_TIMER0_OVERFLOW - m->timer0Us;
+            overflowCount = 1;
+            if (sleepPeriodUs > delayUs) {
+                overflowCount += (sleepPeriodUs - delayUs) / MICROSECONDS_PER_TIMER0_OVERFLOW + ((sleepPeriodUs - delayUs) % MICROSECONDS_PER_TIMER0_OVERFLOW != 0);
+            }
+            delayUs += (overflowCount - 1) * MICROSECONDS_PER_TIMER0_OVERFLOW;
+            m->elapsedUs += delayUs;
+            m->idleUs += delayUs;
+            m->timer0Us = 0;
+            m->timer0OverflowCount += overflowCount;
+            millis = m->timer0Fract + overflowCount * FRACT_INC;
+            m->timer0Millis += overflowCount * MILLIS_INC + millis / FRACT_MAX;
+            m->timer0Fract = (unsigned char)(millis % FRACT_MAX);
+            m->idleWakeupCount += overflowCount;
         }
-        currentTime++;
-        ofsm_heartbeat(currentTime);
+        /*_ofsm_sleep_timer_get_time_left_us()*/
+        sleepPeriodUs = _ofsm_plan_time_left_us(_ofsm_simulation_sleep_model_micros(m) - timerStartUs, timerPeriodUs);
     }
-}/*_ofsm_simulation_heartbeat_provider_thread*/
+}/*_ofsm_simulation_sleep_model*/
+
+#ifdef _OFSM_IMPL_SIMULATION_ENERGY_MODEL
+/*charge (microcoulombs) consumed by sleep of sleepUs, split into watchdog steps and idle sleep by sleep planner model; each step adds its wakeup cost*/
+static double _ofsm_simulation_energy_model_sleep(unsigned long sleepUs, bool deepSleep) {
+    OFSMSimulationSleepModel m = OFSMSimulationSleepModel();
+    _ofsm_simulation_sleep_model(&m, sleepUs, deepSleep, OFSM_CONFIG_SIMULATION_WDT_CLOCK_ERROR_PPM);
+    return ((double)OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_UA * m.idleUs
+        + (double)OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_UA * (m.elapsedUs - m.idleUs)) / 1000000.0
+        + ((double)OFSM_CONFIG_SIMULATION_ENERGY_IDLE_SLEEP_WAKEUP_NC * m.idleWakeupCount
+        + (double)OFSM_CONFIG_SIMULATION_ENERGY_DEEP_SLEEP_WAKEUP_NC * m.watchdogStepCount) / 1000.0;
+}
+
+/*Default energy model: charge (microcoulombs) consumed by awake period followed by sleep period and wakeup.
+Longest watchdog period is a multiple of timer0 overflow period, so planner splits every such chunk of a long sleep the same way;
+only one chunk is modeled and multiplied.*/
+double _ofsm_simulation_energy_model(_OFSM_TIME_DATA_TYPE awakeTicks, _OFSM_TIME_DATA_TYPE sleepTicks, bool deepSleep) {
+    const unsigned long chunkUs = _OFSM_MIN_DEEP_SLEEP_US << _OFSM_MAX_SLEEP_MASK;
+    double sleepUs = (double)sleepTicks * OFSM_CONFIG_TICK_US;
+    double chunkCount = floor(sleepUs / chunkUs);
+    double chargeUC = (double)OFSM_CONFIG_SIMULATION_ENERGY_ACTIVE_UA * awakeTicks * OFSM_CONFIG_TICK_US / 1000000.0
+        + (double)OFSM_CONFIG_SIMULATION_ENERGY_WAKEUP_NC / 1000.0;
+
+    if (chunkCount > 0) {
+        chargeUC += chunkCount * _ofsm_simulation_energy_model_sleep(chunkUs, deepSleep);
+    }
+    return chargeUC + _ofsm_simulation_energy_model_sleep((unsigned long)(sleepUs - chunkCount * chunkUs), deepSleep);
+}/*_ofsm_simulation_energy_model*/
+#endif /* _OFSM_IMPL_SIMULATION_ENERGY_MODEL */
 
 #ifdef _OFSM_IMPL_EVENT_GENERATOR
 void _ofsm_simulation_sleep_thread(int sleepMilliseconds) {
@@ -691,95 +2454,146 @@ void _ofsm_simulation_sleep(int sleepMilliseconds) {
 }/*_ofsm_simulation_sleep*/
 
 int lineNumber = 0;
-std::ifstream fileStream;
+unsigned long _ofsmSimulationCommandCount = 0;  /*number of script commands processed so far (see tests/ofsmBenchmark.cpp)*/
+FILE *_ofsmSimulationScriptFile = NULL;
+char _ofsmSimulationScriptBuffer[OFSM_CONFIG_SIMULATION_SCRIPT_BUFFER_SIZE];
+
+/*part of the script file processed by event generator; whole file by default (see PC SIMULATION PARALLEL RUNNER)*/
+struct OFSMSimulationScriptRange {
+    long offset;        /*file offset of the first line*/
+    int firstLine;
+    int lastLine;       /*0 - up to the end of the file*/
+};
+OFSMSimulationScriptRange _ofsmSimulationScriptRange = { 0, 1, 0 };
+
+#ifdef OFSM_CONFIG_SUPPORT_SNAPSHOT
+std::deque<std::string> _ofsmSimulationSnapshots; /*snapshot slots of 'sn[apshot]' command; they survive reset*/
+#endif
+
+/*r[eset] command; 'ru[n]' and 'rest[ore]' are not*/
+static inline bool _ofsm_simulation_is_reset_command(const char *t) {
+    return 'r' == t[0] && 'u' != t[1] && 0 != strncmp(t, "rest", 4);
+}
+
+/*reads next line of the script into lineBuffer; returns false at the end of the script*/
+static bool _ofsm_simulation_read_line(char *lineBuffer, int lineBufferSize) {
+    size_t len;
+    int c;
+    if (_ofsmSimulationScriptRange.lastLine && lineNumber >= _ofsmSimulationScriptRange.lastLine) {
+        return false;
+    }
+    if (!fgets(lineBuffer, lineBufferSize, _ofsmSimulationScriptFile)) {
+        return false;
+    }
+    lineNumber++;
+    len = strlen(lineBuffer);
+    if (len > 0 && lineBuffer[len - 1] != '\n' && !feof(_ofsmSimulationScriptFile)) {
+        /*line doesn't fit into the buffer, skip the rest of it*/
+        while ((c = fgetc(_ofsmSimulationScriptFile)) != EOF && c != '\n') {
+        }
+        printf("ASSERT at line: %i: Line is longer than OFSM_CONFIG_SIMULATION_SCRIPT_MAX_LINE_LENGTH, it is truncated.\n", lineNumber);
+    }
+    return true;
+}
 
+/*Parses script line in place (no memory allocation): "<command>[,<parameter>...][=<assert compare string>][//<comment>]"*/
 int _ofsm_simulation_event_generator(const char *fileName) {
-    std::string line;
-    std::string token;
+    char lineBuffer[OFSM_CONFIG_SIMULATION_SCRIPT_MAX_LINE_LENGTH + 1];
+    char *tokens[OFSM_CONFIG_SIMULATION_SCRIPT_MAX_TOKENS + 1]; /*+1 for 'queue' shorthand*/
+    static char queueCommand[] = "queue";
+    char *line;
+    char *t;
+    char *assertCompareString;
+    char *p;
+    uint8_t tCount;
     int exitCode = 0;
-    std::string assertCompareString;
 
     //in case of reset we don't need to open file again
-    if (fileName && !lineNumber) {
-        fileStream.open(fileName);
-        std::cin.rdbuf(fileStream.rdbuf());
+    if (!_ofsmSimulationScriptFile) {
+        _ofsmSimulationScriptFile = fileName ? fopen(fileName, "r") : stdin;
+        if (!_ofsmSimulationScriptFile) {
+            std::cerr << "Unable to open " << fileName << ". Exiting..." << std::endl;
+            return 1;
+        }
+        if (fileName) {
+            setvbuf(_ofsmSimulationScriptFile, _ofsmSimulationScriptBuffer, _IOFBF, sizeof(_ofsmSimulationScriptBuffer));
+            fseek(_ofsmSimulationScriptFile, _ofsmSimulationScriptRange.offset, SEEK_SET);
+            lineNumber = _ofsmSimulationScriptRange.firstLine - 1;
+        }
     }
-    while (!std::cin.eof())
+    while (_ofsm_simulation_read_line(lineBuffer, sizeof(lineBuffer)))
     {
-
-        //read line from stdin
-        std::getline(std::cin, line);
-        lineNumber++;
-        trim(line);
-
-        //prepare for parsing
-        std::string t;
-        std::deque<std::string> tokens;
-
         //strip comments
-        std::size_t commentPos = line.find("//");
-        if (commentPos != std::string::npos) {
-            line.replace(commentPos, line.length(), "");
+        p = strstr(lineBuffer, "//");
+        if (p) {
+            *p = 0;
         }
+        line = _ofsm_simulation_trim(lineBuffer);
 
         //skip empty lines
-        if (!line.length()) {
+        if (!*line) {
             continue;
         }
 
-        //get assert string or print string (preserving case)
-        t = line;
-        toLower(t);
-        assertCompareString = "";
-        if (0 != t.find("p")) {
-            /*it is not print, get assert*/
-            std::size_t assertComparePos = line.find("=");
-            if (assertComparePos != std::string::npos) {
-                assertCompareString = line.substr(assertComparePos + 1);
-                trim(assertCompareString);
-                line.replace(assertComparePos, line.length(), "");
-            }
-        }
-        //handle p[rint][,<string to be printed>] ...... command (preserver case)
-        else {
-            std::size_t commaPos = line.find(",");
-            if (commaPos != std::string::npos) {
-                assertCompareString = line.substr(commaPos + 1);
-            }
-            std::cout << assertCompareString << std::endl;
+        //handle p[rint][,<string to be printed>] ...... command (preserve case)
+        if ('p' == tolower((unsigned char)line[0])) {
+            p = strchr(line, ',');
+            std::cout << (p ? p + 1 : "") << '\n';
+            _ofsmSimulationCommandCount++;
             continue;
         }
 
-        //convert commands to lower case
-        toLower(line);
-        std::stringstream strStream(line);
+        //get assert string
+        assertCompareString = NULL;
+        p = strchr(line, '=');
+        if (p) {
+            *p = 0;
+            assertCompareString = _ofsm_simulation_trim(p + 1);
+        }
 
-        //parse by tokens
-        while (std::getline(strStream, token, ',')) {
-            if (token.find_first_not_of(' ') >= 0) {
-                tokens.push_back(trim(token));
+        //convert commands to lower case and parse by tokens
+        tCount = 0;
+        for (p = line; *p; p++) {
+            *p = (char)tolower((unsigned char)*p);
+        }
+        while (*line && tCount < OFSM_CONFIG_SIMULATION_SCRIPT_MAX_TOKENS) {
+            p = strchr(line, ',');
+            if (p) {
+                *p = 0;
             }
+            tokens[tCount++] = _ofsm_simulation_trim(line);
+            if (!p) {
+                break;
+            }
+            line = p + 1;
         }
 
         //skip empty lines
-        if (0 >= tokens.size()) {
+        if (0 == tCount || (1 == tCount && !*tokens[0])) {
             continue;
         }
+        _ofsmSimulationCommandCount++;
 
 #ifdef OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC
-        if (OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC(tokens)) {
-            continue;
+        {
+            std::deque<std::string> hookTokens(tokens, tokens + tCount);
+            if (OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC(hookTokens)) {
+                if (assertCompareString && *assertCompareString) {
+                    exitCode += _ofsm_simulation_check_for_assert(assertCompareString, lineNumber); /*hook may set assert compare string*/
+                }
+                continue;
+            }
         }
 #endif
         //if line starts with digit, assume shorthand of 'queue' command: eventCode[,eventData[,groupIndex]]
-        std::string digits = "0123456789";
-        if (std::string::npos != digits.find(tokens[0])) {
-            tokens.push_front("queue");
+        if (isdigit((unsigned char)tokens[0][0])) {
+            memmove(tokens + 1, tokens, tCount * sizeof(*tokens));
+            tokens[0] = queueCommand;
+            tCount++;
         }
 
         //parse command
         t = tokens[0];
-        uint8_t tCount = (uint8_t)tokens.size();
 
         switch (t[0]) {
         case 'e':			//e[xit]
@@ -802,7 +2616,7 @@ int _ofsm_simulation_event_generator(const char *fileName) {
         {
             _OFSM_TIME_DATA_TYPE sleepPeriod = 0;
             if (tCount > 1) {
-                sleepPeriod = atoi(tokens[1].c_str());
+                sleepPeriod = atoi(tokens[1]);
             }
             if (0 == sleepPeriod) {
                 sleepPeriod = 1000;
@@ -819,14 +2633,16 @@ int _ofsm_simulation_event_generator(const char *fileName) {
             uint8_t eventCode = 0;
             uint8_t eventData = 0;
             uint8_t eventCodeIndex = 1;
-            uint8_t groupIndex = 0;
+            _OFSM_INDEX_DATA_TYPE groupIndex = 0;
             bool isGlobal = false;
             bool forceNew = false;
+            bool isIsr = false;
             if (tCount > 1) {
                 t = tokens[1];
-                isGlobal = std::string::npos != t.find("g");
-                forceNew = std::string::npos != t.find("f");
-                if (isGlobal || forceNew) {
+                isGlobal = NULL != strchr(t, 'g');
+                forceNew = NULL != strchr(t, 'f');
+                isIsr = NULL != strchr(t, 'i');
+                if (isGlobal || forceNew || isIsr) {
                     eventCodeIndex = 2;
                 }
             }
@@ -834,19 +2650,19 @@ int _ofsm_simulation_event_generator(const char *fileName) {
             if (tCount > eventCodeIndex) {
                 t = tokens[eventCodeIndex];
                 eventCodeIndex++;
-                eventCode = atoi(t.c_str());
+                eventCode = atoi(t);
             }
             //get eventData
             if (tCount > eventCodeIndex) {
                 t = tokens[eventCodeIndex];
                 eventCodeIndex++;
-                eventData = atoi(t.c_str());
+                eventData = atoi(t);
             }
             //get groupIndex
             if (tCount > eventCodeIndex) {
                 t = tokens[eventCodeIndex];
                 eventCodeIndex++;
-                groupIndex = atoi(t.c_str());
+                groupIndex = atoi(t);
                 if (groupIndex >= _ofsmGroupCount) {
                     printf("ASSERT at line: %i: Invalid Group Index %i.\n", lineNumber, groupIndex);
                     continue;
@@ -856,6 +2672,11 @@ int _ofsm_simulation_event_generator(const char *fileName) {
             if (isGlobal) {
                 ofsm_queue_global_event(forceNew, eventCode, eventData);
             }
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+            else if (isIsr) {
+                ofsm_isr_queue_group_event(groupIndex, forceNew, eventCode, eventData);
+            }
+#endif
             else {
                 ofsm_queue_group_event(groupIndex, forceNew, eventCode, eventData);
             }
@@ -865,8 +2686,7 @@ int _ofsm_simulation_event_generator(const char *fileName) {
         {
             _OFSM_TIME_DATA_TYPE currentTime;
             if (tCount > 1) {
-                t = tokens[1];
-                currentTime = atoi(t.c_str());
+                currentTime = (_OFSM_TIME_DATA_TYPE)strtoull(tokens[1], NULL, 10); /*'-1' sets max. time value*/
             }
             else {
                 OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
@@ -876,34 +2696,125 @@ int _ofsm_simulation_event_generator(const char *fileName) {
             ofsm_heartbeat(currentTime);
         }
         break;
-        case 's':			//s[tatus][,groupIndex[,fsmIndex]]
+        case 's':			//s[tatus][,groupIndex[,fsmIndex[,reportLineTag]]] or sl[eep],sleepPeriodUs[,d[,wdtClockErrorPpm]] or sn[apshot][,slot]
         {
+            if (t[0] && t[1] == 'n') {
+#ifdef OFSM_CONFIG_SUPPORT_SNAPSHOT
+                size_t slot = tCount > 1 ? (size_t)atoi(tokens[1]) : 0;
+                size_t size = 0;
+                if (slot >= _ofsmSimulationSnapshots.size()) {
+                    _ofsmSimulationSnapshots.resize(slot + 1);
+                }
+                std::string &snapshot = _ofsmSimulationSnapshots[slot];
+                while ((size = ofsm_snapshot(&snapshot[0], snapshot.size())) != snapshot.size()) {
+                    snapshot.resize(size);
+                }
+                break;
+#else
+                printf("ASSERT at line: %i: snapshot command is ignored unless OFSM_CONFIG_SUPPORT_SNAPSHOT is defined.\n", lineNumber);
+                continue;
+#endif
+            }
+            if (t[0] && t[1] == 'l') {
+                OFSMSimulationSleepModel model = OFSMSimulationSleepModel();
+                unsigned long sleepPeriodUs = 0;
+                long clockErrorPpm = OFSM_CONFIG_SIMULATION_WDT_CLOCK_ERROR_PPM;
+                char buf[160];
+                if (tCount > 1) {
+                    sleepPeriodUs = strtoul(tokens[1], NULL, 10);
+                }
+                if (tCount > 3) {
+                    clockErrorPpm = atol(tokens[3]);
+                }
+                _ofsm_simulation_sleep_model(&model, sleepPeriodUs, tCount > 2 && 0 == strcmp(tokens[2], "d"), clockErrorPpm);
+                /*W - watchdog prescalers, I - idle sleep wakeups, E - real time, U - micros(), M - millis()*/
+                _ofsm_snprintf(buf, (sizeof(buf) / sizeof(*buf)), "-SM[W:%s,I:%lu,E:%010llu,U:%010lu,M:%010lu]"
+                    , model.watchdogPrescalers.c_str()
+                    , model.idleWakeupCount
+                    , model.elapsedUs
+                    , _ofsm_simulation_sleep_model_micros(&model)
+                    , model.timer0Millis);
+                ofsm_simulation_set_assert_compare_string(buf);
+                std::cout << buf << std::endl;
+                break;
+            }
+#if defined(OFSM_CONFIG_SIMULATION_TICKLESS) && !defined(OFSM_CONFIG_SIMULATION_SCRIPT_MODE)
+            _ofsm_simulation_tickless_sync_time(); /*tickless heartbeat provider doesn't update time while OFSM sleeps*/
+#endif
             OFSMSimulationStatusReport report;
-            uint8_t groupIndex = 0;
-            uint8_t fsmIndex = 0;
+            _OFSM_INDEX_DATA_TYPE groupIndex = 0;
+            _OFSM_INDEX_DATA_TYPE fsmIndex = 0;
             //get group index
             if (tCount > 1) {
-                t = tokens[1];
-                groupIndex = atoi(t.c_str());
+                groupIndex = atoi(tokens[1]);
             }
             //get fsm index
             if (tCount > 2) {
-                t = tokens[2];
-                fsmIndex = atoi(t.c_str());
+                fsmIndex = atoi(tokens[2]);
             }
             _ofsm_simulation_create_status_report(&report, groupIndex, fsmIndex);
+            //get report line to be compared by assert
+            if (tCount > 3) {
+                for (p = tokens[3]; *p; p++) {
+                    *p = (char)toupper((unsigned char)*p);
+                }
+                report.assertLineTag = tokens[3];
+            }
 
             OFSM_CONFIG_CUSTOM_SIMULATION_CUSTOM_STATUS_REPORT_PRINTER_FUNC(&report);
         }
         break;
-        case 'r':			//r[eset]
+        case 'r':			//r[eset] or ru[n],ticks or rest[ore][,slot]
         {
-            return -1; /*repeat main loop*/
+            if (_ofsm_simulation_is_reset_command(t)) {
+                return -1; /*repeat main loop*/
+            }
+            if (t[1] != 'u') {
+#ifdef OFSM_CONFIG_SUPPORT_SNAPSHOT
+                size_t slot = tCount > 1 ? (size_t)atoi(tokens[1]) : 0;
+                if (slot >= _ofsmSimulationSnapshots.size() || _ofsmSimulationSnapshots[slot].empty()) {
+                    printf("ASSERT at line: %i: Snapshot slot %i is empty.\n", lineNumber, (int)slot);
+                    continue;
+                }
+#   ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+                if (_ofsmSimulationTraceFile) {
+                    printf("ASSERT at line: %i: restore command is ignored while trace is recorded.\n", lineNumber);
+                    continue;
+                }
+#   endif
+                if (!ofsm_restore(_ofsmSimulationSnapshots[slot].data(), _ofsmSimulationSnapshots[slot].size())) {
+                    printf("ASSERT at line: %i: Snapshot %i cannot be restored.\n", lineNumber, (int)slot);
+                    continue;
+                }
+#   ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+                OFSM_CONFIG_CUSTOM_WAKEUP_FUNC(); /*let main loop re-evaluate restored wakeup time*/
+#   endif
+                break;
+#else
+                printf("ASSERT at line: %i: restore command is ignored unless OFSM_CONFIG_SUPPORT_SNAPSHOT is defined.\n", lineNumber);
+                continue;
+#endif
+            }
+#ifdef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
+            _OFSM_TIME_DATA_TYPE ticks = 0;
+            if (tCount > 1) {
+                ticks = (_OFSM_TIME_DATA_TYPE)strtoull(tokens[1], NULL, 10);
+            }
+            _ofsm_simulation_run(ticks);
+#else
+            printf("ASSERT at line: %i: run command is ignored unless OFSM_CONFIG_SIMULATION_SCRIPT_MODE is defined.\n", lineNumber);
+            continue;
+#endif
         }
         break;
         default:			//Unrecognized command!!!
         {
-            printf("ASSERT at line: %i: Invalid Command '%s' ignored.\n", lineNumber, line.c_str());
+            uint8_t i;
+            printf("ASSERT at line: %i: Invalid Command '", lineNumber);
+            for (i = 0; i < tCount; i++) {
+                printf(i ? ",%s" : "%s", tokens[i]);
+            }
+            printf("' ignored.\n");
             continue;
         }
         break;
@@ -911,7 +2822,7 @@ int _ofsm_simulation_event_generator(const char *fileName) {
 
 
         //check for assert
-        if (assertCompareString.length() > 0) {
+        if (assertCompareString && *assertCompareString) {
             exitCode += _ofsm_simulation_check_for_assert(assertCompareString, lineNumber);
         }
 
@@ -925,7 +2836,75 @@ int _ofsm_simulation_event_generator(const char *fileName) {
 }/*_ofsm_simulation_event_generator*/
 #endif /* _OFSM_IMPL_EVENT_GENERATOR */
 
-int main(int argc, char* argv[])
+/*In simulation mode, we need to allow to reset OFSM to initial state, so that intermediate test case can start clean.*/
+void _ofsm_simulation_reset() {
+    _OFSM_INDEX_DATA_TYPE i, k;
+    OFSMGroup *group;
+    OFSM *fsm;
+    /*reset GLOBALS*/
+    _ofsmFlags = (_OFSM_FLAG_INFINITE_SLEEP | _OFSM_FLAG_OFSM_FIRST_ITERATION);
+    _ofsmTime = 0;
+    _ofsmWakeupTime = 0;
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    memset((void*)&_ofsmSleepStatistics, 0, sizeof(_ofsmSleepStatistics));
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+    _ofsmSimulationSavedWakeupCount = _ofsmSimulationPendingSavedWakeups = 0;
+#endif
+#ifdef OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+    _ofsmSimulationEnergyChargeUC = 0;
+    _ofsmSimulationEnergyElapsedUs = 0;
+    _ofsmSimulationEnergyAwakeTicks = 0;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+    _ofsm_event_pool_reset();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+    _ofsm_elastic_queue_reset();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+    _ofsm_isr_staging_reset();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+    _ofsm_broadcast_reset();
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+    memset((void*)_ofsmCriticalSectionStatistics, 0, sizeof(_ofsmCriticalSectionStatistics));
+#endif
+    /*reset groups and FSMs*/
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        group->flags = 0;
+        group->currentEventIndex = group->nextEventIndex = 0;
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+        group->deadlineMissCount = 0;
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+        if (group->fsmArray) {
+            _ofsm_fsm_array_reset(group->fsmArray, group->groupSize);
+            continue;
+        }
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_FSM_POOL
+        if (group->fsmPool) {
+            _ofsm_fsm_pool_reset(group);
+            continue;
+        }
+#endif
+        for (k = 0; k < group->groupSize; k++) {
+            fsm = (group->fsms)[k];
+            fsm->flags = (_OFSM_FLAG_INFINITE_SLEEP);
+            fsm->currentState = fsm->simulationInitialState;
+            fsm->skipNextEventCode = (uint8_t)-1;
+            fsm->wakeupTime = 0;
+#ifdef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+            fsm->wakeupSlack = 0;
+#endif
+        }
+    }
+}/*_ofsm_simulation_reset*/
+
+int _ofsm_simulation_main(const char *scriptFileName)
 {
     int retCode = 0;
     do {
@@ -935,26 +2914,17 @@ int main(int argc, char* argv[])
         fsmThread.detach();
 
         //start timer thread
+#   ifdef OFSM_CONFIG_SIMULATION_TICKLESS
+        std::thread heartbeatProviderThread(_ofsm_simulation_tickless_heartbeat_provider_thread, (long)OFSM_CONFIG_SIMULATION_TICK_US);
+#   else
         std::thread heartbeatProviderThread(_ofsm_simulation_heartbeat_provider_thread, OFSM_CONFIG_SIMULATION_TICK_MS);
+#   endif
         heartbeatProviderThread.detach();
 #else
         //perform setup and make first iteration through the OFSM
         _ofsm_simulation_fsm_thread(0);
 #endif
 
-        char *scriptFileName = NULL;
-        if (argc > 1) {
-            switch (argc) {
-            case 2:
-                scriptFileName = argv[1];
-                break;
-            default:
-                std::cerr << "Too many argument. Exiting..." << std::endl;
-                return 1;
-                break;
-            }
-        }
-
         //call event generator
         retCode = OFSM_CONFIG_CUSTOM_SIMULATION_EVENT_GENERATOR_FUNC(scriptFileName);
 
@@ -965,6 +2935,9 @@ int main(int argc, char* argv[])
             OFSM_CONFIG_CUSTOM_WAKEUP_FUNC();
 #endif
         }
+#if defined(OFSM_CONFIG_SIMULATION_TICKLESS) && !defined(OFSM_CONFIG_SIMULATION_SCRIPT_MODE)
+        _ofsm_simulation_heartbeat_rearm(); /*let tickless heartbeat provider see exit flag*/
+#endif
 
 #ifndef OFSM_CONFIG_SIMULATION_SCRIPT_MODE
         _ofsm_debug_printf(3, "Waiting for %i milliseconds for all threads to exit...\n", OFSM_CONFIG_SIMULATION_TICK_MS);
@@ -973,34 +2946,405 @@ int main(int argc, char* argv[])
 
         if (retCode < 0) {
             _ofsm_debug_printf(3, "Reseting...\n");
-
-			/*In simulation mode, we need to allow to reset OFSM to initial state, so that intermediate test case can start clean.*/
-			uint8_t i, k;
-			OFSMGroup *group;
-			OFSM *fsm;
-			/*reset GLOBALS*/
-			_ofsmFlags = (_OFSM_FLAG_INFINITE_SLEEP | _OFSM_FLAG_OFSM_FIRST_ITERATION);
-			_ofsmTime = 0;
-			_ofsmWakeupTime = 0;
-			/*reset groups and FSMs*/
-			for (i = 0; i < _ofsmGroupCount; i++) {
-				group = (_ofsmGroups)[i];
-				group->flags = 0;
-				group->currentEventIndex = group->nextEventIndex = 0;
-				for (k = 0; k < group->groupSize; k++) {
-					fsm = (group->fsms)[k];
-					fsm->flags = (_OFSM_FLAG_INFINITE_SLEEP);
-					fsm->currentState = fsm->simulationInitialState;
-					fsm->skipNextEventCode = (uint8_t)-1;
-					fsm->wakeupTime = 0;
-				}
-			}
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+            _ofsm_simulation_trace_reset();
+#endif
+            _ofsm_simulation_reset();
         }
 
     } while (retCode < 0);
 
+    return retCode;
+}/*_ofsm_simulation_main*/
+
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_REPLAY
+static inline bool _ofsm_simulation_trace_read(void *data, size_t size) {
+    return 1 == fread(data, size, 1, _ofsmSimulationTraceFile);
+}
+
+/*replays trace recorded by threaded simulation as fast as possible: <sketch> --replay <trace file>
+Digest of OFSM state is verified before every main loop pass; the first pass that differs from recording is reported as an assert.*/
+int _ofsm_simulation_trace_replay(const char *fileName) {
+    uint8_t header[sizeof(_ofsmSimulationTraceMagic) + 3];
+    unsigned long recordCount = 0;
+    unsigned long passCount = 0;
+    unsigned long divergedPassCount = 0;
+    bool isBroken = false;
+    int type;
+    uint32_t digest;
+    _OFSM_TIME_DATA_TYPE currentTime;
+    uint8_t flags;
+    _OFSM_INDEX_DATA_TYPE groupIndex;
+    uint8_t eventCode;
+    OFSM_CONFIG_EVENT_DATA_TYPE eventData;
+    _OFSM_TIME_DATA_TYPE deadlineTicks = 0;
+
+    _ofsmSimulationTraceFile = fopen(fileName, "rb");
+    if (!_ofsmSimulationTraceFile) {
+        std::cerr << "Unable to open " << fileName << ". Exiting..." << std::endl;
+        return 1;
+    }
+    setvbuf(_ofsmSimulationTraceFile, _ofsmSimulationScriptBuffer, _IOFBF, sizeof(_ofsmSimulationScriptBuffer));
+    if (!_ofsm_simulation_trace_read(header, sizeof(header))
+        || 0 != memcmp(header, _ofsmSimulationTraceMagic, sizeof(_ofsmSimulationTraceMagic) - 1)
+        || header[sizeof(_ofsmSimulationTraceMagic) - 1] != _OFSM_SIMULATION_TRACE_VERSION
+        || header[sizeof(_ofsmSimulationTraceMagic)] != sizeof(_OFSM_TIME_DATA_TYPE)
+        || header[sizeof(_ofsmSimulationTraceMagic) + 1] != sizeof(_OFSM_INDEX_DATA_TYPE)
+        || header[sizeof(_ofsmSimulationTraceMagic) + 2] != sizeof(OFSM_CONFIG_EVENT_DATA_TYPE)) {
+        std::cerr << fileName << " is not a trace of this configuration. Exiting..." << std::endl;
+        fclose(_ofsmSimulationTraceFile);
+        _ofsmSimulationTraceFile = NULL;
+        return 1;
+    }
+
+    while (!isBroken && EOF != (type = fgetc(_ofsmSimulationTraceFile))) {
+        recordCount++;
+        switch (type) {
+        case 'B':
+            setup();
+            break;
+        case 'W':
+            OFSM_CONFIG_ATOMIC_BLOCK(OFSM_CONFIG_ATOMIC_RESTORESTATE) {
+                _ofsmFlags &= ~(_OFSM_FLAG_OFSM_EVENT_QUEUED | _OFSM_FLAG_INFINITE_SLEEP);
+            }
+            break;
+        case 'P':
+            isBroken = !_ofsm_simulation_trace_read(&digest, sizeof(digest));
+            if (isBroken) {
+                break;
+            }
+            passCount++;
+            if (digest != _ofsm_simulation_trace_digest()) {
+                if (0 == divergedPassCount) {
+                    printf("ASSERT at trace record: %lu: Replay diverged from recording at main loop pass %lu.\n", recordCount, passCount);
+                }
+                divergedPassCount++;
+            }
+            _ofsm_start();
+            break;
+        case 'H':
+            isBroken = !_ofsm_simulation_trace_read(&currentTime, sizeof(currentTime));
+            if (!isBroken) {
+                ofsm_heartbeat(currentTime);
+            }
+            break;
+        case 'E':
+            isBroken = !_ofsm_simulation_trace_read(&flags, sizeof(flags))
+                || !_ofsm_simulation_trace_read(&groupIndex, sizeof(groupIndex))
+                || !_ofsm_simulation_trace_read(&eventCode, sizeof(eventCode))
+                || !_ofsm_simulation_trace_read(&eventData, sizeof(eventData))
+                || ((flags & _OFSM_SIMULATION_TRACE_FLAG_DEADLINE) && !_ofsm_simulation_trace_read(&deadlineTicks, sizeof(deadlineTicks)));
+            if (isBroken) {
+                break;
+            }
+            if (flags & _OFSM_SIMULATION_TRACE_FLAG_GLOBAL) {
+                ofsm_queue_global_event((flags & _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT) != 0, eventCode, eventData);
+            }
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+            else if (flags & _OFSM_SIMULATION_TRACE_FLAG_ISR) {
+                ofsm_isr_queue_group_event(groupIndex, (flags & _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT) != 0, eventCode, eventData);
+            }
+#endif
+#ifdef OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+            else if (flags & _OFSM_SIMULATION_TRACE_FLAG_DEADLINE) {
+                ofsm_queue_group_event_deadline(groupIndex, (flags & _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT) != 0, eventCode, eventData, deadlineTicks);
+            }
+#endif
+            else {
+                ofsm_queue_group_event(groupIndex, (flags & _OFSM_SIMULATION_TRACE_FLAG_FORCE_NEW_EVENT) != 0, eventCode, eventData);
+            }
+            break;
+        case 'R':
+            _ofsm_simulation_reset();
+            break;
+        default:
+            isBroken = true;
+            break;
+        }
+    }
+    fclose(_ofsmSimulationTraceFile);
+    _ofsmSimulationTraceFile = NULL;
+
+    if (isBroken) {
+        printf("ASSERT at trace record: %lu: Trace is truncated or corrupted.\n", recordCount);
+    }
+    /*R - records, P - main loop passes, D - diverged passes*/
+    printf("-TR[R:%lu,P:%lu,D:%lu]\n", recordCount, passCount, divergedPassCount);
+    return (isBroken || divergedPassCount) ? 1 : 0;
+}/*_ofsm_simulation_trace_replay*/
+#endif /* _OFSM_IMPL_SIMULATION_TRACE_REPLAY */
+
+#ifdef _OFSM_IMPL_SIMULATION_PARALLEL_RUNNER
+struct OFSMSimulationScriptCase {
+    const char *fileName;
+    OFSMSimulationScriptRange range;
+    pid_t pid;
+    FILE *output;           /*worker stdout and stderr*/
+    bool isPassed;
+    std::string report;     /*worker output (verbose mode) or its asserts*/
+};
+
+/*splits script into 'reset' delimited cases; lines following 'exit' command are not part of any case.
+Case that restores snapshot taken by earlier case is merged with it (and all cases in between), so that they run in the same worker*/
+static bool _ofsm_simulation_split_script(const char *fileName, std::deque<OFSMSimulationScriptCase> &cases) {
+    char lineBuffer[OFSM_CONFIG_SIMULATION_SCRIPT_MAX_LINE_LENGTH + 1];
+    OFSMSimulationScriptCase scriptCase = OFSMSimulationScriptCase();
+    bool hasCommand = false;
+    long offset = 0;
+    int n = 0;
+    int c;
+    char *line;
+    char *p;
+#ifdef OFSM_CONFIG_SUPPORT_SNAPSHOT
+    std::deque<size_t> snapshotCaseIndexes; /*index of the case that took snapshot of the slot; cases.size() is index of current case*/
+    size_t slot;
+    size_t k;
+#endif
+    FILE *f = fopen(fileName, "r");
+    if (!f) {
+        std::cerr << "Unable to open " << fileName << ". Exiting..." << std::endl;
+        return false;
+    }
+    scriptCase.fileName = fileName;
+    scriptCase.range.firstLine = 1;
+    while (fgets(lineBuffer, sizeof(lineBuffer), f)) {
+        n++;
+        if (lineBuffer[0] && lineBuffer[strlen(lineBuffer) - 1] != '\n') {
+            while ((c = fgetc(f)) != EOF && c != '\n') {
+            }
+        }
+        p = strstr(lineBuffer, "//");
+        if (p) {
+            *p = 0;
+        }
+        line = _ofsm_simulation_trim(lineBuffer);
+        for (p = line; *p; p++) {
+            *p = (char)tolower((unsigned char)*p);
+        }
+        if (_ofsm_simulation_is_reset_command(line)) {
+            //r[eset] starts new case
+            if (hasCommand) {
+                scriptCase.range.lastLine = n - 1;
+                cases.push_back(scriptCase);
+            }
+            scriptCase.range.offset = offset;
+            scriptCase.range.firstLine = n;
+            hasCommand = true;
+        }
+        else if (*line) {
+            hasCommand = true;
+            if ('e' == line[0]) {
+                break; //e[xit]
+            }
+#ifdef OFSM_CONFIG_SUPPORT_SNAPSHOT
+            p = strchr(line, ',');
+            slot = p ? (size_t)atoi(p + 1) : 0;
+            if ('s' == line[0] && 'n' == line[1]) {
+                //sn[apshot][,slot]
+                if (slot >= snapshotCaseIndexes.size()) {
+                    snapshotCaseIndexes.resize(slot + 1, (size_t)-1);
+                }
+                snapshotCaseIndexes[slot] = cases.size();
+            }
+            else if ('r' == line[0] && 'u' != line[1] && slot < snapshotCaseIndexes.size() && snapshotCaseIndexes[slot] < cases.size()) {
+                //rest[ore][,slot] of snapshot taken by earlier case: current case continues that case
+                scriptCase.range = cases[snapshotCaseIndexes[slot]].range;
+                cases.resize(snapshotCaseIndexes[slot]);
+                for (k = 0; k < snapshotCaseIndexes.size(); k++) {
+                    if (snapshotCaseIndexes[k] != (size_t)-1 && snapshotCaseIndexes[k] > cases.size()) {
+                        snapshotCaseIndexes[k] = cases.size();
+                    }
+                }
+            }
+#endif
+        }
+        offset = ftell(f);
+    }
+    fclose(f);
+    if (hasCommand) {
+        scriptCase.range.lastLine = n;
+        cases.push_back(scriptCase);
+    }
+    return true;
+}/*_ofsm_simulation_split_script*/
+
+/*collects worker output and sets case result*/
+static void _ofsm_simulation_collect_case(OFSMSimulationScriptCase &scriptCase, int status, bool verbose) {
+    char lineBuffer[OFSM_CONFIG_SIMULATION_SCRIPT_MAX_LINE_LENGTH + 1];
+    char buf[80];
+    std::string assertLines;
+    bool isAssertDetails = false;
+    int assertLine;
+
+    rewind(scriptCase.output);
+    while (fgets(lineBuffer, sizeof(lineBuffer), scriptCase.output)) {
+        if (1 == sscanf(lineBuffer, "ASSERT at line: %i", &assertLine)) {
+            _ofsm_snprintf(buf, sizeof(buf), "%s%i", assertLines.length() ? "," : "", assertLine);
+            assertLines += buf;
+            isAssertDetails = true;
+        }
+        else if (lineBuffer[0] != '\t') {
+            isAssertDetails = false; /*'Expected:' and 'Produced:' lines of assert are indented*/
+        }
+        if (verbose || isAssertDetails) {
+            scriptCase.report += lineBuffer;
+        }
+    }
+    fclose(scriptCase.output);
+    scriptCase.output = NULL;
+
+    scriptCase.isPassed = !assertLines.length() && WIFEXITED(status) && 0 == WEXITSTATUS(status);
+    _ofsm_snprintf(buf, sizeof(buf), "%s %s:%i-%i", (scriptCase.isPassed ? "PASS" : "FAIL"), scriptCase.fileName, scriptCase.range.firstLine, scriptCase.range.lastLine);
+    std::string header = buf;
+    if (assertLines.length()) {
+        header += " (lines: " + assertLines + ")";
+    }
+    else if (WIFSIGNALED(status)) {
+        _ofsm_snprintf(buf, sizeof(buf), " (signal %i)", WTERMSIG(status));
+        header += buf;
+    }
+    else if (!scriptCase.isPassed) {
+        _ofsm_snprintf(buf, sizeof(buf), " (exit code %i)", WEXITSTATUS(status));
+        header += buf;
+    }
+    scriptCase.report = header + "\n" + scriptCase.report;
+}/*_ofsm_simulation_collect_case*/
+
+/*runs script cases in forked worker processes: <sketch> -j[<jobs>] [-v] <script file>...*/
+int _ofsm_simulation_parallel_runner(int argc, char* argv[]) {
+    std::deque<OFSMSimulationScriptCase> cases;
+    unsigned int jobs = 0;
+    unsigned int running = 0;
+    unsigned int failedCount = 0;
+    size_t next = 0;
+    size_t k;
+    bool verbose = false;
+    int scriptCount = 0;
+    int status;
+    int retCode;
+    pid_t pid;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (0 == strncmp(argv[i], "-j", 2)) {
+            jobs = atoi(argv[i] + 2);
+        }
+        else if (0 == strcmp(argv[i], "-v")) {
+            verbose = true;
+        }
+        else {
+            if (!_ofsm_simulation_split_script(argv[i], cases)) {
+                return 1;
+            }
+            scriptCount++;
+        }
+    }
+    if (0 == jobs) {
+        jobs = std::thread::hardware_concurrency();
+        if (0 == jobs) {
+            jobs = 1;
+        }
+    }
+
+    std::cout.flush();
+    fflush(stdout);
+    fflush(stderr);
+    while (next < cases.size() || running) {
+        //start next worker
+        if (next < cases.size() && running < jobs) {
+            OFSMSimulationScriptCase &scriptCase = cases[next++];
+            scriptCase.output = tmpfile();
+            pid = scriptCase.output ? fork() : -1;
+            if (0 == pid) {
+                dup2(fileno(scriptCase.output), STDOUT_FILENO);
+                dup2(fileno(scriptCase.output), STDERR_FILENO);
+                _ofsmSimulationScriptRange = scriptCase.range;
+                retCode = _ofsm_simulation_main(scriptCase.fileName);
+                std::cout.flush();
+                fflush(stdout);
+                _exit(retCode ? 1 : 0);
+            }
+            if (pid < 0) {
+                std::cerr << "Unable to start worker process. Exiting..." << std::endl;
+                return 1;
+            }
+            scriptCase.pid = pid;
+            running++;
+            continue;
+        }
+        //wait for any worker to finish
+        pid = wait(&status);
+        if (pid < 0) {
+            break;
+        }
+        for (k = 0; k < next; k++) {
+            if (cases[k].pid == pid && cases[k].output) {
+                _ofsm_simulation_collect_case(cases[k], status, verbose);
+                running--;
+                break;
+            }
+        }
+    }
+
+    //print summary in script order
+    for (k = 0; k < cases.size(); k++) {
+        if (!cases[k].isPassed) {
+            failedCount++;
+        }
+        if (verbose || !cases[k].isPassed) {
+            std::cout << cases[k].report;
+        }
+    }
+    /*S - scripts, C - cases, P - passed cases, F - failed cases*/
+    printf("-PR[S:%i,C:%u,P:%u,F:%u]\n", scriptCount, (unsigned int)cases.size(), (unsigned int)cases.size() - failedCount, failedCount);
+    return failedCount > 255 ? 255 : (int)failedCount;
+}/*_ofsm_simulation_parallel_runner*/
+#endif /* _OFSM_IMPL_SIMULATION_PARALLEL_RUNNER */
+
+#ifndef OFSM_CONFIG_SIMULATION_CUSTOM_MAIN
+int main(int argc, char* argv[])
+{
+    int retCode;
+#ifdef _OFSM_IMPL_SIMULATION_PARALLEL_RUNNER
+    if (argc > 1 && 0 == strncmp(argv[1], "-j", 2)) {
+        return _ofsm_simulation_parallel_runner(argc, argv);
+    }
+#endif
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_REPLAY
+    if (argc > 1 && 0 == strcmp(argv[1], "--replay")) {
+        if (argc != 3) {
+            std::cerr << "Usage: " << argv[0] << " --replay <trace file>. Exiting..." << std::endl;
+            return 1;
+        }
+        return _ofsm_simulation_trace_replay(argv[2]);
+    }
+#endif
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+    if (argc > 2 && 0 == strcmp(argv[1], "--record")) {
+        if (!_ofsm_simulation_trace_record_open(argv[2])) {
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+#endif
+    switch (argc) {
+    case 1:
+        retCode = _ofsm_simulation_main(NULL);
+        break;
+    case 2:
+        retCode = _ofsm_simulation_main(argv[1]);
+        break;
+    default:
+        std::cerr << "Too many argument. Exiting..." << std::endl;
+        return 1;
+    }
+#ifdef _OFSM_IMPL_SIMULATION_TRACE_RECORD
+    _ofsm_simulation_trace_record_close();
+#endif
     return retCode;
 }
+#endif /* OFSM_CONFIG_SIMULATION_CUSTOM_MAIN */
 
 #endif /* OFSM_CONFIG_SIMULATION */
 
@@ -1055,13 +3399,6 @@ static inline void _ofsm_deep_sleep_enable_peripheral() {
 
 volatile unsigned long _ofsmWatchdogDelayUs;
 
-/*chip specific MAX watchdog sleep period*/
-#ifndef WDP3
-#	define _OFSM_MAX_SLEEP_MASK  0B111 /*2 sec*/
-#else
-#   define _OFSM_MAX_SLEEP_MASK 0B1001 /*8 sec*/
-#endif
-
 static inline void _ofsm_enter_sleep() {
 uint8_t sleepFlag = 0;
 unsigned long sleepPeriodUs;
@@ -1069,15 +3406,27 @@ unsigned long sleepPeriodUs;
 	cli(); /*disable interrupts*/
 	_ofsmFlags &= ~_OFSM_FLAG_OFSM_IN_PROCESS; /*enable wakeup on timeout*/
 
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    _OFSM_TIME_DATA_TYPE stepStartTime;
+    uint8_t deepSleepStep;
+#endif
+
     while(!(_ofsmFlags & _OFSM_FLAG_OFSM_EVENT_QUEUED)) {
-        /*when in infinite sleep make wakeup time far in the future (128 * 16ms (16384000 us))*/
+        /*when in infinite sleep make wakeup time far in the future (128 * 16ms (16384000 us)), but within time comparison range*/
         if(_ofsmFlags & _OFSM_FLAG_INFINITE_SLEEP) {
-            _ofsmWakeupTime = _ofsmTime + (128 * 16384000L)/(unsigned long)OFSM_CONFIG_TICK_US;
+            _ofsmWakeupTime = _ofsmTime + ((128 * 16384000L)/(unsigned long)OFSM_CONFIG_TICK_US > _OFSM_TIME_HALF_RANGE ? _OFSM_TIME_HALF_RANGE : (128 * 16384000L)/(unsigned long)OFSM_CONFIG_TICK_US);
         }
         sleepPeriodUs = OFSM_CONFIG_CUSTOM_SLEEP_TIMER_SET_FUNC();
         while(!(_ofsmFlags & _OFSM_FLAG_OFSM_EVENT_QUEUED) && sleepPeriodUs > 0L) {
-            if(_ofsmFlags & _OFSM_FLAG_ALLOW_DEEP_SLEEP && sleepPeriodUs >= 16000L) {
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+            stepStartTime = _ofsmTime;
+            deepSleepStep = 0;
+#endif
+            if(_ofsm_plan_is_deep_sleep_step(_ofsmFlags & _OFSM_FLAG_ALLOW_DEEP_SLEEP, sleepPeriodUs)) {
                 sleepFlag |= 2;
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+                deepSleepStep = 1;
+#endif
                 OFSM_CONFIG_CUSTOM_DEEP_SLEEP_DISABLE_PERIPHERAL_FUNC();
                 _ofsm_enter_deep_sleep(sleepPeriodUs);
                 /*when coming out of deep sleep we always re-enable peripherals right away, as we cannot guarantee that next sleep will be a deep sleep again*/
@@ -1095,6 +3444,11 @@ unsigned long sleepPeriodUs;
             /*next call will be calling heartbeat via milliseconds/microseconds proxy
             unless custom heartbeat provider is implemented*/
             sleepPeriodUs = OFSM_CONFIG_CUSTOM_SLEEP_TIMER_GET_TIME_LEFT_US_FUNC();
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+            if (deepSleepStep) {
+                _ofsmSleepStatistics.deepSleepTicks += _ofsmTime - stepStartTime;
+            }
+#endif
         }
     }
 
@@ -1125,10 +3479,7 @@ static inline unsigned long _ofsm_sleep_timer_get_time_left_us() {
     unsigned long fullTicks = diff / OFSM_CONFIG_TICK_US;
     /*call heartbeat when we have at least 1 full ticks, adjust timer start time*/
     ofsm_heartbeat(_ofsmTimeBeforeSleep + fullTicks);
-    if(diff >= _ofsmSleepPeriodUs) {
-        return 0;
-    }
-    return _ofsmSleepPeriodUs - diff;
+    return _ofsm_plan_time_left_us(diff, _ofsmSleepPeriodUs);
 }
 #endif /*OFSM_CONFIG_CUSTOM_HEARTBEAT_PROVIDER*/
 
@@ -1159,19 +3510,6 @@ static inline void _ofsm_enter_idle_sleep(unsigned long sleepPeriodUs) {
 #endif // OFSM_CONFIG_DISABLE_BROWN_OUT_DETECTOR_ON_IDLE_SLEEP
 }
 
-#ifndef MICROSECONDS_PER_TIMER0_OVERFLOW
-	/* In Arduino environment the prescaler is set so that timer0 ticks every 64 clock cycles, and the
-	 the overflow handler is called every 256 ticks. */
-#	define MICROSECONDS_PER_TIMER0_OVERFLOW (clockCyclesToMicroseconds(64 * 256))
-    /* the fractional number of milliseconds per timer0 overflow. we shift right
-    * by three to fit these numbers into a byte. (for the clock speeds we care
-    * about - 8 and 16 MHz - this doesn't lose precision.) */
-#   define FRACT_INC ((MICROSECONDS_PER_TIMER0_OVERFLOW % 1000) >> 3)
-#   define FRACT_MAX (1000 >> 3)
-    /* the whole number of milliseconds per timer0 overflow*/
-#   define MILLIS_INC (MICROSECONDS_PER_TIMER0_OVERFLOW / 1000)
-#endif
-
 #ifdef OFSM_IMPL_WATCHDOG_INTERRUPT_HANDLER
 extern volatile unsigned long timer0_millis; /*Arduino timer0 variable*/
 extern volatile unsigned long timer0_overflow_count; /*Arduino timer0 overflow counter*/
@@ -1182,8 +3520,10 @@ static inline void _ofsm_wdt_vector() {
     then time will not be updated as we don't know how big of a delay was between getting to sleep and external interrupt
     */
 	if(_ofsmFlags & _OFSM_FLAG_OFSM_IN_DEEP_SLEEP) {
-		unsigned long overflowCount = _ofsmWatchdogDelayUs / MICROSECONDS_PER_TIMER0_OVERFLOW;
-		timer0_millis += overflowCount * MILLIS_INC + (unsigned long)(overflowCount/FRACT_MAX);
+		unsigned long overflowCount;
+		unsigned long millis;
+		_ofsm_plan_timer0_compensation(_ofsmWatchdogDelayUs, &overflowCount, &millis);
+		timer0_millis += millis;
 		/*update Arduino overflow counter*/
 		timer0_overflow_count += overflowCount;
 	}
@@ -1191,22 +3531,21 @@ static inline void _ofsm_wdt_vector() {
 #endif
 
 ISR(WDT_vect) {
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    _ofsmSleepStatistics.watchdogWakeupCount++;
+#endif
 	OFSM_CONFIG_CUSTOM_WATCHDOG_INTERRUPT_HANDLER_FUNC();
 }
 
 static inline void _ofsm_enter_deep_sleep(unsigned long sleepPeriodUs) {
     uint16_t wdtMask = 0;
+    uint8_t prescaler;
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    unsigned long watchdogWakeupCount;
+#endif
 
-    if(sleepPeriodUs >= 8192000L) {
-        wdtMask = _OFSM_MAX_SLEEP_MASK; /*8 sec*/
-        _ofsmWatchdogDelayUs = 16000L << _OFSM_MAX_SLEEP_MASK;
-    } else {
-        unsigned long probe = 16000L;
-        for (wdtMask = 0; probe <= (sleepPeriodUs-(16000L << wdtMask)); wdtMask++) {
-            probe = probe << 1;
-        }
-        _ofsmWatchdogDelayUs = probe;
-    }
+    _ofsmWatchdogDelayUs = _ofsm_plan_deep_sleep_step(sleepPeriodUs, &prescaler);
+    wdtMask = prescaler;
 
     /*adjust wdtMask: shift bit: 3 into WDP3 position (bit: 5)*/
     wdtMask = (((wdtMask & 0B1000) << 2) | (wdtMask & 0B111));
@@ -1245,6 +3584,9 @@ static inline void _ofsm_enter_deep_sleep(unsigned long sleepPeriodUs) {
 	sleep_bod_disable();
 #endif // OFSM_CONFIG_DISABLE_BROWN_OUT_DETECTOR_ON_DEEP_SLEEP
 
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    watchdogWakeupCount = _ofsmSleepStatistics.watchdogWakeupCount;
+#endif
 	sei(); /*next instruction is guaranteed to be executed*/
 	sleep_cpu();
 	/*------------------------------------------*/
@@ -1257,6 +3599,11 @@ static inline void _ofsm_enter_deep_sleep(unsigned long sleepPeriodUs) {
 
     wdt_disable();
     _ofsmFlags &= ~_OFSM_FLAG_OFSM_IN_DEEP_SLEEP;
+#ifdef OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+    if (watchdogWakeupCount == _ofsmSleepStatistics.watchdogWakeupCount) {
+        _ofsmSleepStatistics.interruptedDeepSleepCount++;
+    }
+#endif
 }
 
 #endif /* not OFSM_CONFIG_SIMULATION */
@@ -0,0 +1,103 @@
+/*
+OFSM script parser benchmark: measures how many simulation script commands per second event generator processes.
+Compiler Command line: g++ -O2 -std=c++11 -DUTEST -I../src -o ofsmBenchmark ofsmBenchmark.cpp
+Usage:
+    ofsmBenchmark > /dev/null                   //generates stress script of OFSM_BENCHMARK_CYCLE_COUNT cycles and runs it
+    ofsmBenchmark <script file> > /dev/null     //runs given script
+Result is printed to stderr: -BM[C:<commands>,T:<milliseconds>,R:<commands per second>]
+*/
+int ofsm_benchmark_event_generator(const char *fileName);
+#define OFSM_CONFIG_CUSTOM_SIMULATION_EVENT_GENERATOR_FUNC ofsm_benchmark_event_generator
+
+#include "ofsmTest.h"
+#include <ofsm.impl.h>
+
+/*number of generated stress script cycles; each cycle is 10 commands*/
+#ifndef OFSM_BENCHMARK_CYCLE_COUNT
+#   define OFSM_BENCHMARK_CYCLE_COUNT 200000
+#endif
+
+/*define events*/
+enum Events {Timeout = 0, NormalTransition};
+enum States {S0 = 0, S1};
+enum FsmId	{DefaultFsm = 0};
+enum FsmGrpId {MainGroup = 0};
+
+/* Handlers declaration */
+void DummyHandler();
+
+/* OFSM configuration */
+OFSMTransition transitionTable[][1 + NormalTransition] = {
+    /* timeout,               NormalTransition */
+    { { DummyHandler, S1 },{ DummyHandler, S1 } }, //S0
+    { { 0,			  0  },{ DummyHandler, S0 } }, //S1
+};
+
+OFSM_DECLARE_FSM(DefaultFsm, transitionTable, 1 + NormalTransition, NULL, NULL, 0);
+OFSM_DECLARE_GROUP_1(MainGroup, EVENT_QUEUE_SIZE, DefaultFsm);
+OFSM_DECLARE_1(MainGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/* Handler implementation */
+void DummyHandler() {
+}
+
+/*each cycle brings FSM back to the same state, so that the same assert holds for every cycle*/
+static const char *_ofsm_benchmark_cycle =
+    "queue,1,0,0        //S0 -> S1\n"
+    "wakeup\n"
+    "\n"
+    "1                  //S1 -> S0, queue shorthand\n"
+    "W\n"
+    "h,0\n"
+    "q,f,1,0,0\n"
+    "q,,0\n"
+    "status = -O[id]-G(0)[.,002]-F(0)[ipo]-S(0)-TW[0000000000.,O:0000000001.,F:0000000001.]   \n"
+    "Print, --- cycle\n"
+    "r\n";
+
+int ofsm_benchmark_event_generator(const char *fileName) {
+    static const char *generatedFileName = "ofsmBenchmark.tmp";
+    static std::chrono::steady_clock::time_point start;
+    static bool isGenerated = false;
+    int retCode;
+
+    if (!lineNumber) {
+        if (!fileName) {
+            FILE *f = fopen(generatedFileName, "w");
+            if (!f) {
+                std::cerr << "Unable to create " << generatedFileName << std::endl;
+                return 1;
+            }
+            fputs("reset //start clean\n", f);
+            for (unsigned long i = 0; i < OFSM_BENCHMARK_CYCLE_COUNT; i++) {
+                fputs(_ofsm_benchmark_cycle, f);
+            }
+            fputs("exit\n", f);
+            fclose(f);
+            isGenerated = true;
+        }
+        start = std::chrono::steady_clock::now();
+    }
+
+    retCode = _ofsm_simulation_event_generator(isGenerated ? generatedFileName : fileName);
+    if (retCode < 0) {
+        return retCode; /*reset; main loop calls generator again*/
+    }
+
+    unsigned long commandCount = _ofsmSimulationCommandCount;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "-BM[C:" << commandCount << ",T:" << (unsigned long)ms << ",R:" << (unsigned long)(ms > 0 ? commandCount * 1000.0 / ms : 0) << "]" << std::endl;
+    if (isGenerated) {
+        remove(generatedFileName);
+    }
+    return retCode;
+}
@@ -0,0 +1,26 @@
+/*
+OFSM broadcast queue tests.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmBroadcastTest ofsmBroadcastTest.cpp
+Usage: ofsmBroadcastTest ofsmBroadcastTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_BROADCAST_QUEUE
+
+#include "ofsmQueueTest.h"
+
+enum FsmId	{FirstFsm = 0, SecondFsm};
+enum FsmGrpId {FirstGroup = 0, SecondGroup};
+
+OFSM_DECLARE_FSM(FirstFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_FSM(SecondFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_GROUP(FirstGroup, EVENT_QUEUE_SIZE, FirstFsm);
+OFSM_DECLARE_GROUP(SecondGroup, EVENT_QUEUE_SIZE, SecondFsm);
+OFSM_DECLARE(FirstGroup, SecondGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
@@ -0,0 +1,48 @@
+/*
+OFSM critical section statistics tests: ofsmTest sketch with OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS and fake microseconds clock,
+so that hold time of every atomic block is exactly the clock step set by script.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmCriticalSectionTest ofsmCriticalSectionTest.cpp
+Usage: ofsmCriticalSectionTest ofsmCriticalSectionTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_CRITICAL_SECTION_STATISTICS
+#define OFSM_CONFIG_CUSTOM_CRITICAL_SECTION_MICROS_FUNC ofsm_critical_section_test_micros
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_critical_section_test_command_hook
+
+#include <deque>
+#include <string>
+unsigned long ofsm_critical_section_test_micros();
+bool ofsm_critical_section_test_command_hook(std::deque<std::string> &tokens);
+
+#include "ofsmTest.cpp"
+
+unsigned long ofsmCriticalSectionTestNowUs;
+unsigned long ofsmCriticalSectionTestStepUs; /*every clock read advances clock by the step: atomic block (with no nested block) is held for one step*/
+
+unsigned long ofsm_critical_section_test_micros() {
+    ofsmCriticalSectionTestNowUs += ofsmCriticalSectionTestStepUs;
+    return ofsmCriticalSectionTestNowUs;
+}
+
+/*Extra commands:
+    cu,<us>             //sets clock step, i.e. hold time of every following atomic block
+    ct,<count>          //enters OFSM_CRITICAL_SECTION_GET_TIME site <count> times (ofsm_get_time())
+    cz                  //clears statistics (ofsm_reset_critical_section_statistics()), e.g. the ones of main loop pass made by reset*/
+bool ofsm_critical_section_test_command_hook(std::deque<std::string> &tokens) {
+    _OFSM_TIME_DATA_TYPE currentTime;
+    if (tokens[0] == "cu" && tokens.size() > 1) {
+        ofsmCriticalSectionTestStepUs = (unsigned long)atol(tokens[1].c_str());
+        return true;
+    }
+    if (tokens[0] == "ct" && tokens.size() > 1) {
+        for (long i = atol(tokens[1].c_str()); i > 0; i--) {
+            ofsm_get_time(currentTime);
+        }
+        (void)currentTime;
+        return true;
+    }
+    if (tokens[0] == "cz") {
+        ofsm_reset_critical_section_statistics();
+        return true;
+    }
+    return false;
+}
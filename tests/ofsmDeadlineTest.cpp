@@ -0,0 +1,77 @@
+/*
+OFSM event deadline (Earliest Deadline First) tests.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmDeadlineTest ofsmDeadlineTest.cpp
+Usage: ofsmDeadlineTest ofsmDeadlineTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_EVENT_DEADLINE
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_deadline_test_command_hook
+
+#include "ofsmTest.h"
+bool ofsm_deadline_test_command_hook(std::deque<std::string> &tokens);
+#include <ofsm.impl.h>
+
+/*define events*/
+enum Events {Timeout = 0, NormalTransition};
+enum States {S0 = 0, S1};
+enum FsmId	{DefaultFsm = 0, UrgentFsm};
+enum FsmGrpId {MainGroup = 0, UrgentGroup};
+
+/* Handlers declaration */
+void DummyHandler();
+
+/* OFSM configuration */
+OFSMTransition transitionTable[][1 + NormalTransition] = {
+    /* timeout,               NormalTransition */
+    { { DummyHandler, S1 },{ DummyHandler, S1 } }, //S0
+    { { 0,			  0  },{ DummyHandler, S0 } }, //S1
+};
+
+OFSM_DECLARE_FSM(DefaultFsm, transitionTable, 1 + NormalTransition, NULL, NULL, 0);
+OFSM_DECLARE_FSM(UrgentFsm, transitionTable, 1 + NormalTransition, NULL, NULL, 0);
+OFSM_DECLARE_GROUP(MainGroup, EVENT_QUEUE_SIZE, DefaultFsm);
+OFSM_DECLARE_GROUP(UrgentGroup, EVENT_QUEUE_SIZE, UrgentFsm);
+OFSM_DECLARE(MainGroup, UrgentGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/* Handler implementation */
+std::string processingOrder; /*indexes of groups in order their events were processed*/
+
+void DummyHandler() {
+    processingOrder += (char)('0' + fsm_get_group_index());
+}
+
+/*Extra commands:
+    dq,<group index>,<event code>,<deadline ticks>[,f]    //queue event with deadline ('f' - force new event); deadline -1 is OFSM_NO_DEADLINE
+    dm[,<group index>]                                  //prints deadline miss count of the group: -DM(<group index>)[<count>]
+    po                                                  //prints (and clears) indexes of groups in order their events were processed: -PO[<group indexes>]*/
+bool ofsm_deadline_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[32];
+    _OFSM_INDEX_DATA_TYPE groupIndex = tokens.size() > 1 ? (_OFSM_INDEX_DATA_TYPE)atoi(tokens[1].c_str()) : 0;
+    if (tokens[0] == "dq" && tokens.size() > 3) {
+        ofsm_queue_group_event_deadline(groupIndex, tokens.size() > 4 && tokens[4] == "f", (uint8_t)atoi(tokens[2].c_str()), 0,
+            (_OFSM_TIME_DATA_TYPE)strtoull(tokens[3].c_str(), NULL, 10));
+        return true;
+    }
+    if (tokens[0] == "po") {
+        _ofsm_snprintf(buf, sizeof(buf), "-PO[%s]", processingOrder.c_str());
+        processingOrder.clear();
+        ofsm_simulation_set_assert_compare_string(buf);
+        std::cout << buf << std::endl;
+        return true;
+    }
+    if (tokens[0] == "dm") {
+        _ofsm_snprintf(buf, sizeof(buf), "-DM(%i)[%u]", (int)groupIndex, (unsigned int)ofsm_query_group_deadline_miss_count(groupIndex));
+        ofsm_simulation_set_assert_compare_string(buf);
+        std::cout << buf << std::endl;
+        return true;
+    }
+    return false;
+}
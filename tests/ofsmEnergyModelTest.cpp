@@ -0,0 +1,8 @@
+/*
+OFSM simulation energy model tests: ofsmBlink example with OFSM_CONFIG_SIMULATION_ENERGY_MODEL (default current draw and charge constants).
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmEnergyModelTest ofsmEnergyModelTest.cpp
+Usage: ofsmEnergyModelTest ofsmEnergyModelTest.test
+*/
+#define OFSM_CONFIG_SIMULATION_ENERGY_MODEL
+
+#include "../examples/ofsmBlink/ofsmBlink.ino"
@@ -0,0 +1,27 @@
+/*
+OFSM shared event pool tests.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmEventPoolTest ofsmEventPoolTest.cpp
+Usage: ofsmEventPoolTest ofsmEventPoolTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+
+#include "ofsmQueueTest.h"
+
+enum FsmId	{FirstFsm = 0, SecondFsm};
+enum FsmGrpId {FirstGroup = 0, SecondGroup};
+
+OFSM_DECLARE_FSM(FirstFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_FSM(SecondFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_EVENT_POOL(SingleSlotPool, 1);
+OFSM_DECLARE_GROUP_SHARED_QUEUE(FirstGroup, SingleSlotPool, 0, FirstFsm);
+OFSM_DECLARE_GROUP_SHARED_QUEUE(SecondGroup, SingleSlotPool, 0, SecondFsm);
+OFSM_DECLARE(FirstGroup, SecondGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
@@ -0,0 +1,104 @@
+/*
+OFSM FSM array tests.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmFsmArrayTest ofsmFsmArrayTest.cpp
+Usage: ofsmFsmArrayTest ofsmFsmArrayTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_FSM_ARRAY
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_fsm_array_test_command_hook
+
+#include "ofsmTest.h"
+bool ofsm_fsm_array_test_command_hook(std::deque<std::string> &tokens);
+#include <ofsm.impl.h>
+
+#define SENSOR_COUNT 4
+
+/*define events*/
+enum Events {Timeout = 0, Start, Stop};
+enum States {Idle = 0, Measuring};
+enum FsmId	{ControllerFsm = 0, SensorFsmArray};
+enum FsmGrpId {ControllerGroup = 0, SensorGroup};
+
+/* Handlers declaration */
+void StartHandler();
+void MeasuredHandler();
+void StopHandler();
+
+/* OFSM configuration */
+OFSMTransition transitionTable[][1 + Stop] = {
+    /* timeout,                         Start,                          Stop */
+    { { 0,               Idle },        { StartHandler, Measuring },    { 0,           Idle } }, //Idle
+    { { MeasuredHandler, Measuring },   { 0,            Measuring },    { StopHandler, Idle } }, //Measuring
+};
+
+unsigned int measurementCount[SENSOR_COUNT]; /*per instance data of the FSM array*/
+
+OFSM_DECLARE_FSM(ControllerFsm, transitionTable, 1 + Stop, NULL, NULL, Idle);
+OFSM_DECLARE_FSM_ARRAY(SensorFsmArray, transitionTable, 1 + Stop, NULL, measurementCount, Idle, SENSOR_COUNT);
+OFSM_DECLARE_GROUP(ControllerGroup, EVENT_QUEUE_SIZE, ControllerFsm);
+OFSM_DECLARE_GROUP_FSM_ARRAY(SensorGroup, EVENT_QUEUE_SIZE, SensorFsmArray);
+OFSM_DECLARE(ControllerGroup, SensorGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/* Handler implementation */
+std::string measurements; /*<group index>.<fsm index>@<time> of every measurement*/
+
+/*each instance measures with its own period: fsm index + 1 ticks*/
+void StartHandler() {
+    fsm_set_transition_delay(fsm_get_fsm_index() + 1);
+}
+
+void MeasuredHandler() {
+    _OFSM_TIME_DATA_TYPE currentTime;
+    ofsm_get_time(currentTime);
+    if (fsm_get_private_data()) {
+        fsm_get_private_data_cast(unsigned int*)[fsm_get_fsm_index()]++;
+    }
+    if (measurements.length()) {
+        measurements += ",";
+    }
+    measurements += std::to_string((int)fsm_get_group_index()) + "." + std::to_string((int)fsm_get_fsm_index()) + "@" + std::to_string((unsigned long long)currentTime);
+    fsm_set_transition_delay(fsm_get_fsm_index() + 1);
+}
+
+void StopHandler() {
+    fsm_set_infinite_delay();
+}
+
+/*Extra commands:
+    me                                  //prints (and clears) measurements: -ME[<group index>.<fsm index>@<time>,...]
+    mc                                  //prints measurement count of every FSM array instance: -MC[<count>,...]
+    fs,<group index>,<fsm index>        //prints state and flags of the FSM queried by ofsm_query_fsm_...(): -FS(<group index>.<fsm index>)[S:<state>,F:<flags>]*/
+bool ofsm_fsm_array_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[160];
+    std::string counts;
+    if (tokens[0] == "me") {
+        _ofsm_snprintf(buf, sizeof(buf), "-ME[%s]", measurements.c_str());
+        measurements.clear();
+    }
+    else if (tokens[0] == "mc") {
+        for (int i = 0; i < SENSOR_COUNT; i++) {
+            counts += (i ? "," : "") + std::to_string(measurementCount[i]);
+        }
+        _ofsm_snprintf(buf, sizeof(buf), "-MC[%s]", counts.c_str());
+    }
+    else if (tokens[0] == "fs" && tokens.size() > 2) {
+        _OFSM_INDEX_DATA_TYPE groupIndex = (_OFSM_INDEX_DATA_TYPE)atoi(tokens[1].c_str());
+        _OFSM_INDEX_DATA_TYPE fsmIndex = (_OFSM_INDEX_DATA_TYPE)atoi(tokens[2].c_str());
+        _ofsm_snprintf(buf, sizeof(buf), "-FS(%i.%i)[S:%i,F:%02X]", (int)groupIndex, (int)fsmIndex,
+            (int)ofsm_query_fsm_next_state(groupIndex, fsmIndex), (unsigned int)(ofsm_query_fsm_flags(groupIndex, fsmIndex) & _OFSM_FLAG_INFINITE_SLEEP));
+    }
+    else {
+        return false;
+    }
+    ofsm_simulation_set_assert_compare_string(buf);
+    std::cout << buf << std::endl;
+    return true;
+}
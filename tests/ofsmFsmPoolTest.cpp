@@ -0,0 +1,106 @@
+/*
+OFSM FSM pool tests.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmFsmPoolTest ofsmFsmPoolTest.cpp
+Usage: ofsmFsmPoolTest ofsmFsmPoolTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_FSM_POOL
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_fsm_pool_test_command_hook
+
+#include "ofsmTest.h"
+bool ofsm_fsm_pool_test_command_hook(std::deque<std::string> &tokens);
+#include <ofsm.impl.h>
+
+#define POOL_CAPACITY 3
+#define DEVICE_ID_COUNT 10
+
+/*define events*/
+enum Events {Timeout = 0, Work, Quit};
+enum States {Idle = 0};
+enum FsmId	{ControllerFsm = 0};
+enum FsmGrpId {ControllerGroup = 0, DeviceGroup};
+
+/* Handlers declaration */
+void WorkHandler();
+void QuitHandler();
+
+/* OFSM configuration */
+OFSMTransition transitionTable[][1 + Quit] = {
+    /* timeout,        Work,                   Quit */
+    { { 0,  Idle },    { WorkHandler, Idle },  { QuitHandler, Idle } }, //Idle
+};
+
+OFSM_DECLARE_FSM(ControllerFsm, transitionTable, 1 + Quit, NULL, NULL, Idle);
+OFSM_DECLARE_GROUP(ControllerGroup, EVENT_QUEUE_SIZE, ControllerFsm);
+OFSM_DECLARE_GROUP_FSM_POOL(DeviceGroup, EVENT_QUEUE_SIZE, POOL_CAPACITY);
+OFSM_DECLARE(ControllerGroup, DeviceGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/* Handler implementation */
+int deviceIds[DEVICE_ID_COUNT] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9}; /*private data of spawned FSMs identifies them*/
+OFSM *devices[DEVICE_ID_COUNT];
+std::string handled; /*<device id> (or 'c' for controller) of every FSM that handled Work/Quit event*/
+
+static void record_handled() {
+    if (handled.length()) {
+        handled += ",";
+    }
+    handled += fsm_get_private_data() ? std::to_string(*fsm_get_private_data_cast(int*)) : std::string("c");
+}
+
+void WorkHandler() {
+    record_handled();
+    fsm_set_infinite_delay();
+}
+
+/*pool FSM destroys itself while group is processing the event*/
+void QuitHandler() {
+    record_handled();
+    if (fsm_get_private_data()) {
+        devices[*fsm_get_private_data_cast(int*)] = NULL;
+        ofsm_destroy_fsm(fsm_get_group_index(), fsm_get_fsm());
+    }
+    fsm_set_infinite_delay();
+}
+
+/*Extra commands:
+    sp,<group index>,<device id>        //spawns FSM with device id as private data: -SP[<1 - spawned; 0 - not spawned>]
+    de,<group index>,<device id>|c      //destroys FSM spawned with device id ('c' - controller FSM, which is not from the pool)
+    gs,<group index>                    //prints number of FSMs in the group: -GS(<group index>)[<count>]
+    hd                                  //prints (and clears) device ids of FSMs that handled Work/Quit events: -HD[<device id>|c,...]*/
+bool ofsm_fsm_pool_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[80];
+    _OFSM_INDEX_DATA_TYPE groupIndex = tokens.size() > 1 ? (_OFSM_INDEX_DATA_TYPE)atoi(tokens[1].c_str()) : 0;
+    int deviceId = tokens.size() > 2 ? atoi(tokens[2].c_str()) % DEVICE_ID_COUNT : 0;
+    if (tokens[0] == "sp") {
+        OFSM *fsm = ofsm_spawn_fsm(groupIndex, transitionTable, 1 + Quit, &(deviceIds[deviceId]), Idle);
+        if (fsm) {
+            devices[deviceId] = fsm;
+        }
+        _ofsm_snprintf(buf, sizeof(buf), "-SP[%i]", fsm ? 1 : 0);
+    }
+    else if (tokens[0] == "de" && tokens.size() > 2) {
+        ofsm_destroy_fsm(groupIndex, tokens[2] == "c" ? ofsm_query_get_fsm(ControllerGroup, 0) : devices[deviceId]);
+        return true;
+    }
+    else if (tokens[0] == "gs") {
+        _ofsm_snprintf(buf, sizeof(buf), "-GS(%i)[%i]", (int)groupIndex, (int)ofsm_query_get_group(groupIndex)->groupSize);
+    }
+    else if (tokens[0] == "hd") {
+        _ofsm_snprintf(buf, sizeof(buf), "-HD[%s]", handled.c_str());
+        handled.clear();
+    }
+    else {
+        return false;
+    }
+    ofsm_simulation_set_assert_compare_string(buf);
+    std::cout << buf << std::endl;
+    return true;
+}
@@ -0,0 +1,378 @@
+/*
+OFSM transition table fuzzer: feeds sequences of queue, heartbeat and wakeup commands decoded from fuzzer input into script mode OFSM,
+tracks (state, event) cell coverage of every FSM and checks OFSM invariants after every command.
+It calls script mode entry points directly, so that no script is parsed and no iostream is used per execution.
+libFuzzer:
+    Compiler Command line: clang++ -g -O1 -std=c++11 -fsanitize=fuzzer,address -DUTEST -DOFSM_FUZZ_LIBFUZZER -I../src -o ofsmFuzz ofsmFuzz.cpp
+    Usage: ofsmFuzz [libFuzzer options] [corpus directory]     //(state, event) cells feed libFuzzer as extra coverage counters
+Standalone (no libFuzzer):
+    Compiler Command line: g++ -O2 -std=c++11 -DUTEST -I../src -o ofsmFuzz ofsmFuzz.cpp
+    Usage:
+        ofsmFuzz [-n<executions>] [-s<seed>]    //random inputs (default: 100000 executions)
+        ofsmFuzz <input file>...                //re-runs inputs, e.g. crash input saved by libFuzzer or by standalone run
+Invariant violation is printed to stderr and aborts; standalone run saves violating input into ofsmFuzz.crash first.
+Report is printed to stderr at exit:
+    -FC(<group>,<fsm>)[C:<covered cells>,H:<cells with handler in visited states>,S:<visited states>]  //followed by uncovered cells: S:<state>,E:<event>
+    -FZ[E:<executions>,C:<commands>,O:<executions with queue overflow>,W:<commands checked against wakeup time invariant>,T:<milliseconds>,R:<executions per second>]
+To fuzz transition tables of another sketch, include it instead of ofsmTest.cpp (sketch must be configured for script mode).
+*/
+#include <stdint.h>
+#include <stddef.h>
+
+void ofsm_fuzz_transition_hook(struct OFSM *fsm, unsigned int groupIndex, unsigned int fsmIndex, uint8_t eventCode);
+#define OFSM_CONFIG_CUSTOM_SIMULATION_TRANSITION_HOOK_FUNC ofsm_fuzz_transition_hook
+#define OFSM_CONFIG_SIMULATION_CUSTOM_MAIN
+
+#include "ofsmTest.cpp"
+
+/*max. number of FSMs which coverage is tracked*/
+#ifndef OFSM_FUZZ_MAX_FSM_COUNT
+#   define OFSM_FUZZ_MAX_FSM_COUNT 16
+#endif
+
+/*max. size of random input of standalone run*/
+#ifndef OFSM_FUZZ_MAX_INPUT_SIZE
+#   define OFSM_FUZZ_MAX_INPUT_SIZE 256
+#endif
+
+/*max. size of input file re-run by standalone run*/
+#ifndef OFSM_FUZZ_MAX_INPUT_FILE_SIZE
+#   define OFSM_FUZZ_MAX_INPUT_FILE_SIZE 65536
+#endif
+
+/*number of libFuzzer extra counters (power of 2); (state, event) cells are hashed into them*/
+#ifndef OFSM_FUZZ_EXTRA_COUNTER_COUNT
+#   define OFSM_FUZZ_EXTRA_COUNTER_COUNT 16384
+#endif
+
+struct OFSMFuzzFsmCoverage {
+    _OFSM_INDEX_DATA_TYPE groupIndex;
+    _OFSM_INDEX_DATA_TYPE fsmIndex;
+    OFSMTransition **transitionTable;
+    uint8_t eventCount;
+    uint8_t visitedStates[256 / 8];
+    uint8_t cells[256 * 256 / 8];        /*bit per (state, event)*/
+};
+
+struct OFSMFuzzInput {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+};
+
+static OFSMFuzzFsmCoverage _ofsmFuzzCoverage[OFSM_FUZZ_MAX_FSM_COUNT];
+static uint8_t _ofsmFuzzCoverageCount;
+static uint8_t _ofsmFuzzEventCount;     /*max. event count of all FSMs; event codes are generated up to it (inclusive, to hit 'unexpected event')*/
+static bool _ofsmFuzzIsInitialized;
+static unsigned long _ofsmFuzzExecutionCount;
+static unsigned long _ofsmFuzzCommandCount;
+static unsigned long _ofsmFuzzOverflowCount;
+static unsigned long _ofsmFuzzWakeupCheckCount;
+static bool _ofsmFuzzIsOverflow;              /*queue overflowed since main loop last drained all queues*/
+static bool _ofsmFuzzIsExecutionOverflow;     /*queue overflowed during current execution*/
+static const OFSMFuzzInput *_ofsmFuzzCurrentInput;
+static std::chrono::steady_clock::time_point _ofsmFuzzStart;
+
+#ifdef OFSM_FUZZ_LIBFUZZER
+__attribute__((used, section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t _ofsmFuzzExtraCounters[OFSM_FUZZ_EXTRA_COUNTER_COUNT];
+
+static OFSM *ofsm_fuzz_group_fsm(OFSMGroup *group, _OFSM_INDEX_DATA_TYPE fsmIndex) {
+#ifdef OFSM_CONFIG_SUPPORT_FSM_ARRAY
+    if (group->fsmArray) {
+        return group->fsmArray->cursor; /*transition table is shared by array instances*/
+    }
+#endif
+    return (group->fsms)[fsmIndex];
+}
+
+static OFSMFuzzFsmCoverage *ofsm_fuzz_coverage(OFSM *fsm, _OFSM_INDEX_DATA_TYPE groupIndex, _OFSM_INDEX_DATA_TYPE fsmIndex) {
+    OFSMFuzzFsmCoverage *c;
+    uint8_t i;
+    for (i = 0; i < _ofsmFuzzCoverageCount; i++) {
+        c = &(_ofsmFuzzCoverage[i]);
+        if (c->groupIndex == groupIndex && c->fsmIndex == fsmIndex) {
+            return c;
+        }
+    }
+    if (_ofsmFuzzCoverageCount >= OFSM_FUZZ_MAX_FSM_COUNT) {
+        return NULL;
+    }
+    c = &(_ofsmFuzzCoverage[_ofsmFuzzCoverageCount++]);
+    c->groupIndex = groupIndex;
+    c->fsmIndex = fsmIndex;
+    c->transitionTable = fsm->transitionTable;
+    c->eventCount = fsm->transitionTableEventCount;
+    return c;
+}
+
+void ofsm_fuzz_transition_hook(OFSM *fsm, unsigned int groupIndex, unsigned int fsmIndex, uint8_t eventCode) {
+    OFSMFuzzFsmCoverage *c = ofsm_fuzz_coverage(fsm, (_OFSM_INDEX_DATA_TYPE)groupIndex, (_OFSM_INDEX_DATA_TYPE)fsmIndex);
+    unsigned int cell = fsm->currentState * 256 + eventCode;
+    if (c) {
+        c->cells[cell / 8] |= (uint8_t)(1 << (cell % 8));
+        _ofsmFuzzExtraCounters[((unsigned int)(c - _ofsmFuzzCoverage) * 65537 + cell) & (OFSM_FUZZ_EXTRA_COUNTER_COUNT - 1)]++;
+    }
+}
+
+static void ofsm_fuzz_violation(const char *message) {
+    fprintf(stderr, "-FV[%s at command %lu of execution %lu, time %lu, wakeup time %lu]\n", message, _ofsmFuzzCommandCount, _ofsmFuzzExecutionCount, (unsigned long)_ofsmTime, (unsigned long)_ofsmWakeupTime);
+#ifndef OFSM_FUZZ_LIBFUZZER /*libFuzzer saves the input itself*/
+    FILE *f = fopen("ofsmFuzz.crash", "wb");
+    if (f) {
+        fwrite(_ofsmFuzzCurrentInput->data, 1, _ofsmFuzzCurrentInput->size, f);
+        fclose(f);
+    }
+#endif
+    abort();
+}
+
+/*invariants hold whenever main loop is done with all queued events*/
+static void ofsm_fuzz_check_invariants() {
+    _OFSM_INDEX_DATA_TYPE i, k;
+    OFSMGroup *group;
+    OFSMFuzzFsmCoverage *c;
+    bool isAnyFsmAwake = false;
+    bool isAnyGroupOverflow = false;
+    uint8_t state;
+
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        group = (_ofsmGroups)[i];
+        if (group->flags & _OFSM_FLAG_GROUP_BUFFER_OVERFLOW) {
+            _ofsmFuzzIsOverflow = true;
+            _ofsmFuzzIsExecutionOverflow = true;
+            isAnyGroupOverflow = true;
+        }
+        for (k = 0; k < group->groupSize; k++) {
+            c = ofsm_fuzz_coverage(ofsm_fuzz_group_fsm(group, k), i, k);
+            state = _OFSM_GROUP_FSM_CURRENT_STATE(group, k);
+            if (c) {
+                c->visitedStates[state / 8] |= (uint8_t)(1 << (state % 8));
+            }
+            if (!(_OFSM_GROUP_FSM_FLAGS(group, k) & _OFSM_FLAG_INFINITE_SLEEP)) {
+                isAnyFsmAwake = true;
+#ifndef OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK /*with slack OFSM may wakeup later than FSM*/
+                if (!(_ofsmFlags & (_OFSM_FLAG_OFSM_EVENT_QUEUED | _OFSM_FLAG_INFINITE_SLEEP)) && _OFSM_TIME_A_GT_B(_ofsmWakeupTime, _OFSM_GROUP_FSM_WAKEUP_TIME(group, k))) {
+                    ofsm_fuzz_violation("OFSM wakeup time is later than FSM wakeup time");
+                }
+#endif
+            }
+        }
+    }
+#ifdef OFSM_FUZZ_ABORT_ON_OVERFLOW
+    if (_ofsmFuzzIsOverflow) {
+        ofsm_fuzz_violation("Group event queue overflow");
+    }
+#endif
+    if (_ofsmFlags & _OFSM_FLAG_OFSM_EVENT_QUEUED) {
+        return; /*main loop has not processed queued events yet*/
+    }
+    if (!isAnyGroupOverflow) {
+        _ofsmFuzzIsOverflow = false; /*main loop has drained all queues, so that dropped events no longer excuse late wakeup*/
+    }
+    if (_ofsmFlags & _OFSM_FLAG_INFINITE_SLEEP) {
+        if (isAnyFsmAwake) {
+            ofsm_fuzz_violation("OFSM is in infinite sleep while FSM waits for timeout");
+        }
+        return;
+    }
+    if (!_ofsmFuzzIsOverflow) {
+        _ofsmFuzzWakeupCheckCount++;
+        if (_OFSM_TIME_A_GTE_B(_ofsmTime, _ofsmWakeupTime)) {
+            ofsm_fuzz_violation("Wakeup time is in the past without queue overflow");
+        }
+    }
+}
+
+static inline uint8_t ofsm_fuzz_byte(OFSMFuzzInput *in) {
+    return in->pos < in->size ? in->data[in->pos++] : 0;
+}
+
+/*each command is an opcode byte followed by its argument bytes*/
+static void ofsm_fuzz_execute(const uint8_t *data, size_t size) {
+    OFSMFuzzInput in = {data, size, 0};
+    _OFSM_INDEX_DATA_TYPE groupIndex;
+    uint8_t op;
+    uint8_t eventCode;
+    uint8_t eventData;
+    bool forceNewEvent;
+
+    _ofsmFuzzCurrentInput = &in;
+    _ofsmFuzzIsOverflow = false;
+    _ofsmFuzzIsExecutionOverflow = false;
+    _ofsm_simulation_reset();
+    _ofsm_simulation_fsm_thread(0); /*setup() and first pass through OFSM*/
+    _ofsmFuzzExecutionCount++;
+
+    while (in.pos < in.size) {
+        op = ofsm_fuzz_byte(&in);
+        forceNewEvent = (op & 0x08) != 0;
+        _ofsmFuzzCommandCount++;
+        switch (op & 0x07) {
+        case 0:         //group event
+        case 7:         //ISR event (group event unless OFSM_CONFIG_SUPPORT_ISR_STAGING)
+            groupIndex = (_OFSM_INDEX_DATA_TYPE)(ofsm_fuzz_byte(&in) % _ofsmGroupCount);
+            eventCode = ofsm_fuzz_byte(&in) % (_ofsmFuzzEventCount + 1);
+            eventData = ofsm_fuzz_byte(&in);
+#ifdef OFSM_CONFIG_SUPPORT_ISR_STAGING
+            if (7 == (op & 0x07)) {
+                ofsm_isr_queue_group_event(groupIndex, forceNewEvent, eventCode, eventData);
+                break;
+            }
+#endif
+            ofsm_queue_group_event(groupIndex, forceNewEvent, eventCode, eventData);
+            break;
+        case 2:         //global event
+            eventCode = ofsm_fuzz_byte(&in) % (_ofsmFuzzEventCount + 1);
+            eventData = ofsm_fuzz_byte(&in);
+            ofsm_queue_global_event(forceNewEvent, eventCode, eventData);
+            break;
+        case 3:         //heartbeat, a few ticks
+            ofsm_heartbeat(_ofsmTime + (ofsm_fuzz_byte(&in) & 0x07));
+            break;
+        case 4:         //heartbeat, up to 255 << 15 ticks
+            ofsm_heartbeat(_ofsmTime + ((_OFSM_TIME_DATA_TYPE)ofsm_fuzz_byte(&in) << (op >> 4)));
+            break;
+        case 1:         //wakeup (two opcodes, so that main loop gets to drain queues between events)
+        case 5:
+            OFSM_CONFIG_CUSTOM_WAKEUP_FUNC();
+            break;
+        case 6:         //run, up to 255 << 3 ticks (every wakeup on the way is a main loop pass)
+            _ofsm_simulation_run((_OFSM_TIME_DATA_TYPE)ofsm_fuzz_byte(&in) << ((op >> 4) & 0x03));
+            break;
+        }
+        ofsm_fuzz_check_invariants();
+    }
+    /*let main loop process the rest*/
+    OFSM_CONFIG_CUSTOM_WAKEUP_FUNC();
+    _ofsm_simulation_process_pending_events();
+    ofsm_fuzz_check_invariants();
+    if (_ofsmFuzzIsExecutionOverflow) {
+        _ofsmFuzzOverflowCount++;
+    }
+}
+
+static void ofsm_fuzz_report() {
+    OFSMFuzzFsmCoverage *c;
+    OFSMTransition *t;
+    unsigned int coveredCount, handlerCount, stateCount;
+    unsigned int s, e, cell;
+    uint8_t i;
+
+    for (i = 0; i < _ofsmFuzzCoverageCount; i++) {
+        c = &(_ofsmFuzzCoverage[i]);
+        coveredCount = handlerCount = stateCount = 0;
+        for (s = 0; s < 256; s++) {
+            if (!(c->visitedStates[s / 8] & (1 << (s % 8)))) {
+                continue;
+            }
+            stateCount++;
+            for (e = 0; e < c->eventCount; e++) {
+                t = (OFSMTransition*)((c->eventCount * s + e) * sizeof(OFSMTransition) + (char*)c->transitionTable);
+                cell = s * 256 + e;
+                if (t->eventHandler) {
+                    handlerCount++;
+                }
+                if (c->cells[cell / 8] & (1 << (cell % 8))) {
+                    coveredCount++;
+                }
+            }
+        }
+        fprintf(stderr, "-FC(%u,%u)[C:%u,H:%u,S:%u]\n", (unsigned int)c->groupIndex, (unsigned int)c->fsmIndex, coveredCount, handlerCount, stateCount);
+        for (s = 0; s < 256; s++) {
+            if (!(c->visitedStates[s / 8] & (1 << (s % 8)))) {
+                continue;
+            }
+            for (e = 0; e < c->eventCount; e++) {
+                t = (OFSMTransition*)((c->eventCount * s + e) * sizeof(OFSMTransition) + (char*)c->transitionTable);
+                cell = s * 256 + e;
+                if (t->eventHandler && !(c->cells[cell / 8] & (1 << (cell % 8)))) {
+                    fprintf(stderr, "\tS:%u,E:%u\n", s, e);
+                }
+            }
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _ofsmFuzzStart).count();
+    fprintf(stderr, "-FZ[E:%lu,C:%lu,O:%lu,W:%lu,T:%lu,R:%lu]\n", _ofsmFuzzExecutionCount, _ofsmFuzzCommandCount, _ofsmFuzzOverflowCount, _ofsmFuzzWakeupCheckCount, (unsigned long)ms, (unsigned long)(ms > 0 ? _ofsmFuzzExecutionCount * 1000.0 / ms : 0));
+}
+
+static void ofsm_fuzz_initialize() {
+    _OFSM_INDEX_DATA_TYPE i, k;
+    OFSM *fsm;
+    _ofsm_simulation_fsm_thread(0);
+    for (i = 0; i < _ofsmGroupCount; i++) {
+        for (k = 0; k < (_ofsmGroups)[i]->groupSize; k++) {
+            fsm = ofsm_fuzz_group_fsm((_ofsmGroups)[i], k);
+            if (fsm->transitionTableEventCount > _ofsmFuzzEventCount) {
+                _ofsmFuzzEventCount = fsm->transitionTableEventCount;
+            }
+        }
+    }
+    _ofsmFuzzStart = std::chrono::steady_clock::now();
+    _ofsmFuzzIsInitialized = true;
+    atexit(ofsm_fuzz_report);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!_ofsmFuzzIsInitialized) {
+        ofsm_fuzz_initialize();
+    }
+    ofsm_fuzz_execute(data, size);
+    return 0;
+}
+
+#ifndef OFSM_FUZZ_LIBFUZZER
+int main(int argc, char* argv[]) {
+    static uint8_t data[OFSM_FUZZ_MAX_INPUT_FILE_SIZE];
+    unsigned long executionCount = 100000;
+    uint32_t seed = 1;
+    bool hasInputFile = false;
+    size_t size;
+    size_t k;
+    unsigned long n;
+    FILE *f;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (0 == strncmp(argv[i], "-n", 2)) {
+            executionCount = strtoul(argv[i] + 2, NULL, 10);
+        }
+        else if (0 == strncmp(argv[i], "-s", 2)) {
+            seed = (uint32_t)strtoul(argv[i] + 2, NULL, 10);
+        }
+        else {
+            hasInputFile = true;
+            f = fopen(argv[i], "rb");
+            if (!f) {
+                fprintf(stderr, "Unable to open %s. Exiting...\n", argv[i]);
+                return 1;
+            }
+            size = fread(data, 1, sizeof(data), f);
+            fclose(f);
+            LLVMFuzzerTestOneInput(data, size);
+        }
+    }
+    if (hasInputFile) {
+        return 0;
+    }
+    if (!seed) {
+        seed = 1;
+    }
+    for (n = 0; n < executionCount; n++) {
+        /*xorshift32*/
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        size = seed % OFSM_FUZZ_MAX_INPUT_SIZE + 1;
+        for (k = 0; k < size; k++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            data[k] = (uint8_t)seed;
+        }
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    return 0;
+}
+#endif
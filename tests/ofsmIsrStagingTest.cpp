@@ -0,0 +1,25 @@
+/*
+OFSM ISR staging tests: ofsmTest sketch with OFSM_CONFIG_SUPPORT_ISR_STAGING.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmIsrStagingTest ofsmIsrStagingTest.cpp
+Usage: ofsmIsrStagingTest ofsmIsrStagingTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_ISR_STAGING
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_isr_staging_test_command_hook
+
+#include <deque>
+#include <string>
+bool ofsm_isr_staging_test_command_hook(std::deque<std::string> &tokens);
+
+#include "ofsmTest.cpp"
+
+/*Extra commands:
+    qn,<count>,<event code>     //stages <count> forced events into group 0 (as 'q[ueue],fi,<event code>' would do <count> times)*/
+bool ofsm_isr_staging_test_command_hook(std::deque<std::string> &tokens) {
+    if (tokens[0] == "qn" && tokens.size() > 2) {
+        for (int i = atoi(tokens[1].c_str()); i > 0; i--) {
+            ofsm_isr_queue_group_event(0, true, (uint8_t)atoi(tokens[2].c_str()), 0);
+        }
+        return true;
+    }
+    return false;
+}
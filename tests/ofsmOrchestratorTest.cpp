@@ -0,0 +1,109 @@
+/*
+OFSM orchestrator instances tests: default orchestrator is driven by script, worker orchestrator by extra commands on the same thread.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmOrchestratorTest ofsmOrchestratorTest.cpp -lpthread
+Usage: ofsmOrchestratorTest ofsmOrchestratorTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_ORCHESTRATOR_INSTANCES
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_orchestrator_test_command_hook
+
+#include "ofsmTest.h"
+bool ofsm_orchestrator_test_command_hook(std::deque<std::string> &tokens);
+#include <ofsm.impl.h>
+
+/*define events*/
+enum Events {Timeout = 0, Go};
+enum States {Idle = 0, Busy};
+enum FsmId	{MainFsm = 0, WorkerFsm};
+enum FsmGrpId {MainGroup = 0, WorkerGroup};
+enum OrchId {Worker = 0};
+
+/* Handlers declaration */
+void GoHandler();
+void DoneHandler();
+
+/* OFSM configuration */
+OFSMTransition transitionTable[][1 + Go] = {
+    /* timeout,                 Go */
+    { { 0,           Idle },    { GoHandler, Busy } }, //Idle
+    { { DoneHandler, Idle },    { 0,         Busy } }, //Busy
+};
+
+OFSM_DECLARE_FSM(MainFsm, transitionTable, 1 + Go, NULL, NULL, Idle);
+OFSM_DECLARE_FSM(WorkerFsm, transitionTable, 1 + Go, NULL, NULL, Idle);
+OFSM_DECLARE_GROUP(MainGroup, EVENT_QUEUE_SIZE, MainFsm);
+OFSM_DECLARE_GROUP(WorkerGroup, EVENT_QUEUE_SIZE, WorkerFsm);
+OFSM_DECLARE(MainGroup);
+OFSM_DECLARE_ORCHESTRATOR(Worker, WorkerGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/* Handler implementation */
+std::string handled; /*<d - default | w - worker orchestrator><group index>@<time> of every completed job*/
+
+/*job takes 5 ticks on default orchestrator and 3 ticks on worker*/
+void GoHandler() {
+    fsm_set_transition_delay(ofsm_query_orchestrator() == ofsm_get_orchestrator(Worker) ? 3 : 5);
+}
+
+void DoneHandler() {
+    _OFSM_TIME_DATA_TYPE currentTime;
+    ofsm_get_time(currentTime);
+    if (handled.length()) {
+        handled += ",";
+    }
+    handled += (ofsm_query_orchestrator() == ofsm_get_orchestrator(Worker) ? "w" : "d") + std::to_string((int)fsm_get_group_index()) + "@" + std::to_string((unsigned long long)currentTime);
+    fsm_set_infinite_delay();
+}
+
+/*Extra commands (w... commands select worker orchestrator, run its main loop and select default orchestrator back):
+    ws                                  //sets worker orchestrator up (time 0, FSMs in initial state)
+    wq,<event code>                     //queues event into worker group 0
+    wh,<time>                           //delivers heartbeat to worker
+    wst                                 //prints worker state: -WST[T:<time>,S:<state of worker FSM>,I:<1 - infinite sleep>,W:<wakeup time>]
+    hd                                  //prints (and clears) completed jobs: -HD[<d|w><group index>@<time>,...]*/
+bool ofsm_orchestrator_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[128];
+    OFSMOrchestrator *prev;
+    if (tokens[0] == "ws") {
+        prev = ofsm_query_orchestrator();
+        OFSM_SETUP_ORCHESTRATOR(Worker);
+        OFSM_LOOP();
+        ofsm_orchestrator_select(prev);
+        return true;
+    }
+    if ((tokens[0] == "wq" || tokens[0] == "wh") && tokens.size() > 1) {
+        prev = ofsm_orchestrator_select(ofsm_get_orchestrator(Worker));
+        if (tokens[0] == "wq") {
+            ofsm_queue_group_event(0, false, (uint8_t)atoi(tokens[1].c_str()), 0);
+        }
+        else {
+            ofsm_heartbeat((_OFSM_TIME_DATA_TYPE)strtoull(tokens[1].c_str(), NULL, 10));
+        }
+        OFSM_LOOP();
+        ofsm_orchestrator_select(prev);
+        return true;
+    }
+    if (tokens[0] == "wst") {
+        prev = ofsm_orchestrator_select(ofsm_get_orchestrator(Worker));
+        _ofsm_snprintf(buf, sizeof(buf), "-WST[T:%llu,S:%i,I:%i,W:%llu]", (unsigned long long)_ofsmTime, (int)ofsm_query_fsm_next_state(0, 0),
+            (_ofsmFlags & _OFSM_FLAG_INFINITE_SLEEP) ? 1 : 0, (unsigned long long)_ofsmWakeupTime);
+        ofsm_orchestrator_select(prev);
+    }
+    else if (tokens[0] == "hd") {
+        _ofsm_snprintf(buf, sizeof(buf), "-HD[%s]", handled.c_str());
+        handled.clear();
+    }
+    else {
+        return false;
+    }
+    ofsm_simulation_set_assert_compare_string(buf);
+    std::cout << buf << std::endl;
+    return true;
+}
@@ -0,0 +1,50 @@
+/*
+OFSM queue status (OFSMQueueStatus) and elastic queue tests; ring buffer and shared event pool groups.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmQueueStatusTest ofsmQueueStatusTest.cpp
+Usage: ofsmQueueStatusTest ofsmQueueStatusTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_ELASTIC_QUEUE
+#define OFSM_CONFIG_SUPPORT_SHARED_EVENT_POOL
+#define OFSM_QUEUE_TEST_CUSTOM_COMMAND_HOOK_FUNC ofsm_queue_status_test_command_hook
+
+#include "ofsmQueueTest.h"
+
+enum FsmId	{RingFsm = 0, PoolFsm, TinyFsm};
+enum FsmGrpId {RingGroup = 0, PoolGroup, TinyGroup};
+
+OFSM_DECLARE_FSM(RingFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_FSM(PoolFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_FSM(TinyFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_EVENT_POOL(EventPool, 2);
+OFSM_DECLARE_GROUP(RingGroup, EVENT_QUEUE_SIZE, RingFsm);
+OFSM_DECLARE_GROUP_SHARED_QUEUE(PoolGroup, EventPool, 1, PoolFsm);
+OFSM_DECLARE_GROUP(TinyGroup, 1, TinyFsm);
+OFSM_DECLARE(RingGroup, PoolGroup, TinyGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/*Extra commands (see ofsmQueueTest.h for qs, hd):
+    ql,<group index>,<max size>,<high watermark>    //sets group event queue limits (see ofsm_set_group_event_queue_limit())
+    qz,<group index>                                //prints ring buffer size and pending event count of the group: -QZ(<group index>)[<size>,<pending>]*/
+bool ofsm_queue_status_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[64];
+    _OFSM_INDEX_DATA_TYPE groupIndex = tokens.size() > 1 ? (_OFSM_INDEX_DATA_TYPE)atoi(tokens[1].c_str()) : 0;
+    if (tokens[0] == "ql" && tokens.size() > 3) {
+        ofsm_set_group_event_queue_limit(groupIndex, (_OFSM_INDEX_DATA_TYPE)atoi(tokens[2].c_str()), (_OFSM_INDEX_DATA_TYPE)atoi(tokens[3].c_str()));
+        return true;
+    }
+    if (tokens[0] == "qz") {
+        _ofsm_snprintf(buf, sizeof(buf), "-QZ(%i)[%i,%i]", (int)groupIndex, (int)ofsm_query_get_group(groupIndex)->eventQueueSize,
+            (int)_ofsm_group_local_pending_event_count(ofsm_query_get_group(groupIndex)));
+        ofsm_queue_test_print(buf);
+        return true;
+    }
+    return false;
+}
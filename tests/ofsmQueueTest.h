@@ -0,0 +1,98 @@
+#ifndef __OFSM_QUEUE_TEST_H__
+#define __OFSM_QUEUE_TEST_H__
+/*
+Shared fixture of queue tests (event pool, queue status, broadcast, topics): single state transition table, which records every handled event,
+and script commands to queue events and to check handled ones.
+Sketch defines its features, includes this file instead of ofsmTest.h and then declares FSMs (with transitionTable), groups, setup() and loop().
+Events:
+    0 - Timeout
+    1 - Data    (handled by DataHandler)
+    2 - Other   (handled by DataHandler)
+Extra commands:
+    qs,<group index>|g,<event code>,<event data>[,f]    //queues group ('g' - global) event ('f' - force new event) and prints queue status: -QS[QUEUED|REPLACED|BACKPRESSURE|DROPPED]
+    hd                                                  //prints (and clears) events handled by all groups in order: -HD[<group index>:<event code>:<event data>,...]
+    hd,<group index>                                    //prints (and clears) events handled by the group in order: -HD(<group index>)[<event code>:<event data>,...]
+Sketch adds its own commands by defining OFSM_QUEUE_TEST_CUSTOM_COMMAND_HOOK_FUNC (signature of OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC);
+it is called first and prints its result with ofsm_queue_test_print().
+*/
+#define OFSM_CONFIG_SUPPORT_EVENT_DATA
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_queue_test_command_hook
+
+#include "ofsmTest.h"
+bool ofsm_queue_test_command_hook(std::deque<std::string> &tokens);
+#ifdef OFSM_QUEUE_TEST_CUSTOM_COMMAND_HOOK_FUNC
+bool OFSM_QUEUE_TEST_CUSTOM_COMMAND_HOOK_FUNC(std::deque<std::string> &tokens);
+#endif
+#include <ofsm.impl.h>
+
+/*define events*/
+enum Events {Timeout = 0, Data, Other};
+enum States {S0 = 0};
+
+/* Handlers declaration */
+void DataHandler();
+
+/* OFSM configuration */
+OFSMTransition transitionTable[][1 + Other] = {
+    /* timeout,     Data,                   Other */
+    { { 0, S0 },    { DataHandler, S0 },    { DataHandler, S0 } }, //S0
+};
+
+/* Handler implementation */
+std::vector<std::pair<int, std::string> > handled; /*group index and <event code>:<event data> of every handled event*/
+
+void DataHandler() {
+    handled.push_back(std::make_pair((int)fsm_get_group_index(), std::to_string((int)fsm_get_event_code()) + ":" + std::to_string((long)fsm_get_event_data())));
+    fsm_set_infinite_delay();
+}
+
+static const char *ofsmQueueTestStatusNames[] = {"QUEUED", "REPLACED", "BACKPRESSURE", "DROPPED"}; /*indexed by OFSMQueueStatus*/
+
+static void ofsm_queue_test_print(const char *buf) {
+    ofsm_simulation_set_assert_compare_string(buf);
+    std::cout << buf << std::endl;
+}
+
+bool ofsm_queue_test_command_hook(std::deque<std::string> &tokens) {
+    std::string s;
+    char buf[256];
+#ifdef OFSM_QUEUE_TEST_CUSTOM_COMMAND_HOOK_FUNC
+    if (OFSM_QUEUE_TEST_CUSTOM_COMMAND_HOOK_FUNC(tokens)) {
+        return true;
+    }
+#endif
+    if (tokens[0] == "qs" && tokens.size() > 3) {
+        bool forceNewEvent = tokens.size() > 4 && tokens[4] == "f";
+        uint8_t eventCode = (uint8_t)atoi(tokens[2].c_str());
+        OFSM_CONFIG_EVENT_DATA_TYPE eventData = (OFSM_CONFIG_EVENT_DATA_TYPE)atol(tokens[3].c_str());
+        OFSMQueueStatus status = tokens[1] == "g" ? ofsm_queue_global_event(forceNewEvent, eventCode, eventData) :
+            ofsm_queue_group_event((_OFSM_INDEX_DATA_TYPE)atoi(tokens[1].c_str()), forceNewEvent, eventCode, eventData);
+        _ofsm_snprintf(buf, sizeof(buf), "-QS[%s]", ofsmQueueTestStatusNames[status]);
+    }
+    else if (tokens[0] == "hd" && tokens.size() > 1) {
+        int groupIndex = atoi(tokens[1].c_str());
+        for (size_t i = 0; i < handled.size();) {
+            if (handled[i].first != groupIndex) {
+                i++;
+                continue;
+            }
+            s += (s.length() ? "," : "") + handled[i].second;
+            handled.erase(handled.begin() + i);
+        }
+        _ofsm_snprintf(buf, sizeof(buf), "-HD(%i)[%s]", groupIndex, s.c_str());
+    }
+    else if (tokens[0] == "hd") {
+        for (size_t i = 0; i < handled.size(); i++) {
+            s += (s.length() ? "," : "") + std::to_string(handled[i].first) + ":" + handled[i].second;
+        }
+        handled.clear();
+        _ofsm_snprintf(buf, sizeof(buf), "-HD[%s]", s.c_str());
+    }
+    else {
+        return false;
+    }
+    ofsm_queue_test_print(buf);
+    return true;
+}
+
+#endif /*__OFSM_QUEUE_TEST_H__*/
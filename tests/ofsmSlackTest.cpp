@@ -0,0 +1,83 @@
+/*
+OFSM transition delay slack (wakeup coalescing) tests.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmSlackTest ofsmSlackTest.cpp
+Usage: ofsmSlackTest ofsmSlackTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_TRANSITION_DELAY_SLACK
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_slack_test_command_hook
+
+#include "ofsmTest.h"
+bool ofsm_slack_test_command_hook(std::deque<std::string> &tokens);
+#include <ofsm.impl.h>
+
+/*define events*/
+enum Events {Timeout = 0, Start};
+enum States {Idle = 0, Waiting};
+enum FsmId	{SlackFsm = 0, ExactFsm};
+enum FsmGrpId {SlackGroup = 0, ExactGroup};
+
+/* Handlers declaration */
+void StartHandler();
+void TimeoutHandler();
+
+/* OFSM configuration */
+OFSMTransition transitionTable[][1 + Start] = {
+    /* timeout,                     Start */
+    { { 0,              Idle },     { StartHandler, Waiting } }, //Idle
+    { { TimeoutHandler, Idle },     { 0,            Waiting } }, //Waiting
+};
+
+OFSM_DECLARE_FSM(SlackFsm, transitionTable, 1 + Start, NULL, NULL, Idle);
+OFSM_DECLARE_FSM(ExactFsm, transitionTable, 1 + Start, NULL, NULL, Idle);
+OFSM_DECLARE_GROUP(SlackGroup, EVENT_QUEUE_SIZE, SlackFsm);
+OFSM_DECLARE_GROUP(ExactGroup, EVENT_QUEUE_SIZE, ExactFsm);
+OFSM_DECLARE(SlackGroup, ExactGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/* Handler implementation */
+_OFSM_TIME_DATA_TYPE slackTicks[] = {10, 0};     /*slack of the FSM of each group*/
+_OFSM_TIME_DATA_TYPE delayTicks[] = {100, 105};  /*transition delay of the FSM of each group*/
+std::string timeouts; /*<group index>@<time> of every delivered timeout*/
+
+void StartHandler() {
+    fsm_set_transition_delay_slack(delayTicks[fsm_get_group_index()], slackTicks[fsm_get_group_index()]);
+}
+
+void TimeoutHandler() {
+    _OFSM_TIME_DATA_TYPE currentTime;
+    ofsm_get_time(currentTime);
+    if (timeouts.length()) {
+        timeouts += ",";
+    }
+    timeouts += std::to_string((int)fsm_get_group_index()) + "@" + std::to_string((unsigned long long)currentTime);
+    fsm_set_infinite_delay();
+}
+
+/*Extra commands:
+    sd,<group index>,<delay ticks>,<slack ticks>    //sets transition delay and slack used by the FSM of the group on Start event
+    to                                              //prints (and clears) delivered timeouts: -TO[<group index>@<time>,...]*/
+bool ofsm_slack_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[80];
+    if (tokens[0] == "sd" && tokens.size() > 3) {
+        _OFSM_INDEX_DATA_TYPE groupIndex = (_OFSM_INDEX_DATA_TYPE)atoi(tokens[1].c_str());
+        delayTicks[groupIndex] = (_OFSM_TIME_DATA_TYPE)strtoull(tokens[2].c_str(), NULL, 10);
+        slackTicks[groupIndex] = (_OFSM_TIME_DATA_TYPE)strtoull(tokens[3].c_str(), NULL, 10);
+        return true;
+    }
+    if (tokens[0] == "to") {
+        _ofsm_snprintf(buf, sizeof(buf), "-TO[%s]", timeouts.c_str());
+        timeouts.clear();
+        ofsm_simulation_set_assert_compare_string(buf);
+        std::cout << buf << std::endl;
+        return true;
+    }
+    return false;
+}
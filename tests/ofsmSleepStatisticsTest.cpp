@@ -0,0 +1,8 @@
+/*
+OFSM sleep statistics tests: ofsmTest sketch with OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmSleepStatisticsTest ofsmSleepStatisticsTest.cpp
+Usage: ofsmSleepStatisticsTest ofsmSleepStatisticsTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_SLEEP_STATISTICS
+
+#include "ofsmTest.cpp"
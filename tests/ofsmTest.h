@@ -10,6 +10,7 @@
 #   define OFSM_CONFIG_SIMULATION_DEBUG_LEVEL_OFSM 0         /* turn off ofsm debug print */
 #   define OFSM_CONFIG_SIMULATION_SCRIPT_MODE_SLEEP_BETWEEN_EVENTS_MS 0 /* don't sleep between script commands */
 #   define OFSM_CONFIG_DEFAULT_STATE_TRANSITION_DELAY 1     /* make 1 tick as default delay between transitions */
+#   define OFSM_CONFIG_SUPPORT_SNAPSHOT                      /* allow test cases to start from snapshot */
 #else 
 /* When F_CPU is defined, we can be confident that sketch is being compiled to be flushed into MCU, otherwise we assume SIMULATION mode */
 #   ifndef F_CPU
@@ -0,0 +1,35 @@
+/*
+OFSM time data type tests: time register wraparound of 16 bit time (64 bit or any other unsigned type can be given on the command line).
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmTimeTest ofsmTimeTest.cpp
+    64 bit time: g++ -Wall -std=c++11 -fexceptions -DUTEST -DOFSM_CONFIG_TIME_DATA_TYPE=uint64_t -I../src -g -o ofsmTimeTest ofsmTimeTest.cpp
+Usage: ofsmTimeTest ofsmTimeTest.test
+*/
+#include <stdint.h>
+#include <deque>
+#include <string>
+
+#ifndef OFSM_CONFIG_TIME_DATA_TYPE
+#   define OFSM_CONFIG_TIME_DATA_TYPE uint16_t
+#endif
+bool ofsm_time_test_command_hook(std::deque<std::string> &tokens);
+#define OFSM_CONFIG_CUSTOM_SIMULATION_COMMAND_HOOK_FUNC ofsm_time_test_command_hook
+
+#include "ofsmTest.cpp"
+
+/*Extra command:
+    t       //prints current time read by ofsm_get_time() and by its deprecated form: -T[<time>,<time>,<time flags>]*/
+bool ofsm_time_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[80];
+    _OFSM_TIME_DATA_TYPE time;
+    _OFSM_TIME_DATA_TYPE deprecatedTime;
+    uint8_t timeFlags = 0xFF;
+    if (tokens[0] != "t") {
+        return false;
+    }
+    ofsm_get_time(time);
+    ofsm_get_time(deprecatedTime, timeFlags);
+    _ofsm_snprintf(buf, sizeof(buf), "-T[%llu,%llu,%u]", (unsigned long long)time, (unsigned long long)deprecatedTime, (unsigned int)timeFlags);
+    ofsm_simulation_set_assert_compare_string(buf);
+    std::cout << buf << std::endl;
+    return true;
+}
@@ -0,0 +1,49 @@
+/*
+OFSM topics tests.
+Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmTopicTest ofsmTopicTest.cpp
+Usage: ofsmTopicTest ofsmTopicTest.test
+*/
+#define OFSM_CONFIG_SUPPORT_TOPICS
+#define OFSM_QUEUE_TEST_CUSTOM_COMMAND_HOOK_FUNC ofsm_topic_test_command_hook
+
+#include "ofsmQueueTest.h"
+
+enum FsmId	{SensorFsm = 0, LoggerFsm, DisplayFsm};
+enum FsmGrpId {SensorGroup = 0, LoggerGroup, DisplayGroup};
+
+OFSM_DECLARE_FSM(SensorFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_FSM(LoggerFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_FSM(DisplayFsm, transitionTable, 1 + Other, NULL, NULL, S0);
+OFSM_DECLARE_GROUP(SensorGroup, EVENT_QUEUE_SIZE, SensorFsm);
+OFSM_DECLARE_GROUP(LoggerGroup, EVENT_QUEUE_SIZE, LoggerFsm);
+OFSM_DECLARE_GROUP(DisplayGroup, EVENT_QUEUE_SIZE, DisplayFsm);
+OFSM_DECLARE(SensorGroup, LoggerGroup, DisplayGroup);
+
+OFSM_DECLARE_TOPIC(MeasurementTopic, LoggerGroup, DisplayGroup);
+OFSM_DECLARE_TOPIC(ConfigTopic, SensorGroup, DisplayGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/*Extra commands (see ofsmQueueTest.h for qs, hd):
+    tp,m|c,<event code>,<event data>[,f]    //publishes event into MeasurementTopic ('m') or ConfigTopic ('c') ('f' - force new event) and prints status: -TP[QUEUED|REPLACED|BACKPRESSURE|DROPPED]*/
+bool ofsm_topic_test_command_hook(std::deque<std::string> &tokens) {
+    char buf[64];
+    if (tokens[0] == "tp" && tokens.size() > 3) {
+        bool forceNewEvent = tokens.size() > 4 && tokens[4] == "f";
+        uint8_t eventCode = (uint8_t)atoi(tokens[2].c_str());
+        OFSM_CONFIG_EVENT_DATA_TYPE eventData = (OFSM_CONFIG_EVENT_DATA_TYPE)atol(tokens[3].c_str());
+        OFSMQueueStatus status = tokens[1] == "m" ? ofsm_publish(MeasurementTopic, forceNewEvent, eventCode, eventData) :
+            ofsm_publish(ConfigTopic, forceNewEvent, eventCode, eventData);
+        _ofsm_snprintf(buf, sizeof(buf), "-TP[%s]", ofsmQueueTestStatusNames[status]);
+        ofsm_queue_test_print(buf);
+        return true;
+    }
+    return false;
+}
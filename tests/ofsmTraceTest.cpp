@@ -0,0 +1,86 @@
+/*
+OFSM trace record and replay test: replays checked-in trace recorded by threaded build of this sketch.
+Record and replay builds must share OFSM configuration, so the sketch has its own fixed configuration (ofsmTest.h differs between the two).
+Replay:
+    Compiler Command line: g++ -Wall -std=c++11 -fexceptions -DUTEST -I../src -g -o ofsmTraceTest ofsmTraceTest.cpp
+    Usage: ofsmTraceTest --replay ofsmTraceTest.trace //expected summary: -TR[R:<records>,P:<passes>,D:0]
+Record (re-create trace after changing the sketch or OFSM state layout):
+    Compiler Command line: g++ -Wall -std=c++11 -fexceptions -I../src -g -o ofsmTraceTest_r ofsmTraceTest.cpp -lpthread
+    Usage: ofsmTraceTest_r --record ofsmTraceTest.trace ofsmTraceTest.record
+*/
+#define OFSM_CONFIG_SIMULATION                                  /* turn on simulation mode */
+#define OFSM_CONFIG_SIMULATION_TRACE                            /* record (threaded build) or replay (script mode build) */
+#ifdef UTEST
+#   define OFSM_CONFIG_SIMULATION_SCRIPT_MODE                   /* run main loop synchronously */
+#   define OFSM_CONFIG_SIMULATION_SCRIPT_MODE_WAKEUP_TYPE 3     /* replay requires manual wakeup */
+#   define OFSM_CONFIG_SIMULATION_SCRIPT_MODE_SLEEP_BETWEEN_EVENTS_MS 0 /* don't sleep between script commands */
+#endif
+#define OFSM_CONFIG_SIMULATION_DEBUG_LEVEL 0                    /* turn off sketch debug print */
+#define OFSM_CONFIG_SIMULATION_DEBUG_LEVEL_OFSM 0               /* turn off ofsm debug print */
+#define OFSM_CONFIG_SIMULATION_TICK_MS 10                       /* 1 tick == 10 milliseconds */
+#define OFSM_CONFIG_DEFAULT_STATE_TRANSITION_DELAY 1            /* make 1 tick as default delay between transitions */
+
+#define EVENT_QUEUE_SIZE 3 /*event queue size*/
+
+#include <ofsm.decl.h>
+#include <ofsm.impl.h>
+
+/*define events*/
+enum Events {Timeout = 0, On, Off};
+enum States {Dark = 0, Lit, Blinking};
+enum FsmId	{LedFsm = 0, CounterFsm};
+enum FsmGrpId {LedGroup = 0, CounterGroup};
+
+/* Handlers declaration */
+void BlinkHandler();
+void StopHandler();
+void CountHandler();
+
+/* OFSM configuration */
+OFSMTransition ledTransitionTable[][1 + Off] = {
+    /* timeout,                     On,                         Off */
+    { { 0,              Dark },     { BlinkHandler, Lit },      { 0,           Dark } }, //Dark
+    { { BlinkHandler,   Blinking }, { 0,            Lit },      { StopHandler, Dark } }, //Lit
+    { { BlinkHandler,   Lit },      { 0,            Blinking }, { StopHandler, Dark } }, //Blinking
+};
+
+OFSMTransition counterTransitionTable[][1 + Off] = {
+    /* timeout,                 On,                         Off */
+    { { 0,          Dark },     { CountHandler, Dark },     { CountHandler, Dark } }, //Dark
+};
+
+unsigned long eventCount;
+
+OFSM_DECLARE_FSM(LedFsm, ledTransitionTable, 1 + Off, NULL, NULL, Dark);
+OFSM_DECLARE_FSM(CounterFsm, counterTransitionTable, 1 + Off, NULL, &eventCount, Dark);
+OFSM_DECLARE_GROUP(LedGroup, EVENT_QUEUE_SIZE, LedFsm);
+OFSM_DECLARE_GROUP(CounterGroup, EVENT_QUEUE_SIZE, CounterFsm);
+OFSM_DECLARE(LedGroup, CounterGroup);
+
+/* Setup */
+void setup() {
+    OFSM_SETUP();
+}
+
+void loop() {
+    OFSM_LOOP();
+}
+
+/* Handler implementation */
+void BlinkHandler() {
+    fsm_set_transition_delay(3);
+}
+
+void StopHandler() {
+    fsm_set_infinite_delay();
+}
+
+/*counts global events; queues Off into LedGroup after every 4th one (event queued by FSM is not recorded, replay produces it again)*/
+void CountHandler() {
+    unsigned long *count = fsm_get_private_data_cast(unsigned long*);
+    (*count)++;
+    if (0 == (*count % 4)) {
+        ofsm_queue_group_event(LedGroup, false, Off, 0);
+    }
+    fsm_set_infinite_delay();
+}